@@ -20,588 +20,2007 @@
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <getopt.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <time.h>
 
 #include "list.h"
+#include "arena.h"
+#include "batch.h"
+#include "archive.h"
 #include "acpi.h"
+#include "stats.h"
 
 #define DEVICE_LEN	20
-#define TRIP_POINTS	5
-#define BATTERY_DESC	"Battery"
-#define AC_ADAPTER_DESC "Adapter"
-#define THERMAL_DESC	"Thermal"
-#define COOLING_DESC	"Cooling"
-
-#define MIN_PRESENT_RATE 0.01
-#define MIN_CAPACITY	 0.01
-#define MIN_TEMP	 0.01
+#define ATTR_BUF_SIZE	4096
+#define WATCH_RESCAN	10
+#define WATCH_FD_RESERVE	32
+#define UEVENT_MAX	64
+#define MAX_FILE_INDEX	1000	/* of trip points and sensors */
 
 static int ignore_directory_entry(struct dirent *de)
 {
     return !strcmp(de->d_name, ".") || !strcmp(de->d_name, "..");
 }
 
-static struct field *parse_field(char *buf, char *given_attr)
+static int get_unit_value(char *value)
+{
+    int n = -1;
+    sscanf(value, "%d", &n);
+    return n;
+}
+
+static long get_long_value(char *value)
+{
+    long n = -1;
+    sscanf(value, "%ld", &n);
+    return n;
+}
+
+static struct list *arena_list_append(struct arena *a, struct list *node, void *data)
+{
+    struct list *r;
+
+    r = arena_alloc(a, sizeof(struct list));
+    if (!r)
+	return node;
+    r->data = data;
+    r->next = node;
+    return r;
+}
+
+static char *arena_strdup(struct arena *a, char *s)
+{
+    return arena_strndup(a, s, strlen(s));
+}
+
+static int is_thermal_zone(char *type)
+{
+    return strstr(type, "thermal zone") != NULL || strstr(type, "acpitz") != NULL;
+}
+
+/* names of the values in the /proc files, the capacity ones are given in
+ * mA, mAh or mWh there */
+static const struct proc_attr {
+    char *name;
+    int id;
+    int nocase;
+    int scale;
+} proc_attrs[] = {
+    {"remaining capacity", ATTR_CHARGE_NOW, TRUE, 1000},
+    {"present rate", ATTR_CURRENT_NOW, TRUE, 1000},
+    {"last full capacity", ATTR_CHARGE_FULL, TRUE, 1000},
+    {"charging state", ATTR_CHARGING_STATE, FALSE, 1},
+    {"State", ATTR_CHARGING_STATE, FALSE, 1},
+    {"state", ATTR_STATE, FALSE, 1},
+    {"status", ATTR_STATUS, FALSE, 1},
+    {"temperature", ATTR_TEMPERATURE, FALSE, 1},
+    {NULL, ATTR_OTHER, FALSE, 1}
+};
+
+static const struct proc_attr *proc_attr_lookup(char *name)
+{
+    const struct proc_attr *p;
+
+    for (p = proc_attrs; p->name; p++)
+	if (p->nocase ? !strcasecmp(name, p->name) : !strcmp(name, p->name))
+	    break;
+    return p;
+}
+
+static size_t record_size(int device_nr)
+{
+    switch (device_nr) {
+    case BATTERY:
+	return sizeof(struct battery_info);
+    case AC_ADAPTER:
+	return sizeof(struct adapter_info);
+    case THERMAL_ZONE:
+	return sizeof(struct thermal_info);
+    case HWMON:
+	return sizeof(struct hwmon_info);
+    default:
+	return sizeof(struct cooling_info);
+    }
+}
+
+static void init_record(int device_nr, void *rec)
+{
+    memset(rec, 0, record_size(device_nr));
+    switch (device_nr) {
+    case AC_ADAPTER:
+	((struct adapter_info *) rec)->online = -1;
+	break;
+    case THERMAL_ZONE:
+	((struct thermal_info *) rec)->temperature = -1;
+	((struct thermal_info *) rec)->trip_points = -1;
+	break;
+    case COOLING_DEV:
+	((struct cooling_info *) rec)->cur_state = -1;
+	((struct cooling_info *) rec)->max_state = -1;
+	break;
+    }
+}
+
+static void set_stale(int device_nr, void *rec, long ms)
+{
+    switch (device_nr) {
+    case BATTERY:
+	((struct battery_info *) rec)->stale_ms = ms;
+	break;
+    case AC_ADAPTER:
+	((struct adapter_info *) rec)->stale_ms = ms;
+	break;
+    case THERMAL_ZONE:
+	((struct thermal_info *) rec)->stale_ms = ms;
+	break;
+    case HWMON:
+	((struct hwmon_info *) rec)->stale_ms = ms;
+	break;
+    default:
+	((struct cooling_info *) rec)->stale_ms = ms;
+	break;
+    }
+}
+
+static unsigned int record_have(int device_nr, void *rec)
+{
+    switch (device_nr) {
+    case BATTERY:
+	return ((struct battery_info *) rec)->have;
+    case AC_ADAPTER:
+	return ((struct adapter_info *) rec)->have;
+    case THERMAL_ZONE:
+	return ((struct thermal_info *) rec)->have;
+    case HWMON:
+	return ((struct hwmon_info *) rec)->have;
+    default:
+	return ((struct cooling_info *) rec)->have;
+    }
+}
+
+static void set_battery_attr(struct arena *a, struct battery_info *b, int id, char *value, int scale)
+{
+    long *v;
+
+    if (HAS_ATTR(b, id))
+	return;
+    switch (id) {
+    case ATTR_CHARGING_STATE:
+	b->state = arena_strdup(a, value);
+	break;
+    case ATTR_TYPE:
+	b->type = arena_strdup(a, value);
+	break;
+    case ATTR_CURRENT_NOW: v = &b->current_now; goto number;
+    case ATTR_POWER_NOW: v = &b->power_now; goto number;
+    case ATTR_CHARGE_NOW: v = &b->charge_now; goto number;
+    case ATTR_ENERGY_NOW: v = &b->energy_now; goto number;
+    case ATTR_VOLTAGE_NOW: v = &b->voltage_now; goto number;
+    case ATTR_CHARGE_FULL: v = &b->charge_full; goto number;
+    case ATTR_ENERGY_FULL: v = &b->energy_full; goto number;
+    case ATTR_CHARGE_FULL_DESIGN: v = &b->charge_full_design; goto number;
+    case ATTR_ENERGY_FULL_DESIGN: v = &b->energy_full_design; goto number;
+    case ATTR_CAPACITY: v = &b->capacity;
+    number:
+	*v = get_long_value(value) * scale;
+	break;
+    }
+    b->have |= ATTR_BIT(id);
+}
+
+static void set_adapter_attr(struct arena *a, struct adapter_info *ac, int id, char *value)
+{
+    if (HAS_ATTR(ac, id))
+	return;
+    switch (id) {
+    case ATTR_STATE:
+    case ATTR_STATUS:
+	if (!ac->state)
+	    ac->state = arena_strdup(a, value);
+	break;
+    case ATTR_ONLINE:
+	ac->online = get_unit_value(value);
+	if (!ac->state)
+	    ac->state = ac->online ? "on-line" : "off-line";
+	break;
+    case ATTR_TYPE:
+	ac->type = arena_strdup(a, value);
+	break;
+    }
+    ac->have |= ATTR_BIT(id);
+}
+
+/* trip points and sensors are stored at their number in an array of n
+ * that grows as needed; returns NULL if it cannot */
+static void *numbered(struct arena *a, void **array, int *n, int *size, int index, size_t elem)
 {
-    struct field *rval;
     char *p;
-    char *attr;
-    char *value;
-    int has_attr = 0;
-
-    attr = calloc(BUF_SIZE, sizeof(char));
-    value = calloc(BUF_SIZE, sizeof(char));
-    rval = malloc(sizeof(struct field));
-    if (!rval || !attr || !value) {
-	fprintf(stderr, "Out of memory. Could not allocate memory in parse_field.\n");
-	exit(1);
-    }
-
-    p = buf;
-    if (!given_attr) {
-	while (*(p++)) {
-	    if (*p == ':') {
-		strncpy(attr, buf, p - buf);
-		has_attr = 1;
-		break;
-	    }
-	}
-	if (!has_attr) {
-	    free(attr);
-	    free(value);
-	    free(rval);
+    int new_size;
+
+    if (index >= *size) {
+	new_size = *size ? 2 * *size : 8;
+	while (new_size <= index)
+	    new_size *= 2;
+	p = arena_alloc(a, new_size * elem);
+	if (!p)
 	    return NULL;
+	memset(p, 0, new_size * elem);
+	if (*size)
+	    memcpy(p, *array, *size * elem);
+	*array = p;
+	*size = new_size;
+    }
+    if (index >= *n)
+	*n = index + 1;
+    return (char *) *array + index * elem;
+}
+
+static struct trip_point *trip_point(struct arena *a, struct thermal_info *z, int index)
+{
+    void *array = z->trip;
+    struct trip_point *trip = numbered(a, &array, &z->n_trip, &z->trip_size, index, sizeof(struct trip_point));
+
+    z->trip = array;
+    return trip;
+}
+
+static int compare_trip_temp(const void *a, const void *b)
+{
+    const struct trip_point *ta = *(struct trip_point * const *) a;
+    const struct trip_point *tb = *(struct trip_point * const *) b;
+
+    if (ta->temp != tb->temp)
+	return ta->temp < tb->temp ? -1 : 1;
+    /* on equal temperatures the lower trip point has to come last */
+    return tb < ta ? -1 : tb > ta;
+}
+
+/* the trip points that count, sorted by temperature for the state lookup */
+static void sort_trip_points(struct arena *a, struct thermal_info *z)
+{
+    int i;
+
+    z->by_temp = arena_alloc(a, (z->trip_points + 1) * sizeof(struct trip_point *));
+    z->n_by_temp = 0;
+    if (!z->by_temp)
+	return;
+    for (i = 0; i <= z->trip_points; i++)
+	if (z->trip[i].temp >= MIN_TEMP)
+	    z->by_temp[z->n_by_temp++] = &z->trip[i];
+    qsort(z->by_temp, z->n_by_temp, sizeof(struct trip_point *), compare_trip_temp);
+}
+
+static void set_thermal_attr(struct arena *a, struct thermal_info *z, int id, int index, char *value)
+{
+    struct trip_point *trip;
+
+    switch (id) {
+    case ATTR_STATE:
+	if (!z->state)
+	    z->state = arena_strdup(a, value);
+	break;
+    case ATTR_TYPE:
+	if (!z->type)
+	    z->type = arena_strdup(a, value);
+	break;
+    case ATTR_TEMPERATURE:
+	if (HAS_ATTR(z, ATTR_TEMP) || HAS_ATTR(z, ATTR_TEMPERATURE))
+	    break;
+	z->temperature = get_unit_value(value);
+	if (strstr(value, "dK"))
+	    z->temperature = (z->temperature / 10) - ABSOLUTE_ZERO;
+	break;
+    case ATTR_TEMP:
+	if (HAS_ATTR(z, ATTR_TEMP) || HAS_ATTR(z, ATTR_TEMPERATURE))
+	    break;
+	z->temperature = get_unit_value(value) / 1000.0;
+	break;
+    case ATTR_TRIP_TEMP:
+	trip = trip_point(a, z, index);
+	if (trip)
+	    trip->temp = get_unit_value(value) / 1000.0;
+	break;
+    case ATTR_TRIP_TYPE:
+	trip = trip_point(a, z, index);
+	if (trip && !trip->type) {
+	    trip->type = arena_strdup(a, value);
+	    if (index > z->trip_points)
+		z->trip_points = index;
 	}
-	if (*p == ' ')
-	    p++;
-	while (*(p++)) {
-	    if (*p != ' ')
-		break;
-	}
-    } else {
-	strncpy(attr, given_attr, BUF_SIZE);
+	break;
     }
-    strncpy(value, p, BUF_SIZE);
-    if (attr[strlen(attr) - 1] == '\n')
-	attr[strlen(attr) - 1] = '\0';
-    if (value[strlen(value) - 1] == '\n')
-	value[strlen(value) - 1] = '\0';
-    rval->attr = attr;
-    rval->value = value;
-    return rval;
+    z->have |= ATTR_BIT(id);
 }
 
-static struct list *parse_info_file(struct list *l, char *filename, char *given_attr)
+static void set_cooling_attr(struct arena *a, struct cooling_info *c, int id, char *value)
 {
-    FILE *fd;
-    char buf[BUF_SIZE];
+    if (HAS_ATTR(c, id))
+	return;
+    switch (id) {
+    case ATTR_STATUS:
+	c->state = arena_strdup(a, value);
+	break;
+    case ATTR_TYPE:
+	c->type = arena_strdup(a, value);
+	break;
+    case ATTR_CUR_STATE:
+	c->cur_state = get_unit_value(value);
+	break;
+    case ATTR_MAX_STATE:
+	c->max_state = get_unit_value(value);
+	break;
+    }
+    c->have |= ATTR_BIT(id);
+}
+
+/* temperatures are in millidegrees like those of thermal zones */
+static void set_hwmon_attr(struct arena *a, struct hwmon_info *h, int id, int index, char *value)
+{
+    struct hwmon_sensor *sensor;
+    void *array;
+
+    switch (id) {
+    case ATTR_TYPE:
+	if (!h->type)
+	    h->type = arena_strdup(a, value);
+	break;
+    case ATTR_TEMP_INPUT:
+    case ATTR_TEMP_CRIT:
+    case ATTR_TEMP_LABEL:
+	array = h->temp;
+	sensor = numbered(a, &array, &h->n_temp, &h->temp_size, index, sizeof(struct hwmon_sensor));
+	h->temp = array;
+	if (!sensor || HAS_ATTR(sensor, id))
+	    break;
+	if (id == ATTR_TEMP_INPUT)
+	    sensor->input = get_unit_value(value) / 1000.0;
+	else if (id == ATTR_TEMP_CRIT)
+	    sensor->crit = get_unit_value(value) / 1000.0;
+	else
+	    sensor->label = arena_strdup(a, value);
+	sensor->have |= ATTR_BIT(id);
+	break;
+    case ATTR_FAN_INPUT:
+	array = h->fan;
+	sensor = numbered(a, &array, &h->n_fan, &h->fan_size, index, sizeof(struct hwmon_sensor));
+	h->fan = array;
+	if (!sensor || HAS_ATTR(sensor, id))
+	    break;
+	sensor->input = get_unit_value(value);
+	sensor->have |= ATTR_BIT(id);
+	break;
+    }
+    h->have |= ATTR_BIT(id);
+}
 
-    fd = fopen(filename, "r");
-    if (!fd)
-	return l;
+/* store one value in the record of a device */
+static void set_attr(struct arena *a, int device_nr, void *rec, int id, int index, char *value, int scale)
+{
+    switch (device_nr) {
+    case BATTERY:
+	set_battery_attr(a, rec, id, value, scale);
+	break;
+    case AC_ADAPTER:
+	set_adapter_attr(a, rec, id, value);
+	break;
+    case THERMAL_ZONE:
+	set_thermal_attr(a, rec, id, index, value);
+	break;
+    case COOLING_DEV:
+	set_cooling_attr(a, rec, id, value);
+	break;
+    case HWMON:
+	set_hwmon_attr(a, rec, id, index, value);
+	break;
+    }
+}
 
-    while (fgets(buf, BUF_SIZE, fd) != NULL) {
-	struct field *f;
-	f = parse_field(buf, given_attr);
-	if (!f) 
+/* called once all attributes of a device have been read */
+static void finish_record(struct arena *a, int device_nr, void *rec)
+{
+    if (device_nr == THERMAL_ZONE)
+	sort_trip_points(a, rec);
+}
+
+void finish_records(struct arena *a, struct sample *s, int device_nr)
+{
+    int i;
+
+    if (device_nr == THERMAL_ZONE)
+	for (i = 0; i < s->n_zones; i++)
+	    finish_record(a, device_nr, &s->zones[i]);
+}
+
+/* drop devices without any information and those of the other class
+ * sharing the same directory */
+static int keep_record(int device_nr, void *rec)
+{
+    struct battery_info *b = rec;
+    struct adapter_info *ac = rec;
+    struct thermal_info *z = rec;
+    struct cooling_info *c = rec;
+
+    switch (device_nr) {
+    case BATTERY:
+	return b->have && (!b->type || !strcasecmp(b->type, "battery"));
+    case AC_ADAPTER:
+	return ac->have && (!ac->type || !strcasecmp(ac->type, "mains"));
+    case THERMAL_ZONE:
+	return z->have && (!z->type || is_thermal_zone(z->type));
+    case HWMON:
+	return ((struct hwmon_info *) rec)->have != 0;
+    default:
+	return c->have && (!c->type || !is_thermal_zone(c->type));
+    }
+}
+
+static void store_records(struct sample *s, int device_nr, void *records, int n)
+{
+    switch (device_nr) {
+    case BATTERY:
+	s->batteries = records;
+	s->n_batteries = n;
+	break;
+    case AC_ADAPTER:
+	s->adapters = records;
+	s->n_adapters = n;
+	break;
+    case THERMAL_ZONE:
+	s->zones = records;
+	s->n_zones = n;
+	break;
+    case COOLING_DEV:
+	s->coolers = records;
+	s->n_coolers = n;
+	break;
+    case HWMON:
+	s->chips = records;
+	s->n_chips = n;
+	break;
+    }
+}
+
+/* parse a file that has already been read into buf; a file of the sys
+ * interface holds a single value, /proc files have "name: value" lines;
+ * the values are also added to device dev of snapshot ar if there is one */
+static void parse_info_buffer(struct arena *a, int device_nr, void *rec, char *buf, const struct file_list *f,
+			      struct archive_writer *ar, int dev)
+{
+    const struct proc_attr *pa;
+    char *line, *next, *p;
+
+    for (line = buf; *line; line = next) {
+	next = strchr(line, '\n');
+	if (next)
+	    *next++ = '\0';
+	else
+	    next = line + strlen(line);
+
+	if (f->id != ATTR_PROC_LINES) {
+	    if (ar)
+		archive_add_value(ar, dev, ARCHIVE_FILE, f->file, line, strlen(line));
+	    set_attr(a, device_nr, rec, f->id, f->index, line, 1);
+	    break;
+	}
+
+	if (!*line || !(p = strchr(line + 1, ':')))
 	    continue;
-	l = list_append(l, f);
+	*p++ = '\0';
+	while (*p == ' ')
+	    p++;
+	if (ar)
+	    archive_add_value(ar, dev, ARCHIVE_LINE, line, p, strlen(p));
+	pa = proc_attr_lookup(line);
+	set_attr(a, device_nr, rec, pa->id, 0, p, pa->scale);
     }
-    fclose(fd);
-    return l;
 }
 
-struct file_list {
-    char *file;
-    char *attr;
+/* The kernel exports every property of a power_supply device in its uevent
+ * file as PREFIX_NAME=value lines, so one read replaces a file per attribute.
+ * The lines are split in place, keys point behind the prefix. */
+struct uevent {
+    int n;
+    char *key[UEVENT_MAX];
+    char *value[UEVENT_MAX];
+};
+
+static int parse_uevent(struct uevent *ue, char *buf, char *prefix)
+{
+    char *line, *eq, *next;
+    size_t len = strlen(prefix);
+
+    ue->n = 0;
+    for (line = buf; *line && ue->n < UEVENT_MAX; line = next) {
+	next = strchr(line, '\n');
+	if (next)
+	    *next++ = '\0';
+	else
+	    next = line + strlen(line);
+	eq = strchr(line, '=');
+	if (!eq || strncmp(line, prefix, len))
+	    continue;
+	*eq = '\0';
+	ue->key[ue->n] = line + len;
+	ue->value[ue->n] = eq + 1;
+	ue->n++;
+    }
+    return ue->n;
+}
+
+/* keys are upper case versions of the attribute file names */
+static char *uevent_value(struct uevent *ue, char *file)
+{
+    int i;
+
+    for (i = 0; i < ue->n; i++)
+	if (!strcasecmp(ue->key[i], file))
+	    return ue->value[i];
+    return NULL;
+}
+
+/* attributes read for each device class on the sys interface, in the order
+ * of precedence the print functions expect */
+const struct file_list battery_files[] = {
+    {"current_now", ATTR_CURRENT_NOW},
+    {"power_now", ATTR_POWER_NOW},
+    {"charge_now", ATTR_CHARGE_NOW},
+    {"energy_now", ATTR_ENERGY_NOW},
+    {"voltage_now", ATTR_VOLTAGE_NOW},
+    {"charge_full", ATTR_CHARGE_FULL},
+    {"energy_full", ATTR_ENERGY_FULL},
+    {"charge_full_design", ATTR_CHARGE_FULL_DESIGN},
+    {"energy_full_design", ATTR_ENERGY_FULL_DESIGN},
+    {"capacity", ATTR_CAPACITY},
+    {"status", ATTR_CHARGING_STATE},
+    {"type", ATTR_TYPE},
+    {NULL}
+};
+
+const struct file_list ac_adapter_files[] = {
+    {"online", ATTR_ONLINE},
+    {"type", ATTR_TYPE},
+    {NULL}
+};
+
+/* a %d stands for the number of a trip point, any number of them is found */
+const struct file_list thermal_files[] = {
+    {"type", ATTR_TYPE},
+    {"temp", ATTR_TEMP},
+    {"trip_point_%d_type", ATTR_TRIP_TYPE},
+    {"trip_point_%d_temp", ATTR_TRIP_TEMP},
+    {NULL}
+};
+
+const struct file_list cooling_files[] = {
+    {"type", ATTR_TYPE},
+    {"cur_state", ATTR_CUR_STATE},
+    {"max_state", ATTR_MAX_STATE},
+    {NULL}
+};
+
+/* a chip has any number of numbered sensors, found like trip points */
+const struct file_list hwmon_files[] = {
+    {"name", ATTR_TYPE},
+    {"temp%d_input", ATTR_TEMP_INPUT},
+    {"temp%d_crit", ATTR_TEMP_CRIT},
+    {"temp%d_label", ATTR_TEMP_LABEL},
+    {"fan%d_input", ATTR_FAN_INPUT},
+    {NULL}
 };
 
-static struct file_list sys_list[] = {
-    {"current_now", "current_now"},
-    {"power_now", "power_now"},
-    {"charge_now", "charge_now"},
-    {"energy_now", "energy_now"},
-    {"voltage_now", "voltage_now"},
-    {"voltage_min_design", "voltage_min_design"},
-    {"charge_full", "charge_full"},
-    {"energy_full", "energy_full"},
-    {"charge_full_design", "charge_full_design"},
-    {"energy_full_design", "energy_full_design"},
-    {"online", "online"},
-    {"status", "charging state"},
-    {"type", "type"},
-    {"temp", "sys_temp"},
-    {"trip_point_0_type", "trip_point_0_type"},
-    {"trip_point_0_temp", "trip_point_0_temp"},
-    {"trip_point_1_type", "trip_point_1_type"},
-    {"trip_point_1_temp", "trip_point_1_temp"},
-    {"trip_point_2_type", "trip_point_2_type"},
-    {"trip_point_2_temp", "trip_point_2_temp"},
-    {"trip_point_3_type", "trip_point_3_type"},
-    {"trip_point_3_temp", "trip_point_3_temp"},
-    {"trip_point_4_type", "trip_point_4_type"},
-    {"trip_point_4_temp", "trip_point_4_temp"},
-    {"cur_state", "cur_state"},
-    {"max_state", "max_state"}
+static const struct file_list proc_list[] = {
+    {"state", ATTR_PROC_LINES},
+    {"status", ATTR_PROC_LINES},
+    {"info", ATTR_PROC_LINES},
+    {"temperature", ATTR_PROC_LINES},
+    {"cooling_mode", ATTR_PROC_LINES},
+    {NULL}
 };
 
-static struct file_list proc_list[] = {
-    {"state", NULL},
-    {"status", NULL},
-    {"info", NULL},
-    {"temperature", NULL},
-    {"cooling_mode", NULL},
+/* the classes of devices, in the order they are printed; /proc/acpi has
+ * no hwmon */
+const struct device device[DEVICE_CLASSES] = {
+    { BATTERY, "battery", "power_supply", "BAT", "POWER_SUPPLY_", battery_files },
+    { AC_ADAPTER, "ac_adapter", "power_supply", "AC", "POWER_SUPPLY_", ac_adapter_files },
+    { THERMAL_ZONE, "thermal_zone", "thermal", "thermal_zone", NULL, thermal_files },
+    { COOLING_DEV, "fan", "thermal", "cooling_device", NULL, cooling_files },
+    { HWMON, "hwmon", "hwmon", "hwmon", NULL, hwmon_files }
 };
 
-static struct list *get_info(char *device_name, int proc_interface)
+static const struct file_list *get_file_list(int device_nr, int proc_interface)
 {
-    struct list *rval = NULL;
-    struct file_list *list = proc_interface ? proc_list : sys_list;
-    int i, n = (proc_interface ? sizeof(proc_list) : sizeof(sys_list)) / sizeof(struct file_list);
-    char *filename = malloc(strlen(device_name) + strlen("/energy_full_design "));
+    return proc_interface ? proc_list : device[device_nr].files;
+}
 
-    if (filename == NULL) {
-	fprintf(stderr, "Out of memory. Could not allocate memory in get_info.\n");
-	return NULL;
-    }
+/* match a directory entry against a file of the list */
+static int match_file(char *file, char *name, int *index)
+{
+    char *p = strstr(file, "%d");
+    char *end;
+    long n;
+
+    if (!p)
+	return !strcmp(file, name);
+    if (strncmp(name, file, p - file) || !isdigit((unsigned char) name[p - file]))
+	return FALSE;
+    n = strtol(name + (p - file), &end, 10);
+    if (n >= MAX_FILE_INDEX || strcmp(end, p + 2))
+	return FALSE;
+    *index = n;
+    return TRUE;
+}
+
+/* Which attributes of a device exist is found by listing its directory
+ * once instead of probing every file of the list, and remembered by the
+ * caller for as long as it samples the device. A device that comes back
+ * under the same name is a new directory, told apart by its inode and
+ * ctime. */
+struct discovery {
+    int device_nr;
+    char *name;
+    ino_t ino;
+    struct timespec ctime;
+    int n;
+    struct file_list *files;	/* in the order of the list, then by index */
+};
+
+struct discoveries {
+    int n;
+    struct discovery *d;
+};
+
+/* names of numbered files are copies, the others are those of the list */
+static void free_files(const struct file_list *list, struct file_list *files, int n)
+{
+    int i, j;
 
     for (i = 0; i < n; i++) {
-	sprintf(filename, "%s/%s", device_name, list[i].file);
-	rval = parse_info_file(rval, filename, list[i].attr);
+	for (j = 0; list[j].file && list[j].file != files[i].file; j++)
+	    ;
+	if (!list[j].file)
+	    free(files[i].file);
     }
+    free(files);
+}
 
-    return rval;
+static void free_discoveries(struct discoveries *cache, int proc_interface)
+{
+    int i;
+
+    for (i = 0; i < cache->n; i++) {
+	free_files(get_file_list(cache->d[i].device_nr, proc_interface), cache->d[i].files, cache->d[i].n);
+	free(cache->d[i].name);
+    }
+    free(cache->d);
+    cache->d = NULL;
+    cache->n = 0;
 }
 
-void free_devices(struct list *devices)
+/* forget what was found for a device if its directory is not the one that
+ * was listed */
+static void forget_replaced(struct discoveries *cache, int device_nr, char *name, int proc_interface,
+			    const struct stat *st)
 {
-    struct list *p, *r, *s;
-    struct field *f;
+    struct discovery *disc;
+    int i;
 
-    p = devices;
-    while (p) {
-	r = s = p->data;
-	while (r) {
-	    f = r->data;
-	    free(f->attr);
-	    free(f->value);
-	    free(f);
-	    r = r->next;
-	}
-	list_free(s);
-	p = p->next;
+    for (i = 0; i < cache->n; i++) {
+	disc = &cache->d[i];
+	if (disc->device_nr != device_nr || strcmp(disc->name, name))
+	    continue;
+	if (disc->ino == st->st_ino && disc->ctime.tv_sec == st->st_ctim.tv_sec &&
+	    disc->ctime.tv_nsec == st->st_ctim.tv_nsec)
+	    return;
+	free_files(get_file_list(device_nr, proc_interface), disc->files, disc->n);
+	free(disc->name);
+	*disc = cache->d[--cache->n];
+	return;
     }
-    list_free(devices);
 }
 
-struct list *find_devices(char *acpi_path, int device_nr,
-			  int proc_interface)
+static int compare_found(const void *a, const void *b)
 {
-    DIR *d;
+    const struct file_list *fa = a, *fb = b;
+
+    /* entries of the list were numbered in id, see discover_attributes */
+    if (fa->id != fb->id)
+	return fa->id - fb->id;
+    return fa->index - fb->index;
+}
+
+/* returns the number of attributes found, or -1 if there is no memory */
+static int discover_attributes(struct discoveries *cache, int dir_fd, char *name, int device_nr,
+			       int proc_interface, struct file_list **files)
+{
+    const struct file_list *list = get_file_list(device_nr, proc_interface);
+    struct file_list *found = NULL, *f;
+    struct discovery *disc;
     struct dirent *de;
-    struct list *device_info;
-    struct list *rval = NULL;
-    char *device_type = proc_interface ? device[device_nr].proc : device[device_nr].sys;
-    int found_data = FALSE;
+    struct stat st;
+    DIR *d;
+    int i, fd, index, n = 0, size = 0;
+
+    for (i = 0; i < cache->n; i++)
+	if (cache->d[i].device_nr == device_nr && !strcmp(cache->d[i].name, name)) {
+	    *files = cache->d[i].files;
+	    return cache->d[i].n;
+	}
 
-    if (chdir(acpi_path) < 0) {
-	fprintf(stderr, "No ACPI support in kernel, or incorrect acpi_path (\"%s\").\n", acpi_path);
-	exit(1);
+    fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+	memset(&st, 0, sizeof(st));
+    d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d && fd >= 0)
+	close(fd);
+    while (d && (de = readdir(d))) {
+	for (i = 0; list[i].file; i++) {
+	    index = list[i].index;
+	    if (!match_file(list[i].file, de->d_name, &index))
+		continue;
+	    if (n == size) {
+		size = size ? 2 * size : 16;
+		f = realloc(found, size * sizeof(struct file_list));
+		if (!f)
+		    goto nomem;
+		found = f;
+	    }
+	    /* sort by position in the list first, the id is fixed up below */
+	    found[n].file = strchr(list[i].file, '%') ? strdup(de->d_name) : list[i].file;
+	    found[n].id = i;
+	    found[n].index = index;
+	    if (!found[n].file)
+		goto nomem;
+	    n++;
+	    break;
+	}
     }
+    if (d)
+	closedir(d);
+    d = NULL;
+    if (n)
+	qsort(found, n, sizeof(struct file_list), compare_found);
+    for (i = 0; i < n; i++)
+	found[i].id = list[found[i].id].id;
+
+    disc = realloc(cache->d, (cache->n + 1) * sizeof(struct discovery));
+    if (!disc)
+	goto nomem;
+    cache->d = disc;
+    disc = &cache->d[cache->n];
+    disc->name = strdup(name);
+    if (!disc->name)
+	goto nomem;
+    disc->device_nr = device_nr;
+    disc->ino = st.st_ino;
+    disc->ctime = st.st_ctim;
+    disc->n = n;
+    disc->files = found;
+    cache->n++;
+    *files = found;
+    return n;
+
+nomem:
+    if (d)
+	closedir(d);
+    free_files(list, found, n);
+    *files = NULL;
+    errno = ENOMEM;
+    return -1;
+}
+
+/* the values the uevent file has, returns the ids it covered */
+static unsigned int apply_uevent(struct arena *a, int device_nr, void *rec, const struct file_list *list, struct uevent *ue)
+{
+    unsigned int covered = 0;
+    char *value;
+    int i;
+
+    for (i = 0; ue->n && list[i].file; i++) {
+	if (strchr(list[i].file, '%') || !(value = uevent_value(ue, list[i].file)))
+	    continue;
+	set_attr(a, device_nr, rec, list[i].id, list[i].index, value, 1);
+	covered |= ATTR_BIT(list[i].id);
+    }
+    return covered;
+}
+
+#define FULL_IDS	(ATTR_BIT(ATTR_CHARGE_FULL) | ATTR_BIT(ATTR_ENERGY_FULL))
+#define ENERGY_IDS	(ATTR_BIT(ATTR_ENERGY_NOW) | ATTR_BIT(ATTR_ENERGY_FULL) | ATTR_BIT(ATTR_ENERGY_FULL_DESIGN))
+
+/* values of a battery the text lines take, and the ones they only take if
+ * a device does not have the first */
+static const int either[][2] = {
+    {ATTR_CURRENT_NOW, ATTR_POWER_NOW},
+    {ATTR_CHARGE_NOW, ATTR_ENERGY_NOW},
+    {ATTR_CHARGE_FULL, ATTR_ENERGY_FULL},
+    {ATTR_CHARGE_FULL_DESIGN, ATTR_ENERGY_FULL_DESIGN}
+};
+
+/* the ids of need to read for a device known to have the ids of known,
+ * that may have those of maybe; full asks for the full capacity of a
+ * battery, see NEED_PRINTED */
+static unsigned int wanted(int device_nr, unsigned int need, unsigned int known, unsigned int maybe, int full)
+{
+    unsigned int want = need & ~NEED_PRINTED;
+    int i;
+
+    if (device_nr != BATTERY || !(need & NEED_PRINTED))
+	return want;
+    if (full || (need & FULL_IDS))
+	want = (want | FULL_IDS) & ~ATTR_BIT(ATTR_CAPACITY);
+    else if (!(known & ATTR_BIT(ATTR_CAPACITY)))
+	want |= FULL_IDS;
+    for (i = 0; i < sizeof(either) / sizeof(either[0]); i++)
+	if (known & ATTR_BIT(either[i][0]))
+	    want &= ~ATTR_BIT(either[i][1]);
+    if (!(want & maybe & ENERGY_IDS))
+	want &= ~ATTR_BIT(ATTR_VOLTAGE_NOW);
+    return want;
+}
+
+/* a device found while collecting a sample */
+struct collect {
+    int device_nr;
+    int dir_fd;			/* of its class */
+    char *name;
+    char *rec;
+    unsigned int need;
+    unsigned int known;		/* the ids its uevent file had, and its files */
+    unsigned int tried;		/* the ids read so far */
+    unsigned int want;		/* the ids to read in this batch */
+    int archived;		/* its number in the snapshot taken, or -1 */
+};
 
-    if (chdir(device_type) == 0) {
-	d = opendir(".");
-	if (!d) 
+/* a battery without its full capacity needs it rather than the capacity in
+ * percent if it has no state yet or is charging, for the time until it is
+ * charged */
+static int full_needed(struct collect *c)
+{
+    struct battery_info *b = (struct battery_info *) c->rec;
+
+    return c->device_nr == BATTERY && !(b->have & FULL_IDS) && (!b->state || !strcasecmp(b->state, "charging"));
+}
+
+/* a device of the other class sharing the directory, as its type shows */
+static int other_class(struct collect *c)
+{
+    return (record_have(c->device_nr, c->rec) & ATTR_BIT(ATTR_TYPE)) && !keep_record(c->device_nr, c->rec);
+}
+
+/* returns NULL if there is no memory for the read */
+static struct file_read *collect_read(struct arena *a, struct file_read *r, struct collect *c, char *file)
+{
+    char *path = arena_alloc(a, strlen(c->name) + strlen(file) + 2);
+
+    if (!path)
 	return NULL;
+    sprintf(path, "%s/%s", c->name, file);
+    r->fd = -1;
+    r->dir_fd = c->dir_fd;
+    r->path = path;
+    r->size = ATTR_BUF_SIZE;
+    r->buf = arena_alloc(a, r->size);
+    return r->buf ? r : NULL;
+}
 
-	while ((de = readdir(d))) {
-	    if (ignore_directory_entry(de))
+/* read the attribute files of the devices that want ids they have not
+ * tried yet in one batch; the directory of a device is only listed if its
+ * uevent file did not have everything */
+static int collect_files(struct arena *a, struct discoveries *cache, struct collect *devs, int n_devices,
+			 int proc_interface, struct batch *b, struct archive_writer *ar)
+{
+    const struct file_list *list;
+    struct file_list *files, **batch_files;
+    struct file_read *reads;
+    struct collect *c, **batch_devs;
+    unsigned int maybe;
+    int i, j, n, m = 0, full;
+    STATS_START(batch_stats(b), start);
+
+    for (i = 0; i < n_devices; i++) {
+	c = &devs[i];
+	c->want = 0;
+	if (other_class(c))
+	    continue;
+	list = get_file_list(c->device_nr, proc_interface);
+	for (maybe = 0, j = 0; list[j].file; j++)
+	    maybe |= ATTR_BIT(list[j].id);
+	/* the capacity in percent only stands in for the full capacity of a
+	 * battery the uevent file showed not to be charging */
+	full = full_needed(c);
+	if (!(wanted(c->device_nr, c->need, c->known, maybe, full) & maybe & ~c->tried))
+	    continue;
+	n = discover_attributes(cache, c->dir_fd, c->name, c->device_nr, proc_interface, &files);
+	if (n < 0)
+	    return -1;
+	for (j = 0; j < n; j++)
+	    c->known |= ATTR_BIT(files[j].id);
+	c->want = wanted(c->device_nr, c->need, c->known, c->known, full) & ~c->tried;
+	m += n;
+    }
+    reads = arena_alloc(a, m * sizeof(struct file_read));
+    batch_files = arena_alloc(a, m * sizeof(struct file_list *));
+    batch_devs = arena_alloc(a, m * sizeof(struct collect *));
+    if (!reads || !batch_files || !batch_devs)
+	return -1;
+    for (m = 0, i = 0; i < n_devices; i++) {
+	c = &devs[i];
+	if (!c->want)
+	    continue;
+	n = discover_attributes(cache, c->dir_fd, c->name, c->device_nr, proc_interface, &files);
+	for (j = 0; j < n; j++) {
+	    if (!(c->want & ATTR_BIT(files[j].id)))
 		continue;
+	    batch_files[m] = &files[j];
+	    batch_devs[m] = c;
+	    if (collect_read(a, &reads[m], c, files[j].file))
+		m++;
+	}
+	c->tried |= c->want;
+    }
+    STATS_LAP(batch_stats(b), STATS_ENUMERATE, start);
+    batch_read(b, reads, m);
+    STATS_LAP(batch_stats(b), STATS_READ, start);
+    for (j = 0; j < m; j++) {
+	STATS_BATCH_FILE(batch_stats(b), batch_devs[j]->name, batch_files[j]->file, &reads[j]);
+	if (reads[j].result == -ETIMEDOUT)
+	    set_stale(batch_devs[j]->device_nr, batch_devs[j]->rec, STALE_TIMED_OUT);
+	if (reads[j].result >= 0)
+	    parse_info_buffer(a, batch_devs[j]->device_nr, batch_devs[j]->rec, reads[j].buf, batch_files[j],
+			      ar, batch_devs[j]->archived);
+    }
+    STATS_LAP(batch_stats(b), STATS_PARSE, start);
+    return 0;
+}
 
-	    found_data = TRUE;
-	    device_info = get_info(de->d_name, proc_interface);
+/* read the devices of all classes of a sample in two batches, the uevent
+ * files first, then the attribute files they did not cover; parsing follows
+ * the order of the devices, so the batch may read in any order; with ar
+ * every value parsed is added to that snapshot */
+static int collect_info(struct arena *a, struct discoveries *cache, struct collect *devs, int n_devices,
+			int proc_interface, struct batch *b, struct archive_writer *ar)
+{
+    struct file_read *reads;
+    struct collect **batch_devs;
+    struct uevent ue;
+    char *prefix;
+    int i, j, k, m = 0;
+    STATS_START(batch_stats(b), start);
 
-	    if (device_info)
-		rval = list_append(rval, device_info);
-	}
-	closedir(d);
+    for (i = 0; i < n_devices; i++)
+	init_record(devs[i].device_nr, devs[i].rec);
+    reads = arena_alloc(a, n_devices * sizeof(struct file_read));
+    batch_devs = arena_alloc(a, n_devices * sizeof(struct collect *));
+    if (!reads || !batch_devs)
+	return -1;
+    for (i = 0; i < n_devices; i++) {
+	if (proc_interface || !device[devs[i].device_nr].uevent)
+	    continue;
+	batch_devs[m] = &devs[i];
+	if (collect_read(a, &reads[m], &devs[i], "uevent"))
+	    m++;
     }
+    STATS_LAP(batch_stats(b), STATS_ENUMERATE, start);
+    batch_read(b, reads, m);
+    STATS_LAP(batch_stats(b), STATS_READ, start);
+    for (j = 0; j < m; j++) {
+	STATS_BATCH_FILE(batch_stats(b), batch_devs[j]->name, "uevent", &reads[j]);
+	ue.n = 0;
+	prefix = device[batch_devs[j]->device_nr].uevent;
+	if (reads[j].result == -ETIMEDOUT)
+	    set_stale(batch_devs[j]->device_nr, batch_devs[j]->rec, STALE_TIMED_OUT);
+	if (reads[j].result > 0)
+	    parse_uevent(&ue, reads[j].buf, prefix);
+	for (k = 0; ar && k < ue.n; k++)
+	    archive_add_value(ar, batch_devs[j]->archived, ARCHIVE_UEVENT, ue.key[k], ue.value[k], strlen(ue.value[k]));
+	batch_devs[j]->known = batch_devs[j]->tried =
+	    apply_uevent(a, batch_devs[j]->device_nr, batch_devs[j]->rec,
+			 get_file_list(batch_devs[j]->device_nr, proc_interface), &ue);
+    }
+    STATS_LAP(batch_stats(b), STATS_PARSE, start);
+
+    if (collect_files(a, cache, devs, n_devices, proc_interface, b, ar) < 0)
+	return -1;
+    STATS_START(batch_stats(b), finish);
+    for (i = 0; i < n_devices; i++)
+	finish_record(a, devs[i].device_nr, devs[i].rec);
+    STATS_LAP(batch_stats(b), STATS_PARSE, finish);
+    return a->failed ? -1 : 0;
+}
 
-    if (!found_data) {
-	fprintf(stderr, "No support for device type: %s\n", device_type);
+/* the device names of a class, in the order they are numbered in */
+static struct list *list_devices(struct arena *a, int dir_fd)
+{
+    struct list *names = NULL;
+    struct dirent *de;
+    char *name;
+    DIR *d;
+    int fd;
+
+    fd = dir_fd >= 0 ? dup(dir_fd) : -1;
+    d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+	if (fd >= 0)
+	    close(fd);
 	return NULL;
     }
+    /* prepending reverses the directory order, which is the order
+     * devices have always been numbered in */
+    while ((de = readdir(d))) {
+	if (ignore_directory_entry(de))
+	    continue;
+	name = arena_strdup(a, de->d_name);
+	if (name)
+	    names = arena_list_append(a, names, name);
+    }
+    closedir(d);
+    return names;
+}
 
-    return rval;
+/* the records of a class are in place, drop those not to be shown */
+static void store_kept(struct sample *s, struct collect *devs, int n_devices)
+{
+    int i, j, n, device_nr;
+    size_t size;
+    char *records;
+
+    for (i = 0; i < n_devices; i = j) {
+	device_nr = devs[i].device_nr;
+	size = record_size(device_nr);
+	records = devs[i].rec;
+	for (n = 0, j = i; j < n_devices && devs[j].device_nr == device_nr; j++)
+	    if (keep_record(device_nr, devs[j].rec)) {
+		if (records + n * size != devs[j].rec)
+		    memcpy(records + n * size, devs[j].rec, size);
+		n++;
+	    }
+	store_records(s, device_nr, records, n);
+    }
 }
 
-static int get_unit_value(char *value)
+/* the values of device i of a snapshot, returns the ids of the files and
+ * lines it has and applies those of want; uevent values are not looked at */
+static unsigned int apply_archived(struct arena *a, struct archive *ar, int i, struct collect *c,
+				   const struct file_list *list, unsigned int want)
 {
-    int n = -1;
-    sscanf(value, "%d", &n);
-    return n;
+    const struct proc_attr *pa;
+    unsigned int have = 0;
+    char *name, *value;
+    int j, k, n, kind, device_nr, index;
+
+    n = archive_device(ar, i, &device_nr, &name);
+    for (j = 0; j < n; j++) {
+	archive_value(ar, i, j, &kind, &name, &value);
+	if (kind == ARCHIVE_LINE) {
+	    have |= ATTR_BIT(ATTR_PROC_LINES);
+	    if (!(want & ATTR_BIT(ATTR_PROC_LINES)))
+		continue;
+	    pa = proc_attr_lookup(name);
+	    set_attr(a, c->device_nr, c->rec, pa->id, 0, value, pa->scale);
+	    continue;
+	}
+	if (kind != ARCHIVE_FILE)
+	    continue;
+	for (k = 0; list[k].file; k++) {
+	    index = list[k].index;
+	    if (match_file(list[k].file, name, &index))
+		break;
+	}
+	if (!list[k].file)
+	    continue;
+	have |= ATTR_BIT(list[k].id);
+	if (want & ATTR_BIT(list[k].id))
+	    set_attr(a, c->device_nr, c->rec, list[k].id, index, value, 1);
+    }
+    return have;
 }
 
-void print_battery_information(struct list *batteries, int show_empty_slots, int show_capacity)
-{
-    struct list *battery = batteries;
-    struct list *fields;
-    struct field *value;
-    int battery_num = 1;
-
-    while (battery) {
-	int remaining_capacity = -1;
-	int remaining_energy = -1;
-	int present_rate = -1;
-	int voltage = -1;
-	int design_capacity = -1;
-	int design_capacity_unit = -1;
-	int last_capacity = -1;
-	int last_capacity_unit = -1;
-	int hours, minutes, seconds;
-	int percentage;
-	char *state = NULL, *poststr;
-	int type_battery = TRUE;
-	char capacity_unit[4] = "mAh";
-
-	fields = battery->data;
-	while (fields) {
-	    value = fields->data;
-	    if (!strcasecmp(value->attr, "remaining capacity")) {
-		remaining_capacity = get_unit_value(value->value);
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcmp(value->attr, "charge_now")) {
-		remaining_capacity = get_unit_value(value->value) / 1000;
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcmp(value->attr, "energy_now")) {
-		remaining_energy = get_unit_value(value->value) / 1000;
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcasecmp(value->attr, "present rate")) {
-		present_rate = get_unit_value(value->value);
-	    } else if (!strcmp(value->attr, "current_now")) {
-		present_rate = get_unit_value(value->value) / 1000;
-	    } else if (!strcmp(value->attr, "power_now")) {
-		present_rate = get_unit_value(value->value) / 1000;
-	    } else if (!strcasecmp(value->attr, "last full capacity")) {
-		last_capacity = get_unit_value(value->value);
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcmp(value->attr, "charge_full")) {
-		last_capacity = get_unit_value(value->value) / 1000;
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcmp(value->attr, "energy_full")) {
-		last_capacity_unit = get_unit_value(value->value) / 1000;
-		if (!state)
-		    state = strdup("available");
-	    } else if (!strcmp(value->attr, "charge_full_design")) {
-		design_capacity = get_unit_value(value->value) / 1000;
-	    } else if (!strcmp(value->attr, "energy_full_design")) {
-		design_capacity_unit =
-		    get_unit_value(value->value) / 1000;
-	    } else if (!strcmp(value->attr, "type")) {
-		type_battery = (strcasecmp(value->value, "battery") == 0);
-	    } else if (!strcmp(value->attr, "charging state") || !strcmp(value->attr, "State")) {
-		state = value->value;
-	    } else if (!strcmp(value->attr, "voltage_now")) {
-		voltage = get_unit_value(value->value) / 1000;
-		if (!voltage) /* zero voltage makes all calculations mood */
-			voltage = -1;
-	    }
-	    fields = list_next(fields);
+/* A sample from a file written by snapshot_capture. Its values are parsed
+ * where they are mapped, in the order they were read, and the same of them
+ * are taken as collect_info would read from the devices, so the records
+ * come out as if the tree had been read. */
+int find_snapshot(struct arena *a, struct sample *s, int fd, int *show, unsigned int need)
+{
+    const struct file_list *list;
+    struct archive *ar;
+    struct collect *devs, *c;
+    struct uevent ue;
+    char *records[DEVICE_CLASSES], *name, *key, *value;
+    int counts[DEVICE_CLASSES] = { 0 };
+    int i, j, n, n_values, kind, device_nr, proc_interface, n_devices = 0, ret = -1;
+    unsigned int classes;
+
+    memset(s, 0, sizeof(*s));
+    ar = archive_map(fd);
+    if (!ar)
+	return -1;
+    proc_interface = archive_proc(ar);
+    classes = archive_classes(ar);
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (show[device_nr] && !(classes & (1 << device_nr)))
+	    s->missing |= 1 << device_nr;
+    for (i = 0; i < archive_devices(ar); i++) {
+	archive_device(ar, i, &device_nr, &name);
+	if (show[device_nr])
+	    counts[device_nr]++;
+    }
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	records[device_nr] = arena_alloc(a, counts[device_nr] * record_size(device_nr));
+	n_devices += counts[device_nr];
+    }
+    devs = arena_alloc(a, n_devices * sizeof(struct collect));
+    if (!devs || a->failed)
+	goto out;
+
+    /* devices were added by class, in the order they are numbered in */
+    for (n = 0, i = 0; i < archive_devices(ar); i++) {
+	n_values = archive_device(ar, i, &device_nr, &name);
+	if (!show[device_nr])
+	    continue;
+	c = &devs[n++];
+	c->device_nr = device_nr;
+	c->rec = records[device_nr];
+	c->need = need;
+	records[device_nr] += record_size(device_nr);
+	init_record(device_nr, c->rec);
+	list = get_file_list(device_nr, proc_interface);
+
+	ue.n = 0;
+	for (j = 0; j < n_values && ue.n < UEVENT_MAX; j++) {
+	    archive_value(ar, i, j, &kind, &key, &value);
+	    if (kind != ARCHIVE_UEVENT)
+		continue;
+	    ue.key[ue.n] = key;
+	    ue.value[ue.n] = value;
+	    ue.n++;
 	}
-	if (type_battery) {	/* or else this is the ac_adapter */
-	    if (!state) {
-		if (show_empty_slots) 
-		    printf("%s %d: slot empty\n", BATTERY_DESC, battery_num - 1);
-	    } else {
-		/* convert energy values (in mWh) to charge values (in mAh) if needed and possible */
-		if (last_capacity_unit != -1 && last_capacity == -1) {
-		    if (voltage != -1) {
-			last_capacity = last_capacity_unit * 1000 / voltage;
-		    } else {
-			last_capacity = last_capacity_unit;
-			strcpy(capacity_unit, "mWh");
-		    }
-		}
-		if (design_capacity_unit != -1 && design_capacity == -1) {
-		    if (voltage != -1) {
-			design_capacity = design_capacity_unit * 1000 / voltage;
-		    } else {
-			design_capacity = design_capacity_unit;
-			strcpy(capacity_unit, "mWh");
-		    }
-		}
-		if (remaining_energy != -1 && remaining_capacity == -1) {
-		    if (voltage != -1) {
-			remaining_capacity = remaining_energy * 1000 / voltage;
-			present_rate = present_rate * 1000 / voltage;
-		    } else {
-			remaining_capacity = remaining_energy;
-		    }
-		}
-		if (last_capacity < MIN_CAPACITY)
-		    percentage = 0;
-		else
-		    percentage = remaining_capacity * 100 / last_capacity;
-		
-		if (percentage > 100)
-		    percentage = 100;
-
-		printf("%s %d: %s, %d%%", BATTERY_DESC, battery_num - 1, state, percentage);
-
-		if (present_rate == -1) {
-		    poststr = "rate information unavailable";
-		    seconds = -1;
-		} else if (!strcasecmp(state, "charging")) {
-		    if (present_rate > MIN_PRESENT_RATE) {
-			seconds = 3600 * (last_capacity - remaining_capacity) / present_rate;
-			poststr = " until charged";
-		    } else {
-			poststr = "charging at zero rate - will never fully charge.";
-			seconds = -1;
-		    }
-		} else if (!strcasecmp(state, "discharging")) {
-		    if (present_rate > MIN_PRESENT_RATE) {
-			seconds = 3600 * remaining_capacity / present_rate;
-			poststr = " remaining";
-		    } else {
-			poststr = "discharging at zero rate - will never fully discharge.";
-			seconds = -1;
-		    }
-		} else {
-		    poststr = NULL;
-		    seconds = -1;
-		}
-
-		if (seconds > 0) {
-		    hours = seconds / 3600;
-		    seconds -= 3600 * hours;
-		    minutes = seconds / 60;
-		    seconds -= 60 * minutes;
-		    printf(", %02d:%02d:%02d%s", hours, minutes, seconds, poststr);
-		} else if (poststr != NULL) {
-		    printf(", %s", poststr);
-		}
-
-		printf("\n");
-
-		if (show_capacity && design_capacity > 0) {
-		    if (last_capacity <= 100) {
-			/* some broken systems just give a percentage here */
-			percentage = last_capacity;
-			last_capacity = percentage * design_capacity / 100;
-		    } else {
-			percentage = last_capacity * 100 / design_capacity;
-		    }
-		    if (percentage > 100)
-			percentage = 100;
-
-		    printf ("%s %d: design capacity %d %s, last full capacity %d %s = %d%%\n",
-			 BATTERY_DESC, battery_num - 1, design_capacity, capacity_unit, last_capacity, capacity_unit, percentage);
-		}
-	    }
-	    battery_num++;
+	c->known = c->tried = apply_uevent(a, device_nr, c->rec, list, &ue);
+	if (other_class(c))
+	    continue;
+	c->known |= apply_archived(a, ar, i, c, list, 0);
+	c->want = wanted(device_nr, need, c->known, c->known, full_needed(c)) & ~c->tried;
+	apply_archived(a, ar, i, c, list, c->want);
+	c->tried |= c->want;
+    }
+    for (i = 0; i < n_devices; i++)
+	finish_record(a, devs[i].device_nr, devs[i].rec);
+    store_kept(s, devs, n_devices);
+    ret = a->failed ? -1 : 0;
+out:
+    if (ret < 0)
+	errno = ENOMEM;
+    archive_unmap(ar);
+    return ret;
+}
+
+/* find_devices reading the tree at acpi_path, and adding every value it
+ * parses to ar if it is not NULL */
+static int collect_sample(struct arena *a, struct sample *s, char *acpi_path, int *show, unsigned int need,
+			  int proc_interface, struct batch *b, struct archive_writer *ar)
+{
+    struct discoveries cache = { 0, NULL };
+    struct list *names[DEVICE_CLASSES], *l;
+    struct collect *devs;
+    int dir_fd[DEVICE_CLASSES];
+    int root_fd, device_nr, i, n_devices = 0, ret = -1;
+    size_t size;
+    char *records;
+    STATS_START(batch_stats(b), start);
+
+    memset(s, 0, sizeof(*s));
+    root_fd = open(acpi_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0 && errno == ENOTDIR && !ar) {
+	root_fd = open(acpi_path, O_RDONLY | O_CLOEXEC);
+	if (root_fd < 0)
+	    return -1;
+	ret = find_snapshot(a, s, root_fd, show, need);
+	close(root_fd);
+	return ret;
+    }
+    if (root_fd < 0)
+	return -1;
+
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	names[device_nr] = NULL;
+	dir_fd[device_nr] = -1;
+	if (!show[device_nr])
+	    continue;
+	dir_fd[device_nr] = openat(root_fd, proc_interface ? device[device_nr].proc : device[device_nr].sys,
+				   O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	names[device_nr] = list_devices(a, dir_fd[device_nr]);
+	if (!names[device_nr])
+	    s->missing |= 1 << device_nr;
+	n_devices += list_length(names[device_nr]);
+    }
+    close(root_fd);
+    STATS_LAP(batch_stats(b), STATS_ENUMERATE, start);
+
+    devs = arena_alloc(a, n_devices * sizeof(struct collect));
+    if (!devs)
+	goto out;
+    for (i = 0, device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	size = record_size(device_nr);
+	records = arena_alloc(a, list_length(names[device_nr]) * size);
+	if (!records)
+	    goto out;
+	for (l = names[device_nr]; l; l = list_next(l), i++) {
+	    devs[i].device_nr = device_nr;
+	    devs[i].dir_fd = dir_fd[device_nr];
+	    devs[i].name = l->data;
+	    devs[i].rec = records;
+	    devs[i].need = need;
+	    devs[i].known = devs[i].tried = 0;
+	    devs[i].archived = ar ? archive_add_device(ar, device_nr, l->data) : -1;
+	    records += size;
 	}
-	battery = list_next(battery);
     }
+    if (collect_info(a, &cache, devs, n_devices, proc_interface, b, ar) < 0)
+	goto out;
+    store_kept(s, devs, n_devices);
+    ret = a->failed ? -1 : 0;
+out:
+    if (ret < 0)
+	errno = ENOMEM;
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (dir_fd[device_nr] >= 0)
+	    close(dir_fd[device_nr]);
+    free_discoveries(&cache, proc_interface);
+    return ret;
+}
+
+int find_devices(struct arena *a, struct sample *s, char *acpi_path, int *show, unsigned int need,
+		 int proc_interface, struct batch *b)
+{
+    return collect_sample(a, s, acpi_path, show, need, proc_interface, b, NULL);
+}
+
+/* without NEED_PRINTED every file is read, and the capacity along with the
+ * full capacity, so the snapshot serves any output; it is written to path,
+ * or to fd if path is NULL */
+static int capture(char *acpi_path, int proc_interface, struct batch *b, const char *path, int fd)
+{
+    int show[DEVICE_CLASSES] = { TRUE, TRUE, TRUE, TRUE, TRUE };
+    struct archive_writer *ar;
+    struct arena a = { NULL, NULL, 0 };
+    struct sample s;
+    int ret = -1, err;
+
+    ar = archive_writer_new(proc_interface);
+    if (!ar) {
+	errno = ENOMEM;
+	return -1;
+    }
+    if (collect_sample(&a, &s, acpi_path, show, ATTR_ALL | ATTR_BIT(ATTR_CAPACITY), proc_interface, b, ar) == 0)
+	ret = path ? archive_write(ar, path, ALL_CLASSES & ~s.missing) : archive_write_fd(ar, fd, ALL_CLASSES & ~s.missing);
+    err = errno;
+    arena_free(&a);
+    archive_writer_free(ar);
+    errno = err;
+    return ret;
+}
+
+int snapshot_capture(char *acpi_path, int proc_interface, struct batch *b, const char *path)
+{
+    return capture(acpi_path, proc_interface, b, path, -1);
 }
 
-void print_ac_adapter_information(struct list *ac_adapters, int show_empty_slots)
+int snapshot_capture_fd(char *acpi_path, int proc_interface, struct batch *b, int fd)
 {
-    struct list *adapter = ac_adapters;
-    struct list *fields;
-    struct field *value;
-    int adapter_num = 1;
+    return capture(acpi_path, proc_interface, b, NULL, fd);
+}
+
+/* Watch mode keeps the attribute files of every device open and re-reads
+ * them with pread(), so a sample costs one syscall per attribute. The
+ * device directory is only walked again every WATCH_RESCAN samples or
+ * after a device disappeared. Attributes that the uevent file provides
+ * are taken from there and get no descriptor of their own. Once the
+ * arena has grown to the size of a sample, sampling does not allocate. */
+#define WATCH_UEVENT	-2
+
+/* the last value read from a file, kept for reads that miss the deadline
+ * of the batch */
+struct watch_last {
+    char *data;
+    size_t size;
+    long long ms;	/* when it was read, 0 if it never was */
+};
+
+struct watch_attr {
+    const struct file_list *f;
+    int fd;		/* -1 if we ran out of descriptors, reopened per read */
+    struct watch_last last;
+};
 
-    while (adapter) {
-	char *state = NULL;
-	int type_ac = TRUE;
+struct watch_device {
+    char *name;
+    int uevent_fd;
+    struct watch_last uevent_last;
+    int n_attrs;
+    struct watch_attr *attrs;
+    int due;		/* its files are read, not taken from last */
+    long long next_ms;	/* when it is due with adaptive sampling */
+    long interval_ms;
+    double value;	/* the one that sets its interval */
+    long long value_ms;	/* when it was read, 0 if not yet */
+};
 
-	 fields = adapter->data;
-	while (fields) {
-	    value = fields->data;
-	    if (!strcmp(value->attr, "state") || !strcmp(value->attr, "status"))
-		state = value->value;
-	    else if (!strcmp(value->attr, "online"))
-		state = get_unit_value(value->value) ? "on-line" : "off-line";
-	    else if (!strcmp(value->attr, "type"))
-		type_ac = (strcasecmp(value->value, "mains") == 0);
+struct watch {
+    int device_nr;
+    int proc_interface;
+    unsigned int need;
+    int dir_fd;
+    DIR *dir;		/* kept open on dir_fd, so rescans do not allocate */
+    int n_devices;
+    struct watch_device *devices;
+    unsigned int samples;
+    int rescan;
+    int n_fds;		/* descriptors kept open, at most max_fds */
+    int max_fds;
+    struct batch *batch;
+    struct file_read *reads;	/* what the batch read for this sample */
+    int next_read;
+    int nomem;		/* devices were left out for lack of memory */
+    int deadline;	/* the batch gives up on reads that take too long */
+    int keep_last;	/* the last values are kept, for one or the other */
+    long min_ms;	/* interval of adaptive sampling, see watch_adapt */
+    long max_ms;	/* 0 if every device is read every time */
+    long files_read;
+    long files_saved;	/* taken from last by adaptive sampling */
+    long stale_ms;	/* age of the oldest value of the device being read
+			 * that is left from an earlier read */
+    struct discoveries cache;
+    struct arena arena;
+#ifdef ENABLE_STATS
+    long long read_ns;		/* of the files read on their own */
+#endif
+};
 
-	    fields = list_next(fields);
+static void watch_release(struct watch *w)
+{
+    int i, j;
+
+    for (i = 0; i < w->n_devices; i++) {
+	for (j = 0; j < w->devices[i].n_attrs; j++) {
+	    if (w->devices[i].attrs[j].fd >= 0)
+		close(w->devices[i].attrs[j].fd);
+	    free(w->devices[i].attrs[j].last.data);
 	}
-	if (type_ac) {		/* or else this is a battery */
-	    if (!state) {
-		if (show_empty_slots) 
-		    printf("%s %d: slot empty\n", AC_ADAPTER_DESC, adapter_num - 1);
-	    } else  {
-		printf("%s %d: %s\n", AC_ADAPTER_DESC, adapter_num - 1, state);
-	    }
+	if (w->devices[i].uevent_fd >= 0)
+	    close(w->devices[i].uevent_fd);
+	free(w->devices[i].uevent_last.data);
+	free(w->devices[i].attrs);
+	free(w->devices[i].name);
+    }
+    free(w->devices);
+    w->devices = NULL;
+    w->n_devices = 0;
+    w->n_fds = 0;
+}
+
+/* open a file to keep, the watches of all classes share the descriptors
+ * with some left for directories and files that are reopened per read */
+static int watch_keep_open(struct watch *w, int dir_fd, char *name)
+{
+    int fd;
+
+    if (w->n_fds >= w->max_fds) {
+	errno = EMFILE;
+	return -1;
+    }
+    fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+	w->n_fds++;
+    return fd;
+}
+
+static DIR *watch_opendir(struct watch *w)
+{
+    if (!w->dir)
+	return NULL;
+    rewinddir(w->dir);
+    return w->dir;
+}
+
+/* unregistered devices fail every read, find out if it is gone */
+static void watch_check_device(struct watch *w, struct watch_device *dev)
+{
+    if (faccessat(w->dir_fd, dev->name, F_OK, 0) < 0)
+	w->rescan = TRUE;
+}
 
-	    adapter_num++;
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* without memory for it the last value is forgotten */
+static void watch_keep_last(struct watch_last *last, char *data, size_t len)
+{
+    char *p;
+
+    if (last->size <= len) {
+	p = realloc(last->data, len + 1);
+	if (!p) {
+	    last->ms = 0;
+	    return;
 	}
-	adapter = list_next(adapter);
+	last->data = p;
+	last->size = len + 1;
     }
+    memcpy(last->data, data, len + 1);
+    last->ms = monotonic_ms();
 }
 
-static double get_real_temp(float temperature, char **scale, int temp_units)
+/* a read that missed the deadline takes the last value into buf, which
+ * is parsed in place, and makes the record as old as it, or timed out if
+ * there is none */
+static ssize_t watch_stale(struct watch *w, struct watch_last *last, char *buf)
 {
-	double real_temp = (double) temperature;
+    long age;
 
-	switch (temp_units) {
-	case TEMP_CELSIUS:
-	    *scale = "degrees C";
-	    break;
-	case TEMP_FAHRENHEIT:
-	    real_temp = (real_temp * 1.8) + 32;
-	    *scale = "degrees F";
-	    break;
-	case TEMP_KELVIN:
-	default:
-	    real_temp += ABSOLUTE_ZERO;
-	    *scale = "kelvin";
-	    break;
+    if (!last->ms) {
+	w->stale_ms = STALE_TIMED_OUT;
+	return -ETIMEDOUT;
+    }
+    age = monotonic_ms() - last->ms;
+    if (w->stale_ms != STALE_TIMED_OUT && age > w->stale_ms)
+	w->stale_ms = age;
+    strcpy(buf, last->data);
+    return strlen(buf);
+}
+
+/* read an open file, or take what the batch of the sample read from it;
+ * files are taken from the batch in the order watch_batch queued them */
+static ssize_t watch_pread(struct watch *w, struct watch_device *dev, char *file, struct watch_last *last,
+			   int fd, char **buf, size_t size)
+{
+    struct file_read one, *r = &one;
+    ssize_t n;
+
+    if (w->reads) {
+	r = &w->reads[w->next_read++];
+    } else if (w->deadline) {
+	/* a file read on its own may not hang either */
+	one.fd = fd;
+	one.path = NULL;
+	one.buf = *buf;
+	one.size = size;
+	batch_read(w->batch, &one, 1);
+    } else {
+	STATS_START(batch_stats(w->batch), start);
+	n = pread(fd, *buf, size - 1, 0);
+	if (n >= 0)
+	    (*buf)[n] = '\0';
+	STATS_FILE_SINCE(batch_stats(w->batch), w->read_ns, dev->name, file, start, n, 1);
+	if (n >= 0 && w->keep_last)
+	    watch_keep_last(last, *buf, n);
+	return n;
+    }
+    STATS_BATCH_FILE(batch_stats(w->batch), dev->name, file, r);
+    *buf = r->buf;
+    if (r->result == -ETIMEDOUT)
+	return watch_stale(w, last, r->buf);
+    if (r->result >= 0 && w->keep_last)
+	watch_keep_last(last, r->buf, r->result);
+    return r->result;
+}
+
+/* the last value of a device that is not due, parsed in place from buf */
+static ssize_t watch_kept(struct watch_last *last, char *buf)
+{
+    if (!last->ms)
+	return -ENODATA;
+    strcpy(buf, last->data);
+    return strlen(buf);
+}
+
+/* a file of a device that failed to read */
+static void watch_failed(struct watch *w, struct watch_device *dev, ssize_t n)
+{
+    if (n != -ETIMEDOUT && n != -ENODATA)
+	watch_check_device(w, dev);
+}
+
+static void watch_read_uevent(struct watch *w, struct watch_device *dev, char *buf, size_t size, struct uevent *ue)
+{
+    ssize_t n;
+
+    ue->n = 0;
+    if (dev->uevent_fd < 0)
+	return;
+    if (dev->due)
+	n = watch_pread(w, dev, "uevent", &dev->uevent_last, dev->uevent_fd, &buf, size);
+    else
+	n = watch_kept(&dev->uevent_last, buf);
+    if (n < 0) {
+	watch_failed(w, dev, n);
+	return;
+    }
+    parse_uevent(ue, buf, device[w->device_nr].uevent);
+}
+
+static void watch_add_device(struct watch *w, char *name)
+{
+    struct watch_device *dev;
+    const struct file_list *list = get_file_list(w->device_nr, w->proc_interface);
+    struct file_list *files;
+    unsigned int covered = 0, known, want;
+    int i, fd, dev_fd, n, n_files;
+    char *prefix = w->proc_interface ? NULL : device[w->device_nr].uevent;
+    char buf[ATTR_BUF_SIZE];
+    struct uevent ue;
+    struct stat st;
+
+    dev = realloc(w->devices, (w->n_devices + 1) * sizeof(struct watch_device));
+    if (!dev) {
+	w->nomem = TRUE;
+	return;
+    }
+    w->devices = dev;
+    dev = &w->devices[w->n_devices];
+    dev->name = strdup(name);
+    dev->attrs = NULL;
+    dev->n_attrs = 0;
+    dev->uevent_fd = -1;
+    memset(&dev->uevent_last, 0, sizeof(dev->uevent_last));
+    dev->due = TRUE;
+    dev->next_ms = dev->value_ms = 0;
+    dev->interval_ms = w->min_ms;
+    if (!dev->name) {
+	w->nomem = TRUE;
+	return;
+    }
+    w->n_devices++;
+
+    dev_fd = openat(w->dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dev_fd < 0)
+	return;
+
+    if (prefix)
+	dev->uevent_fd = watch_keep_open(w, dev_fd, "uevent");
+    watch_read_uevent(w, dev, buf, sizeof(buf), &ue);
+    if (!ue.n && dev->uevent_fd >= 0) {
+	close(dev->uevent_fd);
+	dev->uevent_fd = -1;
+	w->n_fds--;
+    }
+
+    /* the devices of the last enumeration are released, so nothing points
+     * into what is forgotten */
+    if (fstat(dev_fd, &st) == 0)
+	forget_replaced(&w->cache, w->device_nr, name, w->proc_interface, &st);
+    n_files = discover_attributes(&w->cache, w->dir_fd, name, w->device_nr, w->proc_interface, &files);
+    for (n = 0; list[n].file; n++)
+	;
+    dev->attrs = n_files >= 0 ? calloc(n + n_files, sizeof(struct watch_attr)) : NULL;
+    if (!dev->attrs) {
+	/* the device stays, without values */
+	w->nomem = TRUE;
+	close(dev_fd);
+	return;
+    }
+
+    for (i = 0; ue.n && i < n; i++) {
+	if (strchr(list[i].file, '%') || !uevent_value(&ue, list[i].file))
+	    continue;
+	dev->attrs[dev->n_attrs].f = &list[i];
+	dev->attrs[dev->n_attrs].fd = WATCH_UEVENT;
+	dev->n_attrs++;
+	covered |= ATTR_BIT(list[i].id);
+    }
+    for (known = covered, i = 0; i < n_files; i++)
+	known |= ATTR_BIT(files[i].id);
+    want = wanted(w->device_nr, w->need, known, known, TRUE);
+    for (i = 0; i < n_files; i++) {
+	if ((covered & ATTR_BIT(files[i].id)) || !(want & ATTR_BIT(files[i].id)))
+	    continue;
+	fd = watch_keep_open(w, dev_fd, files[i].file);
+	if (fd == -1 && errno != EMFILE && errno != ENFILE)
+	    continue;
+	dev->attrs[dev->n_attrs].f = &files[i];
+	dev->attrs[dev->n_attrs].fd = fd;
+	dev->n_attrs++;
+    }
+    close(dev_fd);
+}
+
+static void watch_enumerate(struct watch *w)
+{
+    DIR *d;
+    struct dirent *de;
+
+    watch_release(w);
+    w->rescan = FALSE;
+    w->nomem = FALSE;
+    d = watch_opendir(w);
+    if (!d)
+	return;
+    while ((de = readdir(d))) {
+	if (ignore_directory_entry(de))
+	    continue;
+	watch_add_device(w, de->d_name);
+    }
+}
+
+/* cheap check whether devices were added or removed: only compare names */
+static int watch_devices_changed(struct watch *w)
+{
+    DIR *d;
+    struct dirent *de;
+    int i = 0, changed = FALSE;
+
+    d = watch_opendir(w);
+    if (!d)
+	return w->n_devices != 0;
+    while (!changed && (de = readdir(d))) {
+	if (ignore_directory_entry(de))
+	    continue;
+	if (i >= w->n_devices || strcmp(de->d_name, w->devices[i].name))
+	    changed = TRUE;
+	i++;
+    }
+    return changed || i != w->n_devices;
+}
+
+struct watch *watch_open(char *acpi_path, int device_nr, unsigned int need, int proc_interface, struct batch *b)
+{
+    struct watch *w;
+    struct rlimit rl;
+    int root_fd, fd;
+    char *device_type = proc_interface ? device[device_nr].proc : device[device_nr].sys;
+
+    root_fd = open(acpi_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+	return NULL;
+
+    w = calloc(1, sizeof(struct watch));
+    if (!w) {
+	close(root_fd);
+	errno = ENOMEM;
+	return NULL;
+    }
+    w->device_nr = device_nr;
+    w->proc_interface = proc_interface;
+    w->need = need;
+    w->batch = b;
+    w->deadline = batch_deadline(b) > 0;
+    w->keep_last = w->deadline;
+    w->max_fds = INT_MAX;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+	w->max_fds = ((long) rl.rlim_cur - WATCH_FD_RESERVE) / 4;
+    w->dir_fd = openat(root_fd, device_type, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    close(root_fd);
+    if (w->dir_fd >= 0) {
+	fd = dup(w->dir_fd);
+	w->dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (!w->dir) {
+	    if (fd >= 0)
+		close(fd);
+	    close(w->dir_fd);
+	    free(w);
+	    errno = ENOMEM;
+	    return NULL;
 	}
-	return (real_temp);
-}
-
-void print_thermal_information(struct list *thermal, int show_empty_slots, int temp_units, int show_trip_points)
-{
-    struct list *sensor = thermal;
-    struct list *fields;
-    struct field *value;
-    int sensor_num = 1;
-    int type_zone = TRUE;
-
-    while (sensor) {
-	float temperature = -1;
-	struct {
-			float trip_temp;
-			char *trip_type;
-	} trip[TRIP_POINTS];
-	char str[]="trip_point_123_type";
-	char *state = NULL, *scale;
-	double real_temp;
-	int i, trip_points = -1;
-
-	memset(trip, 0, sizeof trip);
-	fields = sensor->data;
-	while (fields) {
-	    value = fields->data;
-	    if (!strcmp(value->attr, "state")) {
-		state = value->value;
-	    } else if (!strcmp(value->attr, "type")) {
-		type_zone = (strstr(value->value, "thermal zone") != NULL || strstr(value->value, "acpitz") != NULL);
-		if (!state)
-		    state = strdup("ok");
-	    } else if (!strcmp(value->attr, "temperature")) {
-		temperature = get_unit_value(value->value);
-		if (strstr(value->value, "dK"))
-		    temperature = (temperature / 10) - ABSOLUTE_ZERO;
-		if (!state)
-		    state = strdup("ok");
-	    } else if (!strcmp(value->attr, "sys_temp")) {
-		temperature = get_unit_value(value->value) / 1000.0;
-		if (!state)
-		    state = strdup("ok");
-	    } else {
-		for (i = 0; i < TRIP_POINTS; i++)
-		{
-			sprintf(str, "trip_point_%d_temp", i);
-			if (!strcmp(value->attr, str)) {
-				trip[i].trip_temp = get_unit_value(value->value) / 1000.0;
-			}
-			sprintf(str, "trip_point_%d_type", i);
-			if (!strcmp(value->attr, str)) {
-				trip[i].trip_type = value->value;
-				if (i > trip_points)
-					trip_points = i;
-			}
-		}
-	    }
-	    fields = list_next(fields);
+    }
+
+    STATS_START(batch_stats(w->batch), start);
+    watch_enumerate(w);
+    STATS_SPLIT(batch_stats(w->batch), STATS_READ, w->read_ns, STATS_ENUMERATE, start);
+    return w;
+}
+
+static void watch_read_attr(struct watch *w, struct watch_device *dev, struct watch_attr *a, struct uevent *ue, void *rec)
+{
+    char data[ATTR_BUF_SIZE];
+    char path[BUF_SIZE];
+    char *buf = data;
+    ssize_t n;
+    int fd = a->fd;
+
+    if (fd == WATCH_UEVENT) {
+	char *value = uevent_value(ue, a->f->file);
+
+	/* a property that fails to read is left out of the uevent */
+	if (value)
+	    set_attr(&w->arena, w->device_nr, rec, a->f->id, a->f->index, value, 1);
+	return;
+    }
+    if (!dev->due) {
+	n = watch_kept(&a->last, buf);
+    } else if (fd < 0) {
+	STATS_START(batch_stats(w->batch), start);
+	snprintf(path, sizeof(path), "%s/%s", dev->name, a->f->file);
+	fd = openat(w->dir_fd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+	    STATS_FILE_SINCE(batch_stats(w->batch), w->read_ns, dev->name, a->f->file, start, -1, 1);
+	    return;
 	}
-	if (type_zone) {	/* or else this is a cooling device */
-	    for (i = 0; i <= trip_points; i++)
-	    {
-		if (temperature >= trip[i].trip_temp && trip[i].trip_temp >= MIN_TEMP) {
-			state = trip[i].trip_type;
-			break;
-		}
-	    }
-	    if (!state) {
-		if (show_empty_slots) 
-		    printf("%s %d: slot empty\n", THERMAL_DESC, sensor_num - 1);
-	    } else {
-		real_temp = get_real_temp(temperature, &scale, temp_units);
-		printf("%s %d: %s, %.1f %s\n", THERMAL_DESC, sensor_num - 1, state, real_temp, scale);
-		if (show_trip_points) {
-		    for (i = 0; i <= trip_points; i++)
-		    {
-			if (trip[i].trip_temp >= MIN_TEMP) {
-				real_temp = get_real_temp(trip[i].trip_temp, &scale, temp_units);
-				printf("%s %d: trip point %d switches to mode %s at temperature %.1f %s\n",
-				THERMAL_DESC, sensor_num - 1, i, trip[i].trip_type, real_temp, scale);
-			}
-		    }
-		}
-	    }
-	    sensor_num++;
+	n = pread(fd, buf, sizeof(data) - 1, 0);
+	close(fd);
+	if (n >= 0) {
+	    buf[n] = '\0';
+	    if (w->keep_last)
+		watch_keep_last(&a->last, buf, n);
 	}
-	sensor = list_next(sensor);
-    }
-}
-
-void print_cooling_information(struct list *cooling, int show_empty_slots)
-{
-    struct list *sensor = cooling;
-    struct list *fields;
-    struct field *value;
-    int sensor_num = 1;
-
-    while (sensor) {
-	char *state = NULL, *type = NULL;
-	int cur_state = -1, max_state = -1;
-	int type_cooling = TRUE;
-
-	fields = sensor->data;
-	while (fields) {
-	    value = fields->data;
-	    if (!strcmp(value->attr, "status")) {
-		state = value->value;
-	    } else if (!strcmp(value->attr, "type")) {
-		type = value->value;
-		type_cooling = (strstr(type, "thermal zone") == NULL && strstr(type, "acpitz") == NULL);
-	    } else if (!strcmp(value->attr, "cur_state")) {
-		cur_state = get_unit_value(value->value);
-	    } else if (!strcmp(value->attr, "max_state")) {
-		max_state = get_unit_value(value->value);
-	    }
-	    fields = list_next(fields);
+	STATS_FILE_SINCE(batch_stats(w->batch), w->read_ns, dev->name, a->f->file, start, n, 3);
+    } else {
+	n = watch_pread(w, dev, a->f->file, &a->last, fd, &buf, sizeof(data));
+    }
+    if (n < 0) {
+	watch_failed(w, dev, n);
+	return;
+    }
+    parse_info_buffer(&w->arena, w->device_nr, rec, buf, a->f, NULL, -1);
+}
+
+/* Adaptive sampling reads a device again after an interval that follows
+ * how fast it changes: the time its value takes to change by a step worth
+ * showing at the rate it changed since the last read, doubled while it
+ * does not change at all, and between min_ms and max_ms. The step is 1%
+ * of the full charge of a battery, half a degree of a thermal zone or of
+ * the hottest sensor of a hwmon chip and any change of an adapter or a
+ * cooling device. A thermal zone is read at least four times before it
+ * would reach its next trip point, and every min_ms within ADAPT_NEAR_TRIP
+ * degrees of it. */
+#define ADAPT_TEMP_STEP		0.5
+#define ADAPT_NEAR_TRIP		5.0
+
+static void watch_adapt(struct watch *w, struct watch_device *dev, void *rec, long long now)
+{
+    struct battery_info *b;
+    struct thermal_info *z;
+    struct hwmon_info *h;
+    struct trip_point *trip = NULL;
+    double value, step = 0.5, rate, until, interval;
+    int i;
+
+    switch (w->device_nr) {
+    case BATTERY:
+	b = rec;
+	if (HAS_ATTR(b, ATTR_CHARGE_NOW)) {
+	    value = b->charge_now;
+	    step = HAS_ATTR(b, ATTR_CHARGE_FULL) ? b->charge_full / 100.0 : value / 100.0;
+	} else if (HAS_ATTR(b, ATTR_ENERGY_NOW)) {
+	    value = b->energy_now;
+	    step = HAS_ATTR(b, ATTR_ENERGY_FULL) ? b->energy_full / 100.0 : value / 100.0;
+	} else {
+	    value = 0;
 	}
-	if (type_cooling) {	/* or else this is a thermal zone */
-	    if (!state && !type) {
-		if (show_empty_slots)
-		    printf("%s %d: slot empty\n", COOLING_DESC, sensor_num - 1);
-	    } else if (state) {
-		printf("%s %d: %s\n", COOLING_DESC, sensor_num - 1, state);
-	    } else if (cur_state < 0 || max_state < 0) {
-		printf("%s %d: %s no state information available\n", COOLING_DESC, sensor_num - 1, type);
-	    } else {
-		printf("%s %d: %s %d of %d\n", COOLING_DESC, sensor_num - 1, type, cur_state, max_state);
-	    }
+	if (step < 1)
+	    step = 1;
+	break;
+    case AC_ADAPTER:
+	value = ((struct adapter_info *) rec)->online;
+	break;
+    case THERMAL_ZONE:
+	z = rec;
+	value = z->temperature;
+	step = ADAPT_TEMP_STEP;
+	/* by_temp is sorted, the first one above is the next */
+	for (i = 0; i < z->n_by_temp && !trip; i++)
+	    if (z->by_temp[i]->temp > z->temperature)
+		trip = z->by_temp[i];
+	break;
+    case HWMON:
+	/* the hottest sensor of a chip */
+	h = rec;
+	value = 0;
+	for (i = 0; i < h->n_temp; i++)
+	    if (HAS_ATTR(&h->temp[i], ATTR_TEMP_INPUT) && h->temp[i].input > value)
+		value = h->temp[i].input;
+	step = ADAPT_TEMP_STEP;
+	break;
+    default:
+	value = ((struct cooling_info *) rec)->cur_state;
+	break;
+    }
 
-	    sensor_num++;
+    if (!dev->value_ms || now <= dev->value_ms) {
+	interval = w->min_ms;
+    } else {
+	rate = (value > dev->value ? value - dev->value : dev->value - value) / (now - dev->value_ms);
+	interval = rate > 0 ? step / rate : dev->interval_ms * 2;
+	if (trip && value > dev->value) {
+	    until = (trip->temp - value) / rate;
+	    if (interval > until / 4)
+		interval = until / 4;
 	}
+    }
+    if (trip && trip->temp - value < ADAPT_NEAR_TRIP)
+	interval = w->min_ms;
+    if (interval < w->min_ms)
+	interval = w->min_ms;
+    if (interval > w->max_ms)
+	interval = w->max_ms;
+    dev->value = value;
+    dev->value_ms = now;
+    dev->interval_ms = (long) interval;
+    dev->next_ms = now + dev->interval_ms;
+}
+
+/* read all open files of a sample as one batch */
+static void watch_batch(struct watch *w)
+{
+    struct watch_device *dev;
+    struct file_read *r;
+    int i, j, n = 0;
+
+    w->reads = NULL;
+    w->next_read = 0;
+    if (!w->batch)
+	return;
+    for (i = 0; i < w->n_devices; i++) {
+	if (!w->devices[i].due)
+	    continue;
+	n += w->devices[i].uevent_fd >= 0;
+	for (j = 0; j < w->devices[i].n_attrs; j++)
+	    n += w->devices[i].attrs[j].fd >= 0;
+    }
+    /* without memory for the batch every file is read on its own */
+    w->reads = r = arena_alloc(&w->arena, n * sizeof(struct file_read));
+    if (!r)
+	return;
+    /* in the order watch_read takes them */
+    for (i = w->n_devices - 1; i >= 0; i--) {
+	dev = &w->devices[i];
+	for (j = -1; dev->due && j < dev->n_attrs; j++) {
+	    r->fd = j < 0 ? dev->uevent_fd : dev->attrs[j].fd;
+	    if (r->fd < 0)
+		continue;
+	    r->path = NULL;
+	    r->size = ATTR_BUF_SIZE;
+	    r->buf = arena_alloc(&w->arena, r->size);
+	    if (!r->buf) {
+		w->reads = NULL;
+		return;
+	    }
+	    r++;
+	}
+    }
+    batch_read(w->batch, w->reads, n);
+}
+
+/* read one sample into the device_nr part of s, the records stay valid
+ * until the next call */
+int watch_read(struct watch *w, struct sample *s)
+{
+    struct watch_device *dev;
+    char buf[ATTR_BUF_SIZE];
+    struct uevent ue;
+    size_t size = record_size(w->device_nr);
+    char *records, *rec;
+    long long now;
+    int i, j, n = 0, files;
+    STATS_START(batch_stats(w->batch), start);
 
-	sensor = list_next(sensor);
+    arena_reset(&w->arena);
+    if (w->rescan || (++w->samples % WATCH_RESCAN == 0 && watch_devices_changed(w)))
+	watch_enumerate(w);
+    STATS_SPLIT(batch_stats(w->batch), STATS_READ, w->read_ns, STATS_ENUMERATE, start);
+
+    /* samples come every min_ms or so, a device is due if it would be
+     * before the next one */
+    now = w->max_ms ? monotonic_ms() : 0;
+    for (i = 0; i < w->n_devices; i++) {
+	dev = &w->devices[i];
+	dev->due = !w->max_ms || dev->next_ms <= now + w->min_ms / 2;
+	files = dev->uevent_fd >= 0;
+	for (j = 0; j < dev->n_attrs; j++)
+	    files += dev->attrs[j].fd != WATCH_UEVENT;
+	if (dev->due)
+	    w->files_read += files;
+	else
+	    w->files_saved += files;
+    }
+
+    if (w->n_devices)
+	s->missing &= ~(1U << w->device_nr);
+    else
+	s->missing |= 1U << w->device_nr;
+    records = arena_alloc(&w->arena, w->n_devices * size);
+    if (!records) {
+	store_records(s, w->device_nr, NULL, 0);
+	errno = ENOMEM;
+	return -1;
+    }
+    watch_batch(w);
+    if (w->reads)
+	STATS_LAP(batch_stats(w->batch), STATS_READ, start);
+    /* devices are numbered in reverse directory order, see find_devices */
+    for (i = w->n_devices - 1; i >= 0; i--) {
+	dev = &w->devices[i];
+	rec = records + n * size;
+	init_record(w->device_nr, rec);
+	w->stale_ms = 0;
+	watch_read_uevent(w, dev, buf, sizeof(buf), &ue);
+	for (j = 0; j < dev->n_attrs; j++)
+	    watch_read_attr(w, dev, &dev->attrs[j], &ue, rec);
+	set_stale(w->device_nr, rec, w->stale_ms);
+	finish_record(&w->arena, w->device_nr, rec);
+	if (w->max_ms && dev->due)
+	    watch_adapt(w, dev, rec, now);
+	if (keep_record(w->device_nr, rec))
+	    n++;
     }
+    STATS_SPLIT(batch_stats(w->batch), STATS_READ, w->read_ns, STATS_PARSE, start);
+    /* a rescan before the next batch reads on its own */
+    w->reads = NULL;
+    store_records(s, w->device_nr, records, n);
+    if (w->nomem || w->arena.failed) {
+	errno = ENOMEM;
+	return -1;
+    }
+    return 0;
+}
+
+void watch_adaptive(struct watch *w, long min_ms, long max_ms)
+{
+    int i;
+
+    w->min_ms = min_ms;
+    w->max_ms = max_ms;
+    w->keep_last = TRUE;
+    for (i = 0; i < w->n_devices; i++)
+	w->devices[i].interval_ms = min_ms;
+}
+
+void watch_files(struct watch *w, long *read, long *saved)
+{
+    *read += w->files_read;
+    *saved += w->files_saved;
+}
+
+/* sysfs wakes up pollers for POLLPRI when a driver notifies a change of
+ * an attribute, reading it again is what rearms that */
+int watch_fds(struct watch *w, struct pollfd *fds, int size)
+{
+    struct watch_device *dev;
+    int i, j, n = 0;
+
+    for (i = 0; i < w->n_devices; i++) {
+	dev = &w->devices[i];
+	for (j = 0; j < dev->n_attrs; j++) {
+	    if (dev->attrs[j].fd < 0)
+		continue;
+	    if (n < size) {
+		fds[n].fd = dev->attrs[j].fd;
+		fds[n].events = POLLPRI;
+		fds[n].revents = 0;
+	    }
+	    n++;
+	}
+    }
+    return n;
+}
+
+void watch_rescan(struct watch *w)
+{
+    w->rescan = TRUE;
+}
+
+void watch_close(struct watch *w)
+{
+    if (!w)
+	return;
+    watch_release(w);
+    if (w->dir)
+	closedir(w->dir);
+    if (w->dir_fd >= 0)
+	close(w->dir_fd);
+    free_discoveries(&w->cache, w->proc_interface);
+    arena_free(&w->arena);
+    free(w);
 }
@@ -23,6 +23,7 @@
 #define _APCI_H
 
 #include "config.h"
+#include "prefix.h"
 
 /* remember to update this when making new releases */
 #define ACPI_VERSION_STRING "acpi " VERSION
@@ -47,26 +48,256 @@
 #define AC_ADAPTER 1
 #define THERMAL_ZONE 2
 #define COOLING_DEV 3
+#define HWMON 4
+#define DEVICE_CLASSES 5
+#define ALL_CLASSES ((1 << DEVICE_CLASSES) - 1)
 
-extern struct device
+/* Every attribute is resolved to one of these ids when it is read, the
+ * print functions then only look at the typed records below. */
+enum attr_id {
+	ATTR_CURRENT_NOW,
+	ATTR_POWER_NOW,
+	ATTR_CHARGE_NOW,
+	ATTR_ENERGY_NOW,
+	ATTR_VOLTAGE_NOW,
+	ATTR_CHARGE_FULL,
+	ATTR_ENERGY_FULL,
+	ATTR_CHARGE_FULL_DESIGN,
+	ATTR_ENERGY_FULL_DESIGN,
+	ATTR_CHARGING_STATE,
+	ATTR_TYPE,
+	ATTR_ONLINE,
+	ATTR_STATE,
+	ATTR_STATUS,
+	ATTR_TEMP,
+	ATTR_TEMPERATURE,
+	ATTR_TRIP_TYPE,
+	ATTR_TRIP_TEMP,
+	ATTR_CUR_STATE,
+	ATTR_MAX_STATE,
+	ATTR_OTHER,		/* a /proc line we do not use */
+	ATTR_PROC_LINES,	/* a /proc file of "name: value" lines */
+	ATTR_CAPACITY,		/* the bits are kept in recordings, new ids go below */
+	ATTR_TEMP_INPUT,
+	ATTR_TEMP_CRIT,
+	ATTR_TEMP_LABEL,
+	ATTR_FAN_INPUT
+};
+
+#define ATTR_BIT(id)		(1U << (id))
+#define HAS_ATTR(rec, id)	((rec)->have & ATTR_BIT(id))
+/* every attribute but the capacity, which only stands in for the full
+ * capacity, see NEED_PRINTED */
+#define ATTR_ALL		((ATTR_BIT(ATTR_FAN_INPUT) * 2 - 1) & ~ATTR_BIT(ATTR_CAPACITY))
+
+/* Which attributes are read is given by a need of ATTR_BIT()s. Added to
+ * it, NEED_PRINTED asks for only what the text lines of a battery take:
+ * the charge values rather than the energy ones and the current rather
+ * than the power if it has both, the voltage only to convert energy to
+ * charge, and the full capacity, if it is not in the need, only when
+ * there is no capacity file for the percentage or the battery is charging
+ * or has no state. The capacity is only read if asked for this way. */
+#define NEED_PRINTED		(1U << 31)
+
+/* maps an attribute file to the id of its value */
+struct file_list {
+	char *file;
+	int id;
+	int index;	/* number of the trip point */
+};
+
+extern const struct file_list battery_files[];
+extern const struct file_list ac_adapter_files[];
+extern const struct file_list thermal_files[];
+extern const struct file_list cooling_files[];
+extern const struct file_list hwmon_files[];
+
+extern const struct device
 {
 	int type;
 	char *proc;
 	char *sys;
 	char *sys_dev;
-} device[4];
+	char *uevent;	/* prefix of the properties in the uevent file */
+	const struct file_list *files;	/* attributes to read on the sys interface */
+} device[DEVICE_CLASSES];
 
-struct list *find_devices(char *acpi_path, int device_nr, int proc_interface);
+/* Values are kept in the units of the sys interface (uA, uAh, uV, uW,
+ * uWh), values from /proc are scaled to match. The first value read for
+ * an attribute wins, have records which ones were read. A read that
+ * misses the deadline of a watch gives the value it read before, stale_ms
+ * is then how old the oldest such value is; it is STALE_TIMED_OUT if a read
+ * missed the deadline and there was no value before, which is always the
+ * case for a single sample. */
+#define STALE_TIMED_OUT	-1
 
-void free_devices(struct list *devices);
+struct battery_info {
+	unsigned int have;
+	long stale_ms;		/* age of values left from earlier reads */
+	char *state;
+	char *type;
+	long current_now;
+	long power_now;
+	long charge_now;
+	long energy_now;
+	long voltage_now;
+	long charge_full;
+	long energy_full;
+	long charge_full_design;
+	long energy_full_design;
+	long capacity;		/* percent, as the kernel works it out */
+};
 
-void print_battery_information(struct list *batteries, int show_empty_slots, int show_capacity);
+struct adapter_info {
+	unsigned int have;
+	long stale_ms;
+	char *state;
+	char *type;
+	int online;
+};
 
-void print_ac_adapter_information(struct list *batteries, int show_empty_slots);
+/* trip points below this are not set */
+#define MIN_TEMP	0.01
 
-void print_thermal_information(struct list *batteries, int show_empty_slots, int temp_units, int show_trip_points);
+struct trip_point {
+	float temp;		/* degrees C */
+	char *type;
+};
 
-void print_cooling_information(struct list *batteries, int show_empty_slots);
+struct thermal_info {
+	unsigned int have;
+	long stale_ms;
+	char *state;
+	char *type;
+	float temperature;	/* degrees C */
+	int trip_points;	/* highest trip point with a type, or -1 */
+	int n_trip;		/* trip is indexed by the number of the trip point */
+	int trip_size;
+	struct trip_point *trip;
+	int n_by_temp;		/* those up to trip_points with a temperature */
+	struct trip_point **by_temp;
+};
 
-#endif
+struct cooling_info {
+	unsigned int have;
+	long stale_ms;
+	char *state;
+	char *type;
+	int cur_state;
+	int max_state;
+};
+
+/* a temperature sensor or a fan of a hwmon chip, they are indexed by the
+ * number in their file names */
+struct hwmon_sensor {
+	unsigned int have;
+	float input;		/* degrees C, or RPM of a fan */
+	float crit;		/* degrees C */
+	char *label;
+};
+
+struct hwmon_info {
+	unsigned int have;
+	long stale_ms;
+	char *type;		/* the name of the chip */
+	int n_temp;
+	int temp_size;
+	struct hwmon_sensor *temp;
+	int n_fan;
+	int fan_size;
+	struct hwmon_sensor *fan;
+};
+
+/* one sample, every class is a contiguous array in output order */
+struct sample {
+	int n_batteries;
+	struct battery_info *batteries;
+	int n_adapters;
+	struct adapter_info *adapters;
+	int n_zones;
+	struct thermal_info *zones;
+	int n_coolers;
+	struct cooling_info *coolers;
+	int n_chips;
+	struct hwmon_info *chips;
+	unsigned int missing;	/* bit device_nr set if a class has no devices */
+};
+
+struct arena;
+struct batch;
+struct pollfd;
+struct acpi;
+
+/* Nothing below prints or exits, failures are returned with errno set, so
+ * these functions and those of libacpi.h form the library. */
+
+/* fills the parts of s of the classes with show[device_nr] set with the
+ * attributes of need, records are allocated from arena a; the files are
+ * read by batch b, one after another if it is NULL; returns 0, or -1 if
+ * acpi_path cannot be opened or there is no memory */
+int find_devices(struct arena *a, struct sample *s, char *acpi_path, int *show, unsigned int need,
+		 int proc_interface, struct batch *b);
+
+/* reads every attribute of all classes like find_devices and writes them
+ * to a single file at path, which find_devices then takes as acpi_path;
+ * returns 0, or -1 with errno set */
+int snapshot_capture(char *acpi_path, int proc_interface, struct batch *b, const char *path);
+
+/* snapshot_capture to the empty file fd, which is left open */
+int snapshot_capture_fd(char *acpi_path, int proc_interface, struct batch *b, int fd);
+
+/* find_devices from the snapshot open at fd, whichever interface it was
+ * taken of; returns 0, or -1 with errno set, EINVAL if fd is not one */
+int find_snapshot(struct arena *a, struct sample *s, int fd, int *show, unsigned int need);
 
+/* rebuilds what is derived from the values of the device_nr part of s, for
+ * records that were not filled by find_devices or watch_read */
+void finish_records(struct arena *a, struct sample *s, int device_nr);
+
+/* keeps the devices of one class open for repeated sampling */
+struct watch;
+
+/* reads the attributes of need, a battery always gets its full capacity
+ * as it may start charging; returns NULL if acpi_path cannot be opened or
+ * there is no memory */
+struct watch *watch_open(char *acpi_path, int device_nr, unsigned int need, int proc_interface, struct batch *b);
+
+/* sets the device_nr bit of s->missing if there are no devices, returns
+ * -1 if some values were left out for lack of memory */
+int watch_read(struct watch *w, struct sample *s);
+
+/* fills fds with up to size of the open files to poll, returns how many
+ * there are */
+int watch_fds(struct watch *w, struct pollfd *fds, int size);
+
+/* from now on watch_read only reads a device again once it is due after
+ * an interval between min_ms and max_ms that follows how fast it changes,
+ * and takes its last values otherwise */
+void watch_adaptive(struct watch *w, long min_ms, long max_ms);
+
+/* adds the number of files watch_read has read, and of those adaptive
+ * sampling did not read again, to read and saved */
+void watch_files(struct watch *w, long *read, long *saved);
+
+/* makes the next watch_read look for added or removed devices */
+void watch_rescan(struct watch *w);
+
+void watch_close(struct watch *w);
+
+/* a handle of libacpi.h for the classes set as bits of device_nr that
+ * reads the attributes of need for its snapshots with batch b */
+struct acpi *snapshot_open(const char *root, unsigned int classes, int proc_interface, unsigned int need,
+			   struct batch *b);
+
+/* the sample of the last acpi_snapshot_refresh */
+struct sample *snapshot_sample(struct acpi *h);
+
+/* the classes of the last sample of a handle of acpi_open_shared, and the
+ * time it was taken at */
+unsigned int snapshot_shared(struct acpi *h, long long *time_ms);
+
+/* watch_adaptive and watch_files for all classes of a handle */
+void snapshot_adaptive(struct acpi *h, long min_ms, long max_ms);
+void snapshot_files(struct acpi *h, long *read, long *saved);
+
+#endif
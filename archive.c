@@ -0,0 +1,414 @@
+/* snapshots of all devices in a single file
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "acpi.h"
+#include "archive.h"
+
+/* A snapshot is
+ *
+ *	ARCHIVE_MAGIC, u32 flags, u32 classes, u32 devices, u32 values,
+ *	u32 offset of the strings, u32 zero
+ *	per device: u32 device_nr, name, first value and number of values
+ *	per value: u32 kind, name and value
+ *	the strings, null terminated, each one only once
+ *
+ * with numbers in little endian and names and values given as offsets
+ * into the strings. The values of a device are in the order they were
+ * read, those of the uevent file first. Everything is checked once when
+ * it is mapped, after that the strings are used where they are. */
+#define ARCHIVE_MAGIC	"ACPISNP\001"
+#define MAGIC_LEN	8
+#define HEADER_SIZE	32
+#define DEVICE_SIZE	16
+#define VALUE_SIZE	12
+
+#define FLAG_PROC	1
+
+struct wvalue {
+    uint32_t kind;
+    uint32_t name;
+    uint32_t value;
+};
+
+struct wdevice {
+    uint32_t device_nr;
+    uint32_t name;
+    int n;
+    int size;
+    struct wvalue *values;
+};
+
+struct archive_writer {
+    int proc_interface;
+    int n_devices;
+    int size;
+    struct wdevice *devices;
+    long n_values;
+    char *strings;
+    size_t len;
+    size_t strings_size;
+    uint32_t *slots;		/* offsets plus one of the strings, by hash */
+    size_t n_slots;
+    size_t n_strings;
+    int failed;			/* a value could not be added */
+};
+
+struct archive {
+    unsigned char *map;
+    size_t size;
+    uint32_t flags;
+    uint32_t classes;
+    uint32_t n_devices;
+    uint32_t n_values;
+    char *strings;
+};
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static unsigned int hash(const char *s, size_t len)
+{
+    unsigned int h = 5381;
+
+    while (len--)
+	h = h * 33 + (unsigned char) *s++;
+    return h;
+}
+
+static uint32_t *find_slot(struct archive_writer *w, const char *s, size_t len)
+{
+    size_t i = hash(s, len) & (w->n_slots - 1);
+    char *t;
+
+    while (w->slots[i]) {
+	t = w->strings + w->slots[i] - 1;
+	if (!strncmp(t, s, len) && !t[len])
+	    break;
+	i = (i + 1) & (w->n_slots - 1);
+    }
+    return &w->slots[i];
+}
+
+/* returns the offset of the string, or -1 if there is no memory */
+static long intern(struct archive_writer *w, const char *s, size_t len)
+{
+    uint32_t *slot, *slots;
+    char *strings;
+    size_t i, n;
+
+    if (2 * (w->n_strings + 1) > w->n_slots) {
+	n = w->n_slots ? 2 * w->n_slots : 1024;
+	slots = calloc(n, sizeof(uint32_t));
+	if (!slots)
+	    return -1;
+	free(w->slots);
+	w->slots = slots;
+	w->n_slots = n;
+	for (i = 0; i < w->len; i += strlen(w->strings + i) + 1)
+	    *find_slot(w, w->strings + i, strlen(w->strings + i)) = i + 1;
+    }
+    slot = find_slot(w, s, len);
+    if (*slot)
+	return *slot - 1;
+    if (w->len + len + 1 > w->strings_size) {
+	n = w->strings_size ? 2 * w->strings_size : 4096;
+	while (w->len + len + 1 > n)
+	    n *= 2;
+	strings = realloc(w->strings, n);
+	if (!strings)
+	    return -1;
+	w->strings = strings;
+	w->strings_size = n;
+    }
+    memcpy(w->strings + w->len, s, len);
+    w->strings[w->len + len] = '\0';
+    *slot = w->len + 1;
+    w->len += len + 1;
+    w->n_strings++;
+    return *slot - 1;
+}
+
+struct archive_writer *archive_writer_new(int proc_interface)
+{
+    struct archive_writer *w = calloc(1, sizeof(struct archive_writer));
+
+    if (w)
+	w->proc_interface = proc_interface;
+    return w;
+}
+
+int archive_add_device(struct archive_writer *w, int device_nr, const char *name)
+{
+    struct wdevice *d;
+    long off;
+
+    if (w->n_devices == w->size) {
+	d = realloc(w->devices, (w->size ? 2 * w->size : 64) * sizeof(struct wdevice));
+	if (!d)
+	    goto nomem;
+	w->devices = d;
+	w->size = w->size ? 2 * w->size : 64;
+    }
+    off = intern(w, name, strlen(name));
+    if (off < 0)
+	goto nomem;
+    d = &w->devices[w->n_devices];
+    memset(d, 0, sizeof(*d));
+    d->device_nr = device_nr;
+    d->name = off;
+    return w->n_devices++;
+
+nomem:
+    w->failed = 1;
+    return -1;
+}
+
+int archive_add_value(struct archive_writer *w, int dev, int kind, const char *name, const char *value, size_t len)
+{
+    struct wdevice *d;
+    struct wvalue *v;
+    long name_off, value_off;
+
+    if (dev < 0)
+	return -1;
+    d = &w->devices[dev];
+    if (d->n == d->size) {
+	v = realloc(d->values, (d->size ? 2 * d->size : 16) * sizeof(struct wvalue));
+	if (!v)
+	    goto nomem;
+	d->values = v;
+	d->size = d->size ? 2 * d->size : 16;
+    }
+    name_off = intern(w, name, strlen(name));
+    value_off = intern(w, value, len);
+    if (name_off < 0 || value_off < 0)
+	goto nomem;
+    v = &d->values[d->n++];
+    v->kind = kind;
+    v->name = name_off;
+    v->value = value_off;
+    w->n_values++;
+    return 0;
+
+nomem:
+    w->failed = 1;
+    return -1;
+}
+
+int archive_write_fd(struct archive_writer *w, int fd, unsigned int classes)
+{
+    size_t strings = HEADER_SIZE + (size_t) w->n_devices * DEVICE_SIZE + (size_t) w->n_values * VALUE_SIZE;
+    size_t size = strings + w->len;
+    unsigned char *buf, *p;
+    ssize_t n;
+    size_t done;
+    int i, j, first = 0, err;
+
+    if (w->failed) {
+	errno = ENOMEM;
+	return -1;
+    }
+    if (size > UINT32_MAX) {
+	errno = EFBIG;
+	return -1;
+    }
+    buf = malloc(size);
+    if (!buf)
+	return -1;
+    memcpy(buf, ARCHIVE_MAGIC, MAGIC_LEN);
+    put_u32(buf + 8, w->proc_interface ? FLAG_PROC : 0);
+    put_u32(buf + 12, classes);
+    put_u32(buf + 16, w->n_devices);
+    put_u32(buf + 20, w->n_values);
+    put_u32(buf + 24, strings);
+    put_u32(buf + 28, 0);
+    p = buf + HEADER_SIZE;
+    for (i = 0; i < w->n_devices; i++, p += DEVICE_SIZE) {
+	put_u32(p, w->devices[i].device_nr);
+	put_u32(p + 4, w->devices[i].name);
+	put_u32(p + 8, first);
+	put_u32(p + 12, w->devices[i].n);
+	first += w->devices[i].n;
+    }
+    for (i = 0; i < w->n_devices; i++)
+	for (j = 0; j < w->devices[i].n; j++, p += VALUE_SIZE) {
+	    put_u32(p, w->devices[i].values[j].kind);
+	    put_u32(p + 4, w->devices[i].values[j].name);
+	    put_u32(p + 8, w->devices[i].values[j].value);
+	}
+    memcpy(p, w->strings, w->len);
+
+    for (done = 0; done < size; done += n) {
+	n = write(fd, buf + done, size - done);
+	if (n < 0 && errno == EINTR)
+	    n = 0;
+	else if (n < 0)
+	    break;
+    }
+    err = done < size ? errno : 0;
+    free(buf);
+    errno = err;
+    return err ? -1 : 0;
+}
+
+int archive_write(struct archive_writer *w, const char *path, unsigned int classes)
+{
+    int fd, err;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+	return -1;
+    err = archive_write_fd(w, fd, classes) < 0 ? errno : 0;
+    if (close(fd) < 0 && !err)
+	err = errno;
+    errno = err;
+    return err ? -1 : 0;
+}
+
+void archive_writer_free(struct archive_writer *w)
+{
+    int i;
+
+    if (!w)
+	return;
+    for (i = 0; i < w->n_devices; i++)
+	free(w->devices[i].values);
+    free(w->devices);
+    free(w->strings);
+    free(w->slots);
+    free(w);
+}
+
+/* every offset of the tables points into the strings, which end with a
+ * null, and the values of every device are in the table */
+static int archive_valid(struct archive *ar)
+{
+    size_t strings = get_u32(ar->map + 24);
+    size_t n_strings = ar->size - strings;
+    const unsigned char *p;
+    uint32_t i, first, n;
+
+    if (strings < HEADER_SIZE + (size_t) ar->n_devices * DEVICE_SIZE + (size_t) ar->n_values * VALUE_SIZE ||
+	strings >= ar->size || ar->map[ar->size - 1])
+	return 0;
+    p = ar->map + HEADER_SIZE;
+    for (i = 0; i < ar->n_devices; i++, p += DEVICE_SIZE) {
+	first = get_u32(p + 8);
+	n = get_u32(p + 12);
+	if (get_u32(p) >= DEVICE_CLASSES || get_u32(p + 4) >= n_strings || first > ar->n_values || n > ar->n_values - first)
+	    return 0;
+    }
+    for (i = 0; i < ar->n_values; i++, p += VALUE_SIZE)
+	if (get_u32(p + 4) >= n_strings || get_u32(p + 8) >= n_strings)
+	    return 0;
+    return 1;
+}
+
+struct archive *archive_map(int fd)
+{
+    struct archive *ar;
+    struct stat st;
+    void *map;
+
+    if (fstat(fd, &st) < 0)
+	return NULL;
+    if (!S_ISREG(st.st_mode) || st.st_size < HEADER_SIZE || st.st_size > UINT32_MAX) {
+	errno = EINVAL;
+	return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+	return NULL;
+    ar = malloc(sizeof(struct archive));
+    if (!ar) {
+	munmap(map, st.st_size);
+	errno = ENOMEM;
+	return NULL;
+    }
+    ar->map = map;
+    ar->size = st.st_size;
+    ar->flags = get_u32(ar->map + 8);
+    ar->classes = get_u32(ar->map + 12);
+    ar->n_devices = get_u32(ar->map + 16);
+    ar->n_values = get_u32(ar->map + 20);
+    ar->strings = (char *) ar->map + get_u32(ar->map + 24);
+    if (memcmp(map, ARCHIVE_MAGIC, MAGIC_LEN) || !archive_valid(ar)) {
+	archive_unmap(ar);
+	errno = EINVAL;
+	return NULL;
+    }
+    return ar;
+}
+
+int archive_proc(struct archive *ar)
+{
+    return (ar->flags & FLAG_PROC) != 0;
+}
+
+unsigned int archive_classes(struct archive *ar)
+{
+    return ar->classes;
+}
+
+int archive_devices(struct archive *ar)
+{
+    return ar->n_devices;
+}
+
+int archive_device(struct archive *ar, int i, int *device_nr, char **name)
+{
+    const unsigned char *p = ar->map + HEADER_SIZE + (size_t) i * DEVICE_SIZE;
+
+    *device_nr = get_u32(p);
+    *name = ar->strings + get_u32(p + 4);
+    return get_u32(p + 12);
+}
+
+void archive_value(struct archive *ar, int i, int j, int *kind, char **name, char **value)
+{
+    const unsigned char *d = ar->map + HEADER_SIZE + (size_t) i * DEVICE_SIZE;
+    const unsigned char *p = ar->map + HEADER_SIZE + (size_t) ar->n_devices * DEVICE_SIZE +
+	((size_t) get_u32(d + 8) + j) * VALUE_SIZE;
+
+    *kind = get_u32(p);
+    *name = ar->strings + get_u32(p + 4);
+    *value = ar->strings + get_u32(p + 8);
+}
+
+void archive_unmap(struct archive *ar)
+{
+    munmap(ar->map, ar->size);
+    free(ar);
+}
@@ -0,0 +1,88 @@
+/* snapshots of all devices in a single file
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <stddef.h>
+#include "prefix.h"
+
+/* the kinds of values, each is a null terminated string as it would be
+ * handed to the parser after splitting what was read */
+#define ARCHIVE_FILE	0	/* the first line of an attribute file */
+#define ARCHIVE_UEVENT	1	/* a property of a uevent file, without its prefix */
+#define ARCHIVE_LINE	2	/* a "name: value" line of a /proc file */
+
+/* a snapshot being taken */
+struct archive_writer;
+
+/* a snapshot file mapped for reading */
+struct archive;
+
+/* Post: returns NULL if there is no memory */
+struct archive_writer *archive_writer_new(int proc_interface);
+
+/* add a device of class device_nr
+ *
+ * Post: returns its number for archive_add_value, or -1 if there is no
+ *       memory, which archive_write reports
+ */
+int archive_add_device(struct archive_writer *w, int device_nr, const char *name);
+
+/* add a value of the len bytes at value to device dev, in the order the
+ * values are to be parsed; a dev of -1 is ignored
+ *
+ * Post: returns 0, or -1 if there is no memory, which archive_write reports
+ */
+int archive_add_value(struct archive_writer *w, int dev, int kind, const char *name, const char *value, size_t len);
+
+/* write the snapshot to path, classes are the bits of device_nr whose
+ * directory was there
+ *
+ * Post: returns 0, or -1 with errno set, ENOMEM if something could not
+ *       be added
+ */
+int archive_write(struct archive_writer *w, const char *path, unsigned int classes);
+
+/* archive_write to the empty file fd, which is left open */
+int archive_write_fd(struct archive_writer *w, int fd, unsigned int classes);
+
+void archive_writer_free(struct archive_writer *w);
+
+/* map a snapshot file, the values are read in place
+ *
+ * Post: returns NULL with errno set, EINVAL if fd is not a snapshot
+ */
+struct archive *archive_map(int fd);
+
+/* whether the snapshot was taken of the /proc interface */
+int archive_proc(struct archive *ar);
+
+/* the bits of device_nr whose directory was there */
+unsigned int archive_classes(struct archive *ar);
+
+int archive_devices(struct archive *ar);
+
+/* the class and name of device i, returns how many values it has */
+int archive_device(struct archive *ar, int i, int *device_nr, char **name);
+
+/* value j of device i, the strings point into the mapping */
+void archive_value(struct archive *ar, int i, int j, int *kind, char **name, char **value);
+
+void archive_unmap(struct archive *ar);
+
+#endif
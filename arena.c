@@ -0,0 +1,114 @@
+/* a simple arena allocator
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE	16384
+#define ARENA_ALIGN		16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    char *data;
+};
+
+static struct arena_chunk *arena_new_chunk(size_t size)/*{{{*/
+{
+    struct arena_chunk *c;
+
+    if (size < ARENA_CHUNK_SIZE)
+	size = ARENA_CHUNK_SIZE;
+    c = malloc(sizeof(struct arena_chunk) + size + ARENA_ALIGN);
+    if (!c)
+	return NULL;
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    /* first aligned address behind the header */
+    c->data = (char *) (((size_t) (c + 1) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1));
+    return c;
+}
+
+void *arena_alloc(struct arena *a, size_t size)/*{{{*/
+{
+    struct arena_chunk *c;
+    void *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    /* after a reset the chunks are walked again before new ones are made */
+    c = a->current;
+    while (c && c->used + size > c->size)
+	c = c->next;
+    if (!c) {
+	c = arena_new_chunk(size);
+	if (!c) {
+	    a->failed = 1;
+	    return NULL;
+	}
+	if (a->current) {
+	    c->next = a->current->next;
+	    a->current->next = c;
+	} else {
+	    c->next = a->chunks;
+	    a->chunks = c;
+	}
+    }
+    a->current = c;
+
+    p = c->data + c->used;
+    c->used += size;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n)/*{{{*/
+{
+    char *r;
+
+    r = arena_alloc(a, n + 1);
+    if (!r)
+	return NULL;
+    memcpy(r, s, n);
+    r[n] = '\0';
+    return r;
+}
+
+void arena_reset(struct arena *a)/*{{{*/
+{
+    struct arena_chunk *c;
+
+    for (c = a->chunks; c; c = c->next)
+	c->used = 0;
+    a->current = a->chunks;
+    a->failed = 0;
+}
+
+void arena_free(struct arena *a)/*{{{*/
+{
+    struct arena_chunk *c, *next;
+
+    for (c = a->chunks; c; c = next) {
+	next = c->next;
+	free(c);
+    }
+    a->chunks = NULL;
+    a->current = NULL;
+    a->failed = 0;
+}
@@ -0,0 +1,65 @@
+/* a simple arena allocator
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+#include "prefix.h"
+
+struct arena_chunk;
+
+/* all memory of one sample comes from an arena and is given back at once,
+ * a zero initialized arena is ready to use */
+struct arena {
+    struct arena_chunk *chunks;
+    struct arena_chunk *current;
+    int failed;		/* an allocation failed since the last reset */
+};
+
+/* allocate memory from an arena
+ *
+ * Pre: a != NULL
+ * Post: returns size bytes of suitably aligned memory, valid until the
+ *       next arena_reset or arena_free, or NULL with failed set if there is
+ *       no memory left
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/* copy the first n characters of a string into an arena
+ *
+ * Pre: a != NULL, s != NULL
+ * Post: returns a null terminated copy, or NULL like arena_alloc
+ */
+char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+/* give back all memory allocated from an arena, but keep it for reuse
+ *
+ * Pre: a != NULL
+ * Post: later allocations reuse the memory without calling malloc, failed
+ *       is cleared
+ */
+void arena_reset(struct arena *a);
+
+/* release the memory used by an arena
+ *
+ * Pre: a != NULL
+ * Post: the arena is empty and may be used again
+ */
+void arena_free(struct arena *a);
+
+#endif
@@ -0,0 +1,521 @@
+/* reading many small files at once
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "batch.h"
+#include "uring.h"
+#include "stats.h"
+
+/* Some sysfs attributes block for milliseconds while the kernel asks the
+ * firmware, so the reads of a batch are spread over a few threads, the
+ * calling one included, and a sample takes about as long as its slowest
+ * file. The threads only read, all parsing is left to the caller. */
+struct batch {
+    struct uring *ring;
+    struct stats *stats;	/* the reads are timed for, or NULL */
+    int want_threads;		/* to start for the first batch that needs them */
+    int started;
+    int n_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/* there are reads to take, or stop is set */
+    pthread_cond_t done;	/* all reads are finished */
+    struct file_read *reads;
+    int n;
+    int next;			/* the next read to take */
+    int finished;
+    int stop;
+    /* with a deadline, see batch_read_deadline */
+    int deadline_ms;
+    unsigned int generation;	/* of the reads being taken */
+    struct reader *readers;
+    int n_readers;		/* that are running */
+    int n_stuck;		/* of those, in a read the batch gave up on */
+    int refs;			/* the caller and the readers */
+};
+
+/* Without a deadline the threads read straight into the buffers of the
+ * caller, who waits for them. With one, a read that hangs, say on an
+ * embedded controller that does not answer, is given up on: the caller
+ * goes on and the reader, which cannot be interrupted, finishes the read
+ * some time later into a buffer of its own and drops what it read. Such a
+ * stuck reader is replaced, and a file it is still reading is not handed
+ * out again until it is back, so one hung file costs one thread. */
+struct reader {
+    struct batch *b;
+    unsigned int generation;	/* of the read it does, 0 if it has none */
+    int fd;			/* the open file it reads, or -1 */
+    char path[PATH_MAX];
+    char *buf;
+    size_t size;
+    struct reader *next;
+};
+
+#define MAX_READERS_PER_THREAD	4	/* stuck ones included */
+
+#ifdef INJECT_LATENCY
+/* Test backend: ACPI_INJECT_LATENCY="<file>=<ms>[:<after>][,...]" delays
+ * the reads of a file whose path ends in /<file>, or is <file>, by that
+ * many milliseconds once the first <after> of them are done, so that
+ * deadlines can be tried without slow hardware. The path of an open file
+ * is taken from /proc/self/fd. */
+#define MAX_INJECTED	16
+
+static struct injected {
+    char name[NAME_MAX + 1];
+    long ms;
+    long after;
+    long reads;
+} injected[MAX_INJECTED];
+static int n_injected;
+static pthread_once_t inject_once = PTHREAD_ONCE_INIT;
+
+static void inject_parse(void)
+{
+    char *spec = getenv("ACPI_INJECT_LATENCY"), *end;
+    size_t len;
+
+    while (spec && *spec && n_injected < MAX_INJECTED) {
+	len = strcspn(spec, "=,");
+	if (spec[len] != '=' || len > NAME_MAX)
+	    break;
+	memcpy(injected[n_injected].name, spec, len);
+	injected[n_injected].name[len] = '\0';
+	injected[n_injected].ms = strtol(spec + len + 1, &end, 10);
+	if (*end == ':')
+	    injected[n_injected].after = strtol(end + 1, &end, 10);
+	n_injected++;
+	spec = *end == ',' ? end + 1 : NULL;
+    }
+}
+
+static void inject_latency(struct file_read *r)
+{
+    char link[64], target[PATH_MAX];
+    const char *path = r->path;
+    struct timespec ts;
+    size_t len, name_len;
+    ssize_t n;
+    int i;
+
+    pthread_once(&inject_once, inject_parse);
+    if (!n_injected)
+	return;
+    if (!path) {
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", r->fd);
+	n = readlink(link, target, sizeof(target) - 1);
+	if (n < 0)
+	    return;
+	target[n] = '\0';
+	path = target;
+    }
+    len = strlen(path);
+    for (i = 0; i < n_injected; i++) {
+	name_len = strlen(injected[i].name);
+	if (name_len > len || strcmp(path + len - name_len, injected[i].name) ||
+	    (name_len < len && path[len - name_len - 1] != '/'))
+	    continue;
+	if (__atomic_fetch_add(&injected[i].reads, 1, __ATOMIC_RELAXED) < injected[i].after)
+	    return;
+	ts.tv_sec = injected[i].ms / 1000;
+	ts.tv_nsec = injected[i].ms % 1000 * 1000000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+	    ;
+	return;
+    }
+}
+#else
+#define inject_latency(r)	((void) 0)
+#endif
+
+/* read one file: an open file is read once like the watch mode always did,
+ * one opened for the batch is read until it is full or at its end */
+static void read_file(struct stats *st, struct file_read *r)
+{
+    size_t len = 0;
+    ssize_t n;
+    int fd = r->fd, syscalls = 1;
+    STATS_START(st, start);
+
+    inject_latency(r);
+    if (!r->path) {
+	n = pread(fd, r->buf, r->size - 1, 0);
+	r->result = n < 0 ? -errno : n;
+	if (n >= 0)
+	    r->buf[n] = '\0';
+	STATS_NOTE(st, r, start, syscalls);
+	return;
+    }
+
+    fd = openat(r->dir_fd, r->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	r->result = -errno;
+	STATS_NOTE(st, r, start, syscalls);
+	return;
+    }
+    while (len < r->size - 1) {
+	n = read(fd, r->buf + len, r->size - 1 - len);
+	syscalls++;
+	if (n <= 0)
+	    break;
+	len += n;
+    }
+    close(fd);
+    r->buf[len] = '\0';
+    r->result = len;
+    STATS_NOTE(st, r, start, syscalls + 1);
+}
+
+/* take reads until there are none left, called with the lock held */
+static void batch_work(struct batch *b)
+{
+    struct file_read *r;
+
+    while (b->next < b->n) {
+	r = &b->reads[b->next++];
+	pthread_mutex_unlock(&b->lock);
+	read_file(b->stats, r);
+	pthread_mutex_lock(&b->lock);
+	if (++b->finished == b->n)
+	    pthread_cond_signal(&b->done);
+    }
+}
+
+static void *batch_thread(void *arg)
+{
+    struct batch *b = arg;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+	while (!b->stop && b->next >= b->n)
+	    pthread_cond_wait(&b->work, &b->lock);
+	if (b->stop)
+	    break;
+	batch_work(b);
+    }
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+static void batch_free(struct batch *b)
+{
+    pthread_cond_destroy(&b->done);
+    pthread_cond_destroy(&b->work);
+    pthread_mutex_destroy(&b->lock);
+    uring_close(b->ring);
+    free(b->threads);
+    free(b);
+}
+
+/* take one read with the lock held and do it without, returns 0 if it was
+ * given up on in the meantime */
+static int reader_work(struct reader *me)
+{
+    struct batch *b = me->b;
+    struct file_read *r = &b->reads[b->next++];
+    struct file_read copy = *r;
+
+    if (r->result != -EINPROGRESS)
+	return 1;		/* its file is still read by a stuck reader */
+    if (me->size < r->size) {
+	free(me->buf);
+	me->buf = malloc(r->size);
+	me->size = me->buf ? r->size : 0;
+    }
+    if (!me->buf || (r->path && strlen(r->path) >= sizeof(me->path))) {
+	r->result = me->buf ? -ENAMETOOLONG : -ENOMEM;
+	if (++b->finished == b->n)
+	    pthread_cond_signal(&b->done);
+	return 1;
+    }
+    /* nothing of the caller is used once the lock is dropped */
+    if (r->path)
+	copy.path = strcpy(me->path, r->path);
+    copy.buf = me->buf;
+    me->generation = b->generation;
+    me->fd = r->path ? -1 : r->fd;
+    pthread_mutex_unlock(&b->lock);
+    read_file(b->stats, &copy);
+    pthread_mutex_lock(&b->lock);
+    if (me->generation != b->generation)
+	return 0;
+    if (copy.result >= 0)
+	memcpy(r->buf, copy.buf, copy.result + 1);
+    r->result = copy.result;
+#ifdef ENABLE_STATS
+    r->ns = copy.ns;
+    r->syscalls = copy.syscalls;
+#endif
+    me->generation = 0;
+    if (++b->finished == b->n)
+	pthread_cond_signal(&b->done);
+    return 1;
+}
+
+static void *reader_thread(void *arg)
+{
+    struct reader *me = arg, **p;
+    struct batch *b = me->b;
+    int last;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+	while (!b->stop && b->next >= b->n)
+	    pthread_cond_wait(&b->work, &b->lock);
+	if (b->stop)
+	    break;
+	if (reader_work(me))
+	    continue;
+	/* back from a read that was given up on, a replacement may have
+	 * taken our place */
+	me->generation = 0;
+	b->n_stuck--;
+	if (b->n_readers - b->n_stuck > b->n_threads)
+	    break;
+    }
+    for (p = &b->readers; *p != me; p = &(*p)->next)
+	;
+    *p = me->next;
+    b->n_readers--;
+    last = --b->refs == 0;
+    pthread_mutex_unlock(&b->lock);
+    free(me->buf);
+    free(me);
+    if (last)
+	batch_free(b);
+    return NULL;
+}
+
+/* start a reader, with the lock held unless the batch is being opened */
+static int reader_start(struct batch *b)
+{
+    struct reader *r = calloc(1, sizeof(struct reader));
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret = -1;
+
+    if (!r)
+	return -1;
+    r->b = b;
+    r->fd = -1;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, reader_thread, r) == 0) {
+	r->next = b->readers;
+	b->readers = r;
+	b->n_readers++;
+	b->refs++;
+	ret = 0;
+    } else {
+	free(r);
+    }
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+/* hand the reads to the readers and wait for them until the deadline;
+ * reads that are not done by then fail with ETIMEDOUT */
+static void batch_read_deadline(struct batch *b, struct file_read *reads, int n)
+{
+    struct reader *r;
+    struct timespec deadline;
+    int i;
+    STATS_START(b->stats, start);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += b->deadline_ms / 1000;
+    deadline.tv_nsec += b->deadline_ms % 1000 * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+	deadline.tv_sec++;
+	deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&b->lock);
+    if (++b->generation == 0)
+	b->generation = 1;
+    b->finished = 0;
+    for (i = 0; i < n; i++) {
+	reads[i].result = -EINPROGRESS;
+	for (r = b->readers; !reads[i].path && r; r = r->next)
+	    if (r->generation && r->fd == reads[i].fd) {
+		reads[i].result = -ETIMEDOUT;
+		STATS_NOTE(b->stats, &reads[i], start, 0);
+		b->finished++;
+		break;
+	    }
+    }
+    b->reads = reads;
+    b->n = n;
+    b->next = 0;
+    pthread_cond_broadcast(&b->work);
+    while (b->finished < b->n && b->n_readers > b->n_stuck &&
+	   pthread_cond_timedwait(&b->done, &b->lock, &deadline) != ETIMEDOUT)
+	;
+    if (b->finished < b->n) {
+	for (i = 0; i < n; i++)
+	    if (reads[i].result == -EINPROGRESS) {
+		reads[i].result = -ETIMEDOUT;
+		STATS_NOTE(b->stats, &reads[i], start, 0);
+	    }
+	for (r = b->readers; r; r = r->next)
+	    if (r->generation == b->generation)
+		b->n_stuck++;
+	/* the readers that are still at it drop what they read */
+	if (++b->generation == 0)
+	    b->generation = 1;
+	while (b->n_readers - b->n_stuck < b->n_threads &&
+	       b->n_readers < b->n_threads * MAX_READERS_PER_THREAD && reader_start(b) == 0)
+	    ;
+    }
+    b->reads = NULL;
+    b->n = b->next = 0;
+    pthread_mutex_unlock(&b->lock);
+}
+
+struct batch *batch_open(int threads, int use_io_uring, int deadline_ms, struct stats *st)
+{
+    struct batch *b;
+    pthread_condattr_t attr;
+
+    b = calloc(1, sizeof(struct batch));
+    if (!b)
+	return NULL;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->work, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&b->done, &attr);
+    pthread_condattr_destroy(&attr);
+    b->refs = 1;
+    b->stats = st;
+    b->want_threads = threads;
+    if (deadline_ms > 0) {
+	/* the caller only waits, and a ring cannot give up on a read */
+	b->deadline_ms = deadline_ms;
+	return b;
+    }
+    if (use_io_uring)
+	b->ring = uring_open();
+    return b;
+}
+
+/* start the threads of a batch, no other thread runs yet */
+static void batch_start(struct batch *b)
+{
+    int threads = b->want_threads;
+
+    b->started = 1;
+    if (b->deadline_ms) {
+	b->n_threads = threads;
+	while (b->n_readers < threads && reader_start(b) == 0)
+	    ;
+	if (b->n_readers)
+	    return;
+	/* without readers the caller reads them all and waits for each */
+	b->deadline_ms = 0;
+	b->n_threads = 0;
+	return;
+    }
+    if (threads > 1)
+	b->threads = malloc((threads - 1) * sizeof(pthread_t));
+    /* the calling thread is one of the readers, and the only one if there
+     * is no memory for the others */
+    while (b->threads && b->n_threads < threads - 1 &&
+	   pthread_create(&b->threads[b->n_threads], NULL, batch_thread, b) == 0)
+	b->n_threads++;
+}
+
+void batch_read(struct batch *b, struct file_read *reads, int n)
+{
+    int i;
+    STATS_START(batch_stats(b), start);
+
+    if (b && b->ring && uring_read(b->ring, reads, n) == 0) {
+	/* the ring reads them all at once, each took as long as the batch */
+	for (i = 0; i < n; i++)
+	    STATS_NOTE(b->stats, &reads[i], start, 0);
+	return;
+    }
+    /* a run that never reads more than one file at a time, or with a
+     * deadline none at all, does without threads */
+    if (b && !b->started && (b->deadline_ms ? n > 0 : n > 1))
+	batch_start(b);
+    if (b && b->deadline_ms) {
+	if (n)
+	    batch_read_deadline(b, reads, n);
+	return;
+    }
+    if (!b || !b->n_threads || n < 2) {
+	for (i = 0; i < n; i++)
+	    read_file(b ? b->stats : NULL, &reads[i]);
+	return;
+    }
+
+    pthread_mutex_lock(&b->lock);
+    b->reads = reads;
+    b->n = n;
+    b->next = 0;
+    b->finished = 0;
+    pthread_cond_broadcast(&b->work);
+    batch_work(b);
+    while (b->finished < b->n)
+	pthread_cond_wait(&b->done, &b->lock);
+    b->reads = NULL;
+    b->n = b->next = 0;
+    pthread_mutex_unlock(&b->lock);
+}
+
+int batch_deadline(struct batch *b)
+{
+    return b ? b->deadline_ms : 0;
+}
+
+struct stats *batch_stats(struct batch *b)
+{
+    return b ? b->stats : NULL;
+}
+
+void batch_close(struct batch *b)
+{
+    int i, last, detached;
+
+    if (!b)
+	return;
+    pthread_mutex_lock(&b->lock);
+    b->stop = 1;
+    pthread_cond_broadcast(&b->work);
+    detached = b->deadline_ms;
+    last = --b->refs == 0;
+    pthread_mutex_unlock(&b->lock);
+    if (detached) {
+	/* the readers are not waited for, the last one to go frees it */
+	if (last)
+	    batch_free(b);
+	return;
+    }
+    for (i = 0; i < b->n_threads; i++)
+	pthread_join(b->threads[i], NULL);
+    batch_free(b);
+}
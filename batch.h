@@ -0,0 +1,77 @@
+/* reading many small files at once
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stddef.h>
+#include "config.h"
+#include "prefix.h"
+
+/* one read of a batch, either of an open file or of a file that is opened
+ * for it and closed again */
+struct file_read {
+    int fd;			/* the file to read if path is NULL */
+    int dir_fd;			/* path is opened relative to it */
+    const char *path;
+    char *buf;
+    size_t size;
+    int result;			/* bytes read, or -errno */
+#ifdef ENABLE_STATS
+    long long ns;		/* how long the read took, with --stats */
+    int syscalls;
+#endif
+};
+
+struct batch;
+struct stats;
+
+/* set up the readers of a batch
+ *
+ * Post: returns a batch read by up to threads threads, by io_uring instead
+ *       if use_io_uring is set and the kernel supports it; NULL if there is
+ *       no memory left, which batch_read takes like any NULL batch. With a
+ *       deadline_ms above 0 threads threads read and batch_read gives up on
+ *       what they did not read within deadline_ms milliseconds. The threads
+ *       are started by the first batch_read that has use for them. Every
+ *       read is timed for st unless it is NULL.
+ */
+struct batch *batch_open(int threads, int use_io_uring, int deadline_ms, struct stats *st);
+
+/* read the start of a number of files
+ *
+ * Pre: reads has n entries, b is NULL or returned by batch_open
+ * Post: reads[i].buf holds a null terminated string of reads[i].result
+ *       bytes for every read that succeeded; a NULL batch reads the files
+ *       one after another in the calling thread; a read that missed the
+ *       deadline has a result of -ETIMEDOUT
+ */
+void batch_read(struct batch *b, struct file_read *reads, int n);
+
+/* the deadline_ms of batch_open, 0 for a NULL batch */
+int batch_deadline(struct batch *b);
+
+/* the st of batch_open, NULL for a NULL batch */
+struct stats *batch_stats(struct batch *b);
+
+/* stop the readers of a batch
+ *
+ * Pre: b is NULL or returned by batch_open
+ */
+void batch_close(struct batch *b);
+
+#endif
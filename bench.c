@@ -0,0 +1,380 @@
+/* benchmark of the collector on generated /sys/class and /proc/acpi trees
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* For every size N a tree with N batteries, N thermal zones of M trip
+ * points each and N cooling devices is written below a temporary directory
+ * in both layouts. The acpi program is run on it through -d, and the
+ * library refreshes a snapshot of it in a child process. A run is traced
+ * once with ptrace to count its syscalls; the peak RSS is that of the
+ * child. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "libacpi.h"
+
+#define DEFAULT_TRIPS		4
+#define DEFAULT_SECONDS		0.5
+#define MIN_RUNS		3
+#define MAX_RUNS		1000
+#define REFRESH_SAMPLES		10
+
+struct result {
+    double ns;			/* per sample */
+    double syscalls;		/* per sample */
+    long max_rss;		/* KiB */
+};
+
+static void fail(const char *what, const char *path)
+{
+    fprintf(stderr, "acpi-bench: %s %s: %s\n", what, path, strerror(errno));
+    exit(1);
+}
+
+static void make_dir(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+static void write_file(const char *contents, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void make_dir(const char *fmt, ...)
+{
+    char path[PATH_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(path, sizeof(path), fmt, ap);
+    va_end(ap);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+	fail("cannot create", path);
+}
+
+static void write_file(const char *contents, const char *fmt, ...)
+{
+    char path[PATH_MAX];
+    va_list ap;
+    int fd;
+
+    va_start(ap, fmt);
+    vsnprintf(path, sizeof(path), fmt, ap);
+    va_end(ap);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, contents, strlen(contents)) < 0 || close(fd) < 0)
+	fail("cannot write", path);
+}
+
+/* the sys layout, batteries and the adapter have uevent files like the
+ * kernel makes them */
+static void make_sys(const char *dir, int n, int trips)
+{
+    char buf[1024];
+    int i, j;
+
+    make_dir("%s/sys", dir);
+    make_dir("%s/sys/power_supply", dir);
+    make_dir("%s/sys/thermal", dir);
+    make_dir("%s/sys/power_supply/AC", dir);
+    write_file("POWER_SUPPLY_NAME=AC\nPOWER_SUPPLY_ONLINE=1\n", "%s/sys/power_supply/AC/uevent", dir);
+    write_file("1\n", "%s/sys/power_supply/AC/online", dir);
+    write_file("Mains\n", "%s/sys/power_supply/AC/type", dir);
+    for (i = 0; i < n; i++) {
+	make_dir("%s/sys/power_supply/BAT%d", dir, i);
+	snprintf(buf, sizeof(buf),
+		 "POWER_SUPPLY_NAME=BAT%d\nPOWER_SUPPLY_TYPE=Battery\nPOWER_SUPPLY_STATUS=Discharging\n"
+		 "POWER_SUPPLY_PRESENT=1\nPOWER_SUPPLY_VOLTAGE_NOW=%d\nPOWER_SUPPLY_CURRENT_NOW=%d\n"
+		 "POWER_SUPPLY_CHARGE_FULL_DESIGN=5000000\nPOWER_SUPPLY_CHARGE_FULL=4000000\n"
+		 "POWER_SUPPLY_CHARGE_NOW=%d\nPOWER_SUPPLY_CAPACITY=75\n",
+		 i, 12000000 - i % 1000, 1500000 + i % 1000, 3000000 - i % 1000);
+	write_file(buf, "%s/sys/power_supply/BAT%d/uevent", dir, i);
+	write_file("Battery\n", "%s/sys/power_supply/BAT%d/type", dir, i);
+	write_file("Discharging\n", "%s/sys/power_supply/BAT%d/status", dir, i);
+	write_file("3000000\n", "%s/sys/power_supply/BAT%d/charge_now", dir, i);
+	write_file("4000000\n", "%s/sys/power_supply/BAT%d/charge_full", dir, i);
+	write_file("5000000\n", "%s/sys/power_supply/BAT%d/charge_full_design", dir, i);
+	write_file("1500000\n", "%s/sys/power_supply/BAT%d/current_now", dir, i);
+	write_file("12000000\n", "%s/sys/power_supply/BAT%d/voltage_now", dir, i);
+    }
+    for (i = 0; i < n; i++) {
+	make_dir("%s/sys/thermal/thermal_zone%d", dir, i);
+	write_file("acpitz\n", "%s/sys/thermal/thermal_zone%d/type", dir, i);
+	snprintf(buf, sizeof(buf), "%d\n", 40000 + i % 20000);
+	write_file(buf, "%s/sys/thermal/thermal_zone%d/temp", dir, i);
+	for (j = 0; j < trips; j++) {
+	    write_file(j ? "passive\n" : "critical\n", "%s/sys/thermal/thermal_zone%d/trip_point_%d_type", dir, i, j);
+	    snprintf(buf, sizeof(buf), "%d\n", 100000 - j * 5000);
+	    write_file(buf, "%s/sys/thermal/thermal_zone%d/trip_point_%d_temp", dir, i, j);
+	}
+	make_dir("%s/sys/thermal/cooling_device%d", dir, i);
+	write_file("Processor\n", "%s/sys/thermal/cooling_device%d/type", dir, i);
+	write_file("0\n", "%s/sys/thermal/cooling_device%d/cur_state", dir, i);
+	write_file("10\n", "%s/sys/thermal/cooling_device%d/max_state", dir, i);
+    }
+}
+
+static void make_proc(const char *dir, int n)
+{
+    int i;
+
+    make_dir("%s/proc", dir);
+    make_dir("%s/proc/battery", dir);
+    make_dir("%s/proc/ac_adapter", dir);
+    make_dir("%s/proc/thermal_zone", dir);
+    make_dir("%s/proc/fan", dir);
+    make_dir("%s/proc/ac_adapter/AC", dir);
+    write_file("state:                   on-line\n", "%s/proc/ac_adapter/AC/state", dir);
+    for (i = 0; i < n; i++) {
+	make_dir("%s/proc/battery/BAT%d", dir, i);
+	write_file("present:                 yes\ncapacity state:          ok\n"
+		   "charging state:          discharging\npresent rate:            1000 mA\n"
+		   "remaining capacity:      2000 mAh\npresent voltage:         12000 mV\n",
+		   "%s/proc/battery/BAT%d/state", dir, i);
+	write_file("present:                 yes\ndesign capacity:         5000 mAh\n"
+		   "last full capacity:      4000 mAh\n", "%s/proc/battery/BAT%d/info", dir, i);
+	make_dir("%s/proc/thermal_zone/THM%d", dir, i);
+	write_file("temperature:             50 C\n", "%s/proc/thermal_zone/THM%d/temperature", dir, i);
+	write_file("state:                   ok\n", "%s/proc/thermal_zone/THM%d/state", dir, i);
+	make_dir("%s/proc/fan/FAN%d", dir, i);
+	write_file("status:                  on\n", "%s/proc/fan/FAN%d/state", dir, i);
+    }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    return remove(path);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* follow a child and the threads it starts to the end, counting the
+ * syscalls they make; every syscall stops on entry and on exit */
+static long trace(pid_t pid)
+{
+    long stops = 0;
+    int status, sig, first = 1;
+    pid_t p;
+
+    while ((p = waitpid(-1, &status, __WALL)) > 0) {
+	if (WIFEXITED(status) || WIFSIGNALED(status))
+	    continue;
+	sig = 0;
+	if (first && p == pid) {
+	    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+	    first = 0;
+	} else if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+	    stops++;
+	} else if (status >> 16 == 0 && WSTOPSIG(status) != SIGSTOP && WSTOPSIG(status) != SIGTRAP) {
+	    sig = WSTOPSIG(status);
+	}
+	ptrace(PTRACE_SYSCALL, p, 0, sig);
+    }
+    return (stops + 1) / 2;
+}
+
+/* run acpi with args on a tree, traced or timed */
+static long run_acpi(char *acpi, char **args, int traced, long *max_rss)
+{
+    struct rusage ru;
+    pid_t pid;
+    long syscalls = 0;
+    int status, fd;
+
+    pid = fork();
+    if (pid < 0)
+	fail("cannot fork", acpi);
+    if (pid == 0) {
+	fd = open("/dev/null", O_WRONLY);
+	dup2(fd, 1);
+	dup2(fd, 2);
+	if (traced)
+	    ptrace(PTRACE_TRACEME, 0, 0, 0);
+	execv(acpi, args);
+	_exit(127);
+    }
+    if (traced)
+	syscalls = trace(pid);
+    if (wait4(pid, &status, 0, &ru) == pid && ru.ru_maxrss > *max_rss)
+	*max_rss = ru.ru_maxrss;
+    return syscalls;
+}
+
+static void bench_acpi(char *acpi, char *root, int proc, double seconds, struct result *r)
+{
+    char *args[] = { acpi, proc ? "-Vp" : "-V", "-d", root, NULL };
+    double start, elapsed;
+    int runs = 0;
+
+    memset(r, 0, sizeof(*r));
+    r->syscalls = run_acpi(acpi, args, 1, &r->max_rss);
+    start = now_ns();
+    do {
+	run_acpi(acpi, args, 0, &r->max_rss);
+	runs++;
+	elapsed = now_ns() - start;
+    } while (runs < MAX_RUNS && (runs < MIN_RUNS || elapsed < seconds * 1e9));
+    r->ns = elapsed / runs;
+}
+
+/* a child refreshes a snapshot samples times after the first one and
+ * sends how long that took */
+static double refresh_child(char *root, int samples, int traced, long *syscalls, long *max_rss)
+{
+    struct acpi *h;
+    struct rusage ru;
+    double start, ns = 0;
+    int pfd[2], i, status;
+    pid_t pid;
+
+    if (pipe(pfd) < 0)
+	fail("cannot create a pipe for", root);
+    pid = fork();
+    if (pid < 0)
+	fail("cannot fork for", root);
+    if (pid == 0) {
+	close(pfd[0]);
+	if (traced) {
+	    ptrace(PTRACE_TRACEME, 0, 0, 0);
+	    raise(SIGSTOP);
+	}
+	h = acpi_open(root, 0);
+	if (!h)
+	    _exit(1);
+	acpi_snapshot_refresh(h);
+	start = now_ns();
+	for (i = 0; i < samples; i++)
+	    acpi_snapshot_refresh(h);
+	ns = now_ns() - start;
+	if (write(pfd[1], &ns, sizeof(ns)) < 0)
+	    _exit(1);
+	acpi_close(h);
+	_exit(0);
+    }
+    close(pfd[1]);
+    *syscalls = traced ? trace(pid) : 0;
+    if (read(pfd[0], &ns, sizeof(ns)) != sizeof(ns))
+	ns = 0;
+    close(pfd[0]);
+    if (wait4(pid, &status, 0, &ru) == pid && ru.ru_maxrss > *max_rss)
+	*max_rss = ru.ru_maxrss;
+    return ns;
+}
+
+static void bench_refresh(char *root, double seconds, struct result *r)
+{
+    long one, more;
+    int samples;
+    double ns;
+
+    memset(r, 0, sizeof(*r));
+    /* what opening and the first sample cost cancels out */
+    refresh_child(root, 0, 1, &one, &r->max_rss);
+    refresh_child(root, REFRESH_SAMPLES, 1, &more, &r->max_rss);
+    r->syscalls = (double) (more - one) / REFRESH_SAMPLES;
+
+    ns = refresh_child(root, REFRESH_SAMPLES, 0, &one, &r->max_rss) / REFRESH_SAMPLES;
+    samples = ns > 0 ? seconds * 1e9 / ns : MAX_RUNS;
+    if (samples < MIN_RUNS)
+	samples = MIN_RUNS;
+    if (samples > MAX_RUNS)
+	samples = MAX_RUNS;
+    r->ns = refresh_child(root, samples, 0, &one, &r->max_rss) / samples;
+}
+
+static void print_result(int n, char *mode, struct result *r)
+{
+    printf("%8d  %-12s %14.0f %16.1f %14ld\n", n, mode, r->ns, r->syscalls, r->max_rss);
+    fflush(stdout);
+}
+
+static int usage(void)
+{
+    fprintf(stderr,
+"Usage: acpi-bench [-m <trips>] [-s <secs>] <acpi> [<n>]...\n"
+"Runs <acpi> on generated trees of <n> batteries, thermal zones with <trips>\n"
+"trip points, and cooling devices, and reports the time, syscalls and peak\n"
+"RSS per sample; each measurement takes about <secs> seconds.\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static int default_sizes[] = { 1, 10, 100, 1000, 10000 };
+    char dir[PATH_MAX], root[PATH_MAX], *acpi, *tmp;
+    double seconds = DEFAULT_SECONDS;
+    int trips = DEFAULT_TRIPS;
+    int ch, i, n, n_sizes;
+    struct result r;
+
+    while ((ch = getopt(argc, argv, "m:s:h")) != -1) {
+	switch (ch) {
+	case 'm':
+	    trips = atoi(optarg);
+	    break;
+	case 's':
+	    seconds = strtod(optarg, NULL);
+	    break;
+	default:
+	    return usage();
+	}
+    }
+    if (optind >= argc || trips < 0 || seconds <= 0)
+	return usage();
+    acpi = argv[optind++];
+    n_sizes = argc - optind;
+    if (!n_sizes)
+	n_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+    printf("%8s  %-12s %14s %16s %14s\n", "N", "mode", "ns/sample", "syscalls/sample", "peak RSS KiB");
+    for (i = 0; i < n_sizes; i++) {
+	n = optind < argc ? atoi(argv[optind + i]) : default_sizes[i];
+	tmp = getenv("TMPDIR");
+	snprintf(dir, sizeof(dir), "%s/acpi-bench.XXXXXX", tmp ? tmp : "/tmp");
+	if (!mkdtemp(dir))
+	    fail("cannot create", dir);
+	make_sys(dir, n, trips);
+	make_proc(dir, n);
+
+	snprintf(root, sizeof(root), "%s/sys", dir);
+	bench_acpi(acpi, root, 0, seconds, &r);
+	print_result(n, "sys", &r);
+	snprintf(root, sizeof(root), "%s/proc", dir);
+	bench_acpi(acpi, root, 1, seconds, &r);
+	print_result(n, "proc", &r);
+	snprintf(root, sizeof(root), "%s/sys", dir);
+	bench_refresh(root, seconds, &r);
+	print_result(n, "sys refresh", &r);
+
+	nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return 0;
+}
@@ -0,0 +1,344 @@
+/* a daemon keeping snapshots for the acpi commands run meanwhile
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A command sends the interface and path it would read as a line, and the
+ * collector answers with a byte carrying a descriptor of its last snapshot
+ * file, or closes the connection. Both send the canonical path, so any
+ * spelling of the same tree matches. Each snapshot is a new sealed file, so
+ * a command keeps reading the one it got while the next is taken, and
+ * parses it like a snapshot taken with --snapshot; a file that is not
+ * sealed could shrink under its mapping and is not taken. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "acpi.h"
+#include "collector.h"
+
+#define COLLECTOR_BACKLOG	64
+#define REQUEST_SIZE		(PATH_MAX + 3)
+/* the collector answers one command at a time, one that does not ask at
+ * once is dropped */
+#define REQUEST_TIMEOUT_MS	100
+/* a command reads the devices itself after this */
+#define ANSWER_TIMEOUT_MS	1000
+
+struct collector {
+    int fd;
+    char *path;			/* of the socket, removed on close */
+    char *acpi_path;
+    int proc_interface;
+    int snapshot;		/* the last snapshot file, -1 until the first */
+};
+
+#ifdef HAVE_MEMFD_CREATE
+/* the seals a snapshot has before it is handed out */
+#define SNAPSHOT_SEALS		(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+#endif
+
+/* the line a command sends, which the collector answers if it is its own */
+static int request_line(char *buf, size_t size, const char *acpi_path, int proc_interface)
+{
+    int len = snprintf(buf, size, "%d %s\n", proc_interface ? 1 : 0, acpi_path);
+
+    if (len < 0 || (size_t) len >= size) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    return len;
+}
+
+static int socket_address(struct sockaddr_un *sun, const char *path)
+{
+    if (strlen(path) >= sizeof(sun->sun_path)) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, path);
+    return 0;
+}
+
+/* a socket left behind by an earlier run is replaced, one that a collector
+ * still answers on is not and -2 is returned */
+static int listen_socket(struct collector *c, char *path)
+{
+    struct sockaddr_un sun;
+    struct stat st;
+    int fd;
+
+    if (socket_address(&sun, path) < 0)
+	return -1;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr *) &sun, sizeof(sun)) == 0) {
+	    close(fd);
+	    return -2;
+	}
+	if (fd >= 0)
+	    close(fd);
+	unlink(path);
+    }
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (c->fd < 0)
+	return -1;
+    if (bind(c->fd, (struct sockaddr *) &sun, sizeof(sun)) < 0)
+	return -1;
+    c->path = strdup(path);
+    if (!c->path) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in collector_open.\n");
+	exit(1);
+    }
+    /* the values are readable by everyone in /sys anyway */
+    chmod(path, 0666);
+    return listen(c->fd, COLLECTOR_BACKLOG);
+}
+
+struct collector *collector_open(char *path, char *acpi_path, int proc_interface)
+{
+    struct collector *c;
+    int ret;
+
+    c = calloc(1, sizeof(struct collector));
+    if (!c) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in collector_open.\n");
+	exit(1);
+    }
+    c->fd = c->snapshot = -1;
+    c->proc_interface = proc_interface;
+#ifndef HAVE_MEMFD_CREATE
+    fprintf(stderr, "Snapshots cannot be sealed on this system, so there is no collector.\n");
+    collector_close(c);
+    return NULL;
+#endif
+    c->acpi_path = realpath(acpi_path, NULL);
+    if (!c->acpi_path) {
+	if (errno == ENOMEM) {
+	    fprintf(stderr, "Out of memory. Could not allocate memory in collector_open.\n");
+	    exit(1);
+	}
+	fprintf(stderr, "Could not collect %s: %s\n", acpi_path, strerror(errno));
+	collector_close(c);
+	return NULL;
+    }
+    ret = listen_socket(c, path);
+    if (ret == 0)
+	return c;
+    if (ret == -2)
+	fprintf(stderr, "A collector is running on %s already.\n", path);
+    else
+	fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+    collector_close(c);
+    return NULL;
+}
+
+/* an unnamed file that can be sealed once written */
+static int snapshot_file(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+    return memfd_create("acpi-snapshot", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int seal(int fd)
+{
+#ifdef HAVE_MEMFD_CREATE
+    return fcntl(fd, F_ADD_SEALS, SNAPSHOT_SEALS);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int sealed(int fd)
+{
+#ifdef HAVE_MEMFD_CREATE
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    return seals >= 0 && (seals & SNAPSHOT_SEALS) == SNAPSHOT_SEALS;
+#else
+    return FALSE;
+#endif
+}
+
+int collector_update(struct collector *c, struct batch *b)
+{
+    int fd, err;
+
+    fd = snapshot_file();
+    if (fd < 0)
+	return -1;
+    if (snapshot_capture_fd(c->acpi_path, c->proc_interface, b, fd) < 0 || seal(fd) < 0) {
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+    }
+    if (c->snapshot >= 0)
+	close(c->snapshot);
+    c->snapshot = fd;
+    return 0;
+}
+
+int collector_fd(struct collector *c)
+{
+    return c->fd;
+}
+
+/* the request is read in full before it is compared */
+static int read_request(int fd, char *request)
+{
+    struct pollfd pfd;
+    size_t len = 0;
+    ssize_t n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (len < REQUEST_SIZE) {
+	n = read(fd, request + len, REQUEST_SIZE - len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && errno == EAGAIN) {
+	    if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) <= 0)
+		return -1;
+	    continue;
+	}
+	if (n <= 0)
+	    return -1;
+	len += n;
+	if (request[len - 1] == '\n')
+	    return len;
+    }
+    return -1;
+}
+
+void collector_answer(struct collector *c)
+{
+    char request[REQUEST_SIZE], own[REQUEST_SIZE];
+    char control[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int fd, len;
+
+    fd = accept4(c->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+	return;
+    len = read_request(fd, request);
+    if (c->snapshot < 0 || len < 0 || request_line(own, sizeof(own), c->acpi_path, c->proc_interface) != len ||
+	memcmp(request, own, len)) {
+	close(fd);
+	return;
+    }
+
+    iov.iov_base = "\n";
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &c->snapshot, sizeof(int));
+    while (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+	;
+    close(fd);
+}
+
+void collector_close(struct collector *c)
+{
+    if (!c)
+	return;
+    if (c->fd >= 0)
+	close(c->fd);
+    if (c->path)
+	unlink(c->path);
+    if (c->snapshot >= 0)
+	close(c->snapshot);
+    free(c->path);
+    free(c->acpi_path);
+    free(c);
+}
+
+int collector_query(const char *path, const char *acpi_path, int proc_interface)
+{
+    struct timeval timeout = { ANSWER_TIMEOUT_MS / 1000, ANSWER_TIMEOUT_MS % 1000 * 1000 };
+    char request[REQUEST_SIZE], canonical[PATH_MAX], byte;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct sockaddr_un sun;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int fd, snapshot = -1, len;
+    ssize_t n;
+
+    if (!realpath(acpi_path, canonical))
+	return -1;
+    len = request_line(request, sizeof(request), canonical, proc_interface);
+    if (len < 0 || socket_address(&sun, path) < 0)
+	return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+	return -1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0 || send(fd, request, len, MSG_NOSIGNAL) != len) {
+	close(fd);
+	return -1;
+    }
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    while ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+	;
+    if (n == 1 && !(msg.msg_flags & MSG_CTRUNC))
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+		cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+		memcpy(&snapshot, CMSG_DATA(cmsg), sizeof(int));
+    close(fd);
+    if (snapshot >= 0 && !sealed(snapshot)) {
+	close(snapshot);
+	return -1;
+    }
+    return snapshot;
+}
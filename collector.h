@@ -0,0 +1,62 @@
+/* a daemon keeping snapshots for the acpi commands run meanwhile
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _COLLECTOR_H
+#define _COLLECTOR_H
+
+/* where acpi looks for a collector unless ACPI_COLLECTOR names another
+ * socket, or is empty for none */
+#define COLLECTOR_SOCKET	"/run/acpi.sock"
+
+struct batch;
+struct collector;
+
+/* listen on the unix socket path for the commands reading acpi_path
+ *
+ * Post: returns NULL with a message printed if path cannot be used
+ */
+struct collector *collector_open(char *path, char *acpi_path, int proc_interface);
+
+/* take a snapshot of acpi_path with batch b, which the commands asking
+ * afterwards get; the last one is kept if this fails
+ *
+ * Post: returns 0, or -1 with errno set
+ */
+int collector_update(struct collector *c, struct batch *b);
+
+/* the socket to poll for commands asking */
+int collector_fd(struct collector *c);
+
+/* answer a command that is asking, without waiting for one */
+void collector_answer(struct collector *c);
+
+/* stop listening and remove the socket
+ *
+ * Pre: c is NULL or returned by collector_open
+ */
+void collector_close(struct collector *c);
+
+/* ask the collector on the socket path for its last snapshot of acpi_path,
+ * to be read with find_snapshot
+ *
+ * Post: returns a descriptor of it, or -1 if there is no collector, it
+ *       reads another tree, has nothing yet or sent a file that is not
+ *       sealed against writes and shrinking
+ */
+int collector_query(const char *path, const char *acpi_path, int proc_interface);
+
+#endif
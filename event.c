@@ -0,0 +1,124 @@
+/* kernel uevents about power supplies and thermal devices
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "acpi.h"
+#include "event.h"
+
+#define EVENT_BUF_SIZE	8192
+
+int event_open(void)
+{
+    struct sockaddr_nl addr;
+    int fd, err;
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0)
+	return -1;
+    /* group 1 has the events of the kernel, not those udev passes on */
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+    }
+    return fd;
+}
+
+/* an event is "ACTION@DEVPATH" followed by KEY=value strings, all of them
+ * null terminated */
+static unsigned int event_parse(char *buf, size_t len, unsigned int *changed)
+{
+    char *p, *end = buf + len;
+    char *action = NULL, *subsystem = NULL;
+    unsigned int classes = 0;
+    int i;
+
+    for (p = buf; p < end; p += strlen(p) + 1) {
+	if (!strncmp(p, "ACTION=", 7))
+	    action = p + 7;
+	else if (!strncmp(p, "SUBSYSTEM=", 10))
+	    subsystem = p + 10;
+    }
+    if (!subsystem)
+	return 0;
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	if (!strcmp(subsystem, device[i].sys))
+	    classes |= 1 << i;
+    if (action && (!strcmp(action, "add") || !strcmp(action, "remove")))
+	*changed |= classes;
+    return classes;
+}
+
+/* whether a read of nothing means the peer closed its end, not an empty
+ * datagram */
+static int connected(int fd)
+{
+    int type;
+    socklen_t len = sizeof(type);
+
+    return !getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) && (type == SOCK_STREAM || type == SOCK_SEQPACKET);
+}
+
+unsigned int event_read(int fd, unsigned int *changed, int *closed)
+{
+    char buf[EVENT_BUF_SIZE];
+    struct sockaddr_nl addr;
+    struct iovec iov;
+    struct msghdr msg;
+    unsigned int classes = 0;
+    ssize_t n;
+
+    for (;;) {
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf) - 1;
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof(addr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	n = recvmsg(fd, &msg, 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	/* the kernel dropped events, any device may have come or gone */
+	if (n < 0 && errno == ENOBUFS) {
+	    classes |= ALL_CLASSES;
+	    *changed |= ALL_CLASSES;
+	    continue;
+	}
+	if (n == 0 && connected(fd)) {
+	    *closed = TRUE;
+	    break;
+	}
+	if (n <= 0)
+	    break;
+	/* on netlink, only believe the kernel */
+	if (msg.msg_namelen >= sizeof(addr) && addr.nl_family == AF_NETLINK && addr.nl_pid != 0)
+	    continue;
+	buf[n] = '\0';
+	classes |= event_parse(buf, n, changed);
+    }
+    return classes;
+}
@@ -0,0 +1,40 @@
+/* kernel uevents about power supplies and thermal devices
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EVENT_H
+#define _EVENT_H
+
+/* subscribe to the uevents the kernel sends
+ *
+ * Post: returns a non-blocking descriptor, or -1 with errno set
+ */
+int event_open(void);
+
+/* read the uevents waiting on a descriptor, either the netlink socket of
+ * event_open or a datagram socket that gets the same messages from a
+ * stand-in, like a test that injects them
+ *
+ * Pre: fd is non-blocking
+ * Post: returns the classes the events concern as bits of device_nr,
+ *       the classes that gained or lost a device are also set in *changed,
+ *       all of them if the socket overflowed and events were lost;
+ *       *closed is set to TRUE if the stand-in closed a stream or seqpacket
+ *       socket
+ */
+unsigned int event_read(int fd, unsigned int *changed, int *closed);
+
+#endif
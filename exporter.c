@@ -0,0 +1,714 @@
+/* serving the last sample in the OpenMetrics text format
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include "acpi.h"
+#include "output.h"
+#include "exporter.h"
+
+#define EXPORTER_HOST		"127.0.0.1"
+#define EXPORTER_BACKLOG	16
+#define EXPORTER_CLIENTS	32	/* served at the same time */
+#define REQUEST_SIZE		4096
+#define REQUEST_TIMEOUT_MS	1000	/* how long a client may stall */
+#define HEADER_SIZE		256
+
+#define CONTENT_TYPE	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* a rendered sample, it is never changed once published and freed by the
+ * last one to drop it */
+struct snapshot {
+    int refs;
+    size_t len;
+    char data[];
+};
+
+/* a connection, first reading its request and then sending the response */
+struct client {
+    int fd;			/* -1 if the slot is free */
+    long long deadline_ms;	/* moved on whenever the client keeps up */
+    size_t len;			/* of the request read so far */
+    char request[REQUEST_SIZE + 1];
+    struct snapshot *snap;	/* held while the body is sent */
+    struct iovec iov[2];	/* the rest of the response, header and body */
+    int responding;
+    char header[HEADER_SIZE];
+};
+
+struct exporter {
+    int fd;
+    int wake[2];		/* written to by exporter_close */
+    char *path;			/* of a unix socket, removed on close */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    struct snapshot *current;	/* NULL until the first sample */
+    struct outbuf buf;		/* rendering of the next snapshot */
+    struct client *clients;	/* EXPORTER_CLIENTS of them */
+};
+
+/* the battery values in micro units, with their metric families */
+static struct battery_metric {
+    int id;
+    size_t offset;
+    char *name;
+    char *unit;
+    char *help;
+} battery_metrics[] = {
+    { ATTR_CURRENT_NOW, offsetof(struct battery_info, current_now),
+      "acpi_battery_current_amperes", "amperes", "Current drawn or taken by the battery." },
+    { ATTR_POWER_NOW, offsetof(struct battery_info, power_now),
+      "acpi_battery_power_watts", "watts", "Power drawn or taken by the battery." },
+    { ATTR_VOLTAGE_NOW, offsetof(struct battery_info, voltage_now),
+      "acpi_battery_voltage_volts", "volts", "Voltage of the battery." },
+    { ATTR_CHARGE_NOW, offsetof(struct battery_info, charge_now),
+      "acpi_battery_charge_now_ampere_hours", "ampere_hours", "Remaining charge." },
+    { ATTR_CHARGE_FULL, offsetof(struct battery_info, charge_full),
+      "acpi_battery_charge_full_ampere_hours", "ampere_hours", "Charge when last full." },
+    { ATTR_CHARGE_FULL_DESIGN, offsetof(struct battery_info, charge_full_design),
+      "acpi_battery_charge_full_design_ampere_hours", "ampere_hours", "Design charge." },
+    { ATTR_ENERGY_NOW, offsetof(struct battery_info, energy_now),
+      "acpi_battery_energy_now_watt_hours", "watt_hours", "Remaining energy." },
+    { ATTR_ENERGY_FULL, offsetof(struct battery_info, energy_full),
+      "acpi_battery_energy_full_watt_hours", "watt_hours", "Energy when last full." },
+    { ATTR_ENERGY_FULL_DESIGN, offsetof(struct battery_info, energy_full_design),
+      "acpi_battery_energy_full_design_watt_hours", "watt_hours", "Design energy." },
+    { 0, 0, NULL, NULL, NULL }
+};
+
+static void family(struct outbuf *ob, char *name, char *type, char *unit, char *help)
+{
+    out_printf(ob, "# TYPE %s %s\n", name, type);
+    if (unit)
+	out_printf(ob, "# UNIT %s %s\n", name, unit);
+    out_printf(ob, "# HELP %s %s\n", name, help);
+}
+
+/* the first label is the number of the device */
+static void sample_start(struct outbuf *ob, char *name, char *key, int index)
+{
+    out_printf(ob, "%s{%s=\"%d\"", name, key, index);
+}
+
+static void label(struct outbuf *ob, char *key, char *value)
+{
+    if (!value)
+	return;
+    out_printf(ob, ",%s=\"", key);
+    for (; *value; value++) {
+	if (*value == '\\' || *value == '"')
+	    out_printf(ob, "\\%c", *value);
+	else if (*value == '\n')
+	    out_printf(ob, "\\n");
+	else
+	    out_printf(ob, "%c", *value);
+    }
+    out_printf(ob, "\"");
+}
+
+/* a value in micro units, in the base unit without trailing zeros */
+static void sample_micro(struct outbuf *ob, long long value)
+{
+    long long frac;
+    int digits = 6;
+
+    out_printf(ob, " %s%lld", value < 0 ? "-" : "", (value < 0 ? -value : value) / 1000000);
+    frac = (value < 0 ? -value : value) % 1000000;
+    if (frac) {
+	while (frac % 10 == 0) {
+	    frac /= 10;
+	    digits--;
+	}
+	out_printf(ob, ".%0*lld", digits, frac);
+    }
+    out_printf(ob, "\n");
+}
+
+static long long micro_degrees(float temperature)
+{
+    double t = (double) temperature * 1000;
+
+    return (t < 0 ? -(long long) (0.5 - t) : (long long) (t + 0.5)) * 1000;
+}
+
+static void render_batteries(struct outbuf *ob, struct sample *s)
+{
+    struct battery_metric *m;
+    struct battery_info *b;
+    int i, n;
+
+    family(ob, "acpi_battery", "info", NULL, "State and type of the battery.");
+    for (i = 0; i < s->n_batteries; i++) {
+	b = &s->batteries[i];
+	sample_start(ob, "acpi_battery_info", "battery", i);
+	label(ob, "state", b->state);
+	label(ob, "type", b->type);
+	out_printf(ob, "} 1\n");
+    }
+    for (m = battery_metrics; m->name; m++) {
+	for (i = n = 0; i < s->n_batteries; i++) {
+	    b = &s->batteries[i];
+	    if (!HAS_ATTR(b, m->id))
+		continue;
+	    if (!n++)
+		family(ob, m->name, "gauge", m->unit, m->help);
+	    sample_start(ob, m->name, "battery", i);
+	    out_printf(ob, "}");
+	    sample_micro(ob, *(long *) ((char *) b + m->offset));
+	}
+    }
+}
+
+static void render_adapters(struct outbuf *ob, struct sample *s)
+{
+    struct adapter_info *ac;
+    int i, online;
+
+    family(ob, "acpi_ac_adapter_online", "gauge", NULL, "Whether the adapter is on-line.");
+    for (i = 0; i < s->n_adapters; i++) {
+	ac = &s->adapters[i];
+	if (HAS_ATTR(ac, ATTR_ONLINE))
+	    online = ac->online;
+	else if (ac->state)
+	    online = !strcmp(ac->state, "on-line");
+	else
+	    continue;
+	sample_start(ob, "acpi_ac_adapter_online", "adapter", i);
+	label(ob, "type", ac->type);
+	out_printf(ob, "} %d\n", online);
+    }
+}
+
+static void render_zones(struct outbuf *ob, struct sample *s)
+{
+    struct thermal_info *z;
+    struct trip_point *t;
+    char index[16];
+    int i, j;
+
+    family(ob, "acpi_thermal_zone_temperature_celsius", "gauge", "celsius", "Temperature of the zone.");
+    for (i = 0; i < s->n_zones; i++) {
+	z = &s->zones[i];
+	if (!(z->have & (ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE))))
+	    continue;
+	sample_start(ob, "acpi_thermal_zone_temperature_celsius", "zone", i);
+	label(ob, "type", z->type);
+	out_printf(ob, "}");
+	sample_micro(ob, micro_degrees(z->temperature));
+    }
+    family(ob, "acpi_thermal_zone_trip_point_celsius", "gauge", "celsius", "Temperature of a trip point.");
+    for (i = 0; i < s->n_zones; i++) {
+	z = &s->zones[i];
+	for (j = 0; j < z->n_trip; j++) {
+	    t = &z->trip[j];
+	    if (!t->type && !t->temp)
+		continue;
+	    snprintf(index, sizeof(index), "%d", j);
+	    sample_start(ob, "acpi_thermal_zone_trip_point_celsius", "zone", i);
+	    label(ob, "trip_point", index);
+	    label(ob, "type", t->type);
+	    out_printf(ob, "}");
+	    sample_micro(ob, micro_degrees(t->temp));
+	}
+    }
+}
+
+static void render_coolers(struct outbuf *ob, struct sample *s)
+{
+    struct cooling_info *c;
+    int i;
+
+    family(ob, "acpi_cooling_device_cur_state", "gauge", NULL, "Current cooling state.");
+    for (i = 0; i < s->n_coolers; i++) {
+	c = &s->coolers[i];
+	if (!HAS_ATTR(c, ATTR_CUR_STATE))
+	    continue;
+	sample_start(ob, "acpi_cooling_device_cur_state", "device", i);
+	label(ob, "type", c->type);
+	out_printf(ob, "} %d\n", c->cur_state);
+    }
+    family(ob, "acpi_cooling_device_max_state", "gauge", NULL, "Highest cooling state.");
+    for (i = 0; i < s->n_coolers; i++) {
+	c = &s->coolers[i];
+	if (!HAS_ATTR(c, ATTR_MAX_STATE))
+	    continue;
+	sample_start(ob, "acpi_cooling_device_max_state", "device", i);
+	label(ob, "type", c->type);
+	out_printf(ob, "} %d\n", c->max_state);
+    }
+}
+
+/* a sample of a sensor of hwmon chip i, labelled like its files */
+static void sensor_start(struct outbuf *ob, char *name, int i, struct hwmon_info *h, char *kind, int j, char *sensor_label)
+{
+    char sensor[32];
+
+    snprintf(sensor, sizeof(sensor), "%s%d", kind, j);
+    sample_start(ob, name, "chip", i);
+    label(ob, "name", h->type);
+    label(ob, "sensor", sensor);
+    label(ob, "label", sensor_label);
+    out_printf(ob, "}");
+}
+
+static void render_chips(struct outbuf *ob, struct sample *s)
+{
+    struct hwmon_info *h;
+    int i, j;
+
+    family(ob, "acpi_hwmon_temperature_celsius", "gauge", "celsius", "Temperature of a hwmon sensor.");
+    for (i = 0; i < s->n_chips; i++) {
+	h = &s->chips[i];
+	for (j = 0; j < h->n_temp; j++) {
+	    if (!HAS_ATTR(&h->temp[j], ATTR_TEMP_INPUT))
+		continue;
+	    sensor_start(ob, "acpi_hwmon_temperature_celsius", i, h, "temp", j, h->temp[j].label);
+	    sample_micro(ob, micro_degrees(h->temp[j].input));
+	}
+    }
+    family(ob, "acpi_hwmon_crit_celsius", "gauge", "celsius", "Critical temperature of a hwmon sensor.");
+    for (i = 0; i < s->n_chips; i++) {
+	h = &s->chips[i];
+	for (j = 0; j < h->n_temp; j++) {
+	    if (!HAS_ATTR(&h->temp[j], ATTR_TEMP_CRIT))
+		continue;
+	    sensor_start(ob, "acpi_hwmon_crit_celsius", i, h, "temp", j, h->temp[j].label);
+	    sample_micro(ob, micro_degrees(h->temp[j].crit));
+	}
+    }
+    family(ob, "acpi_hwmon_fan_rpm", "gauge", NULL, "Speed of a hwmon fan in revolutions per minute.");
+    for (i = 0; i < s->n_chips; i++) {
+	h = &s->chips[i];
+	for (j = 0; j < h->n_fan; j++) {
+	    if (!HAS_ATTR(&h->fan[j], ATTR_FAN_INPUT))
+		continue;
+	    sensor_start(ob, "acpi_hwmon_fan_rpm", i, h, "fan", j, NULL);
+	    out_printf(ob, " %.0f\n", h->fan[j].input);
+	}
+    }
+}
+
+static void snapshot_put(struct snapshot *snap)
+{
+    if (snap && --snap->refs == 0)
+	free(snap);
+}
+
+void exporter_publish(struct exporter *e, struct sample *s, unsigned int classes, long long time_ms)
+{
+    struct outbuf *ob = &e->buf;
+    struct snapshot *snap, *old;
+
+    ob->len = 0;
+    if (classes & (1 << BATTERY))
+	render_batteries(ob, s);
+    if (classes & (1 << AC_ADAPTER))
+	render_adapters(ob, s);
+    if (classes & (1 << THERMAL_ZONE))
+	render_zones(ob, s);
+    if (classes & (1 << COOLING_DEV))
+	render_coolers(ob, s);
+    if (classes & (1 << HWMON))
+	render_chips(ob, s);
+    family(ob, "acpi_sample_timestamp_seconds", "gauge", "seconds", "When the values were read.");
+    out_printf(ob, "acpi_sample_timestamp_seconds");
+    sample_micro(ob, time_ms * 1000);
+    out_printf(ob, "# EOF\n");
+
+    snap = malloc(sizeof(struct snapshot) + ob->len);
+    if (!snap) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in exporter_publish.\n");
+	exit(1);
+    }
+    snap->refs = 1;
+    snap->len = ob->len;
+    memcpy(snap->data, ob->data, ob->len);
+
+    pthread_mutex_lock(&e->lock);
+    old = e->current;
+    e->current = snap;
+    snapshot_put(old);
+    pthread_mutex_unlock(&e->lock);
+}
+
+static long long monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void client_close(struct exporter *e, struct client *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    if (c->snap) {
+	pthread_mutex_lock(&e->lock);
+	snapshot_put(c->snap);
+	pthread_mutex_unlock(&e->lock);
+	c->snap = NULL;
+    }
+}
+
+/* the body is left out for a HEAD request */
+static void client_respond(struct client *c, char *status, char *type, char *body, size_t len, int head)
+{
+    c->iov[0].iov_base = c->header;
+    c->iov[0].iov_len = snprintf(c->header, sizeof(c->header),
+	"HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+	status, type, (unsigned long) len);
+    c->iov[1].iov_base = body;
+    c->iov[1].iov_len = head ? 0 : len;
+    c->responding = TRUE;
+}
+
+/* one request per connection, answered from the current snapshot */
+static void client_request(struct exporter *e, struct client *c)
+{
+    char *path, *end;
+    int head;
+
+    head = !strncmp(c->request, "HEAD ", 5);
+    if (strncmp(c->request, "GET ", 4) && !head) {
+	client_respond(c, "405 Method Not Allowed", "text/plain", "", 0, head);
+	return;
+    }
+    path = c->request + (head ? 5 : 4);
+    end = path + strcspn(path, " ?\r\n");
+    *end = '\0';
+    if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+	client_respond(c, "404 Not Found", "text/plain", "", 0, head);
+	return;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    c->snap = e->current;
+    if (c->snap)
+	c->snap->refs++;
+    pthread_mutex_unlock(&e->lock);
+    if (!c->snap)
+	client_respond(c, "503 Service Unavailable", "text/plain", "", 0, head);
+    else
+	client_respond(c, "200 OK", CONTENT_TYPE, c->snap->data, c->snap->len, head);
+}
+
+/* read what the client sent, if that completes the request prepare the
+ * response
+ *
+ * Post: returns -1 if the client is to be dropped
+ */
+static int client_read(struct exporter *e, struct client *c)
+{
+    ssize_t n;
+
+    for (;;) {
+	n = read(c->fd, c->request + c->len, REQUEST_SIZE - c->len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    return 0;
+	if (n <= 0)
+	    return -1;
+	c->len += n;
+	c->request[c->len] = '\0';
+	if (c->len == REQUEST_SIZE || strstr(c->request, "\r\n\r\n") || strstr(c->request, "\n\n")) {
+	    client_request(e, c);
+	    return 0;
+	}
+    }
+}
+
+/* send as much of the response as the client takes, sending to a client
+ * that went away must not raise SIGPIPE
+ *
+ * Post: returns 1 once all of it is sent, -1 if the client is to be dropped
+ */
+static int client_write(struct client *c)
+{
+    struct msghdr msg;
+    ssize_t n;
+    int i;
+
+    while (c->iov[0].iov_len || c->iov[1].iov_len) {
+	memset(&msg, 0, sizeof(msg));
+	i = c->iov[0].iov_len ? 0 : 1;
+	msg.msg_iov = c->iov + i;
+	msg.msg_iovlen = 2 - i;
+	n = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+	}
+	for (; i < 2 && n > 0; i++) {
+	    if ((size_t) n >= c->iov[i].iov_len) {
+		n -= c->iov[i].iov_len;
+		c->iov[i].iov_len = 0;
+	    } else {
+		c->iov[i].iov_base = (char *) c->iov[i].iov_base + n;
+		c->iov[i].iov_len -= n;
+		n = 0;
+	    }
+	}
+    }
+    return 1;
+}
+
+/* the listener, the wake-up pipe and every client share one poll set, so
+ * a client that is slow to send its request or take the response only
+ * holds up itself */
+static void *serve(void *arg)
+{
+    struct exporter *e = arg;
+    struct pollfd fds[2 + EXPORTER_CLIENTS];
+    struct client *c, *slot[EXPORTER_CLIENTS];
+    long long now, next;
+    int i, n, fd, ret, timeout;
+
+    for (;;) {
+	fds[0].fd = e->wake[0];
+	fds[0].events = POLLIN;
+	/* the connections wait in the backlog while every slot is taken */
+	fds[1].fd = -1;
+	fds[1].events = POLLIN;
+	next = -1;
+	for (i = n = 0; i < EXPORTER_CLIENTS; i++) {
+	    c = &e->clients[i];
+	    if (c->fd < 0) {
+		fds[1].fd = e->fd;
+		continue;
+	    }
+	    fds[2 + n].fd = c->fd;
+	    fds[2 + n].events = c->responding ? POLLOUT : POLLIN;
+	    slot[n++] = c;
+	    if (next < 0 || c->deadline_ms < next)
+		next = c->deadline_ms;
+	}
+	timeout = -1;
+	if (next >= 0) {
+	    now = monotonic_ms();
+	    timeout = next > now ? next - now : 0;
+	}
+	if (poll(fds, 2 + n, timeout) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (fds[0].revents)
+	    break;
+
+	now = monotonic_ms();
+	for (i = 0; i < n; i++) {
+	    c = slot[i];
+	    ret = 0;
+	    if (fds[2 + i].revents) {
+		if (!c->responding)
+		    ret = client_read(e, c);
+		if (ret == 0 && c->responding)
+		    ret = client_write(c);
+		c->deadline_ms = now + REQUEST_TIMEOUT_MS;
+	    } else if (c->deadline_ms <= now) {
+		ret = -1;
+	    }
+	    if (ret != 0)
+		client_close(e, c);
+	}
+
+	if (!(fds[1].revents & POLLIN))
+	    continue;
+	for (i = 0; i < EXPORTER_CLIENTS && e->clients[i].fd >= 0; i++)
+	    ;
+	fd = accept4(e->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0 || i == EXPORTER_CLIENTS) {
+	    if (fd >= 0)
+		close(fd);
+	    continue;
+	}
+	c = &e->clients[i];
+	c->fd = fd;
+	c->len = 0;
+	c->responding = FALSE;
+	c->deadline_ms = now + REQUEST_TIMEOUT_MS;
+    }
+    for (i = 0; i < EXPORTER_CLIENTS; i++)
+	if (e->clients[i].fd >= 0)
+	    client_close(e, &e->clients[i]);
+    return NULL;
+}
+
+static int listen_unix(struct exporter *e, char *path)
+{
+    struct sockaddr_un sun;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    /* a socket left behind by an earlier run */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+	unlink(path);
+    e->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (e->fd < 0)
+	return -1;
+    if (bind(e->fd, (struct sockaddr *) &sun, sizeof(sun)) < 0)
+	return -1;
+    e->path = strdup(path);
+    if (!e->path) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in exporter_open.\n");
+	exit(1);
+    }
+    return 0;
+}
+
+static int listen_inet(struct exporter *e, char *addr)
+{
+    struct addrinfo hints, *res, *ai;
+    char *host = EXPORTER_HOST, *port = addr, *colon;
+    int one = 1, ret;
+
+    /* the port follows the last colon, a numeric IPv6 host is in brackets */
+    colon = strrchr(addr, ':');
+    if (colon) {
+	*colon = '\0';
+	port = colon + 1;
+	if (*addr)
+	    host = addr;
+	if (*host == '[' && host[strlen(host) - 1] == ']') {
+	    host++;
+	    host[strlen(host) - 1] = '\0';
+	}
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    ret = getaddrinfo(host, port, &hints, &res);
+    if (colon)
+	*colon = ':';
+    if (ret) {
+	fprintf(stderr, "Could not resolve %s: %s\n", addr, gai_strerror(ret));
+	return -2;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+	e->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+	if (e->fd < 0)
+	    continue;
+	setsockopt(e->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(e->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+	    break;
+	close(e->fd);
+	e->fd = -1;
+    }
+    freeaddrinfo(res);
+    return e->fd < 0 ? -1 : 0;
+}
+
+struct exporter *exporter_open(char *addr)
+{
+    struct exporter *e;
+    int i, ret;
+
+    e = calloc(1, sizeof(struct exporter));
+    if (!e) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in exporter_open.\n");
+	exit(1);
+    }
+    e->fd = e->wake[0] = e->wake[1] = -1;
+    e->clients = calloc(EXPORTER_CLIENTS, sizeof(struct client));
+    if (!e->clients) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in exporter_open.\n");
+	exit(1);
+    }
+    for (i = 0; i < EXPORTER_CLIENTS; i++)
+	e->clients[i].fd = -1;
+    if (!strncmp(addr, "unix:", 5))
+	ret = listen_unix(e, addr + 5);
+    else
+	ret = listen_inet(e, addr);
+    /* a connection that is reset before it is accepted must not block
+     * the thread */
+    if (ret == 0 && fcntl(e->fd, F_SETFL, fcntl(e->fd, F_GETFL) | O_NONBLOCK) < 0)
+	ret = -1;
+    if (ret == 0)
+	ret = listen(e->fd, EXPORTER_BACKLOG);
+    if (ret == -1)
+	fprintf(stderr, "Could not listen on %s: %s\n", addr, strerror(errno));
+    if (ret == 0 && pipe(e->wake) < 0) {
+	fprintf(stderr, "Could not create a pipe: %s\n", strerror(errno));
+	ret = -1;
+    }
+    if (ret == 0) {
+	pthread_mutex_init(&e->lock, NULL);
+	if (pthread_create(&e->thread, NULL, serve, e) == 0)
+	    return e;
+	fprintf(stderr, "Could not start the exporter thread.\n");
+	pthread_mutex_destroy(&e->lock);
+    }
+    if (e->fd >= 0)
+	close(e->fd);
+    if (e->wake[0] >= 0) {
+	close(e->wake[0]);
+	close(e->wake[1]);
+    }
+    if (e->path)
+	unlink(e->path);
+    free(e->path);
+    free(e->clients);
+    free(e);
+    return NULL;
+}
+
+void exporter_close(struct exporter *e)
+{
+    if (!e)
+	return;
+    while (write(e->wake[1], "", 1) < 0 && errno == EINTR)
+	;
+    pthread_join(e->thread, NULL);
+    close(e->fd);
+    close(e->wake[0]);
+    close(e->wake[1]);
+    if (e->path)
+	unlink(e->path);
+    free(e->path);
+    snapshot_put(e->current);
+    pthread_mutex_destroy(&e->lock);
+    out_free(&e->buf);
+    free(e->clients);
+    free(e);
+}
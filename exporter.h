@@ -0,0 +1,46 @@
+/* serving the last sample in the OpenMetrics text format
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _EXPORTER_H
+#define _EXPORTER_H
+
+struct sample;
+struct exporter;
+
+/* listen on addr, either unix:<path> or [<host>:]<port> with the host
+ * defaulting to 127.0.0.1, and answer HTTP requests for /metrics from a
+ * thread of its own
+ *
+ * Post: returns NULL with a message printed if addr cannot be used
+ */
+struct exporter *exporter_open(char *addr);
+
+/* render a sample into the snapshot that is served, the requests
+ * answered after this returns see it; nothing else is ever read to answer
+ * a request
+ *
+ * Pre: e != NULL, the classes set as bits of device_nr are filled in s
+ */
+void exporter_publish(struct exporter *e, struct sample *s, unsigned int classes, long long time_ms);
+
+/* stop serving and close the socket
+ *
+ * Pre: e is NULL or returned by exporter_open
+ */
+void exporter_close(struct exporter *e);
+
+#endif
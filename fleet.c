@@ -0,0 +1,461 @@
+/* reading many captured trees at once
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <glob.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "arena.h"
+#include "acpi.h"
+#include "output.h"
+#include "fleet.h"
+
+/* buckets of 10% of the wear histogram, the last one is 100% and above */
+#define WEAR_BUCKETS	11
+
+/* Every worker owns the range of roots it has not started yet. It takes
+ * the first root of its own range, and once that is empty it steals the
+ * second half of the largest range left, so roots that take long on one
+ * worker do not hold up the others. A result is written as soon as those
+ * of all roots before it are. */
+struct range {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+};
+
+struct result {
+    struct outbuf buf;
+    int done;
+};
+
+/* values of the summary, each worker gathers its own */
+struct values {
+    int n;
+    int size;
+    double *v;
+};
+
+struct fleet;
+
+struct worker {
+    struct fleet *f;
+    pthread_t thread;
+    struct range range;
+    struct arena arena;
+    int read;			/* roots */
+    int failed;
+    int batteries;
+    struct values wear;		/* last full of design capacity, in % */
+    struct values hottest;	/* thermal zone of a root, in degrees C */
+};
+
+struct fleet {
+    char **roots;
+    int n_roots;
+    int *show;
+    unsigned int classes;
+    int proc_interface;
+    int format;
+    int n_workers;
+    struct worker *workers;
+    struct result *results;
+    pthread_mutex_t print_lock;
+    int next_print;		/* the first root whose result is not written */
+    int write_error;		/* errno of a failed write of a result */
+};
+
+static void out_of_memory(char *func)
+{
+    fprintf(stderr, "Out of memory. Could not allocate memory in %s.\n", func);
+    exit(1);
+}
+
+static long long now_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static void add_root(char ***roots, int *n, int *size, const char *root)
+{
+    char **r;
+
+    if (*n == *size) {
+	*size = *size ? 2 * *size : 64;
+	r = realloc(*roots, *size * sizeof(char *));
+	if (!r)
+	    out_of_memory("fleet_roots");
+	*roots = r;
+    }
+    (*roots)[*n] = strdup(root);
+    if (!(*roots)[*n])
+	out_of_memory("fleet_roots");
+    (*n)++;
+}
+
+static void read_roots(FILE *in, char ***roots, int *n, int *size)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &line_size, in)) >= 0) {
+	if (len && line[len - 1] == '\n')
+	    line[--len] = '\0';
+	if (len)
+	    add_root(roots, n, size, line);
+    }
+    free(line);
+}
+
+int fleet_roots(char **args, int n_args, char ***roots)
+{
+    glob_t g;
+    int i, n = 0, size = 0;
+    size_t j;
+
+    *roots = NULL;
+    if (!n_args)
+	read_roots(stdin, roots, &n, &size);
+    for (i = 0; i < n_args; i++) {
+	if (!strcmp(args[i], "-")) {
+	    read_roots(stdin, roots, &n, &size);
+	} else if (!strpbrk(args[i], "*?[")) {
+	    add_root(roots, &n, &size, args[i]);
+	} else {
+	    switch (glob(args[i], 0, NULL, &g)) {
+	    case 0:
+		for (j = 0; j < g.gl_pathc; j++)
+		    add_root(roots, &n, &size, g.gl_pathv[j]);
+		globfree(&g);
+		break;
+	    case GLOB_NOSPACE:
+		out_of_memory("fleet_roots");
+		break;
+	    default:
+		fprintf(stderr, "No roots match %s\n", args[i]);
+		break;
+	    }
+	}
+    }
+    return n;
+}
+
+static void add_value(struct values *v, double value)
+{
+    double *p;
+
+    if (v->n == v->size) {
+	v->size = v->size ? 2 * v->size : 256;
+	p = realloc(v->v, v->size * sizeof(double));
+	if (!p)
+	    out_of_memory("fleet_run");
+	v->v = p;
+    }
+    v->v[v->n++] = value;
+}
+
+static void summarize(struct worker *w, struct sample *s)
+{
+    struct battery_info *b;
+    struct thermal_info *z;
+    long full, design;
+    float hottest = 0;
+    int i, have_temp = FALSE;
+
+    for (i = 0; i < s->n_batteries; i++) {
+	b = &s->batteries[i];
+	w->batteries++;
+	if (HAS_ATTR(b, ATTR_CHARGE_FULL) && HAS_ATTR(b, ATTR_CHARGE_FULL_DESIGN)) {
+	    full = b->charge_full;
+	    design = b->charge_full_design;
+	} else if (HAS_ATTR(b, ATTR_ENERGY_FULL) && HAS_ATTR(b, ATTR_ENERGY_FULL_DESIGN)) {
+	    full = b->energy_full;
+	    design = b->energy_full_design;
+	} else {
+	    continue;
+	}
+	if (design < 1000)
+	    continue;
+	/* some broken systems give a percentage as the full capacity, the
+	 * text lines of -i take it as such too */
+	if (full / 1000 <= 100)
+	    add_value(&w->wear, full / 1000);
+	else
+	    add_value(&w->wear, 100.0 * full / design);
+    }
+    for (i = 0; i < s->n_zones; i++) {
+	z = &s->zones[i];
+	if (!(z->have & (ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE))))
+	    continue;
+	if (!have_temp || z->temperature > hottest)
+	    hottest = z->temperature;
+	have_temp = TRUE;
+    }
+    if (have_temp)
+	add_value(&w->hottest, hottest);
+}
+
+/* write the results that are done in the order of the roots */
+static void finish(struct fleet *f, int i)
+{
+    struct result *r;
+
+    pthread_mutex_lock(&f->print_lock);
+    f->results[i].done = TRUE;
+    while (f->next_print < f->n_roots && f->results[f->next_print].done) {
+	r = &f->results[f->next_print++];
+	if (out_flush(&r->buf, STDOUT_FILENO) < 0 && !f->write_error)
+	    f->write_error = errno;
+	out_free(&r->buf);
+    }
+    pthread_mutex_unlock(&f->print_lock);
+}
+
+static void process(struct worker *w, int i)
+{
+    struct fleet *f = w->f;
+    struct outbuf *ob = &f->results[i].buf;
+    struct sample s;
+    long long time_ms = now_ms();
+
+    if (find_devices(&w->arena, &s, f->roots[i], f->show, ATTR_ALL, f->proc_interface, NULL) < 0) {
+	if (errno == ENOMEM)
+	    out_of_memory("find_devices");
+	out_error(ob, f->format, f->roots[i], time_ms, "No ACPI information in this directory", i == 0);
+	w->failed++;
+    } else {
+	out_sample(ob, f->format, &s, f->classes, time_ms, f->roots[i], NULL, i == 0);
+	summarize(w, &s);
+	w->read++;
+    }
+    arena_reset(&w->arena);
+    finish(f, i);
+}
+
+static int take(struct range *r)
+{
+    int i = -1;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->next < r->end)
+	i = r->next++;
+    pthread_mutex_unlock(&r->lock);
+    return i;
+}
+
+static int left(struct range *r)
+{
+    int n;
+
+    pthread_mutex_lock(&r->lock);
+    n = r->end - r->next;
+    pthread_mutex_unlock(&r->lock);
+    return n;
+}
+
+/* move the second half of the largest range of another worker to the
+ * empty one of w, returns FALSE if there is nothing left to steal */
+static int steal(struct worker *w)
+{
+    struct fleet *f = w->f;
+    struct range *victim;
+    int i, n, most, start, end;
+
+    for (;;) {
+	victim = NULL;
+	most = 0;
+	for (i = 0; i < f->n_workers; i++) {
+	    if (&f->workers[i] == w)
+		continue;
+	    n = left(&f->workers[i].range);
+	    if (n > most) {
+		most = n;
+		victim = &f->workers[i].range;
+	    }
+	}
+	if (!victim)
+	    return FALSE;
+
+	/* it may have shrunk since */
+	pthread_mutex_lock(&victim->lock);
+	n = victim->end - victim->next;
+	start = victim->next + n / 2;
+	end = victim->end;
+	if (n > 0)
+	    victim->end = start;
+	pthread_mutex_unlock(&victim->lock);
+	if (n > 0)
+	    break;
+    }
+    pthread_mutex_lock(&w->range.lock);
+    w->range.next = start;
+    w->range.end = end;
+    pthread_mutex_unlock(&w->range.lock);
+    return TRUE;
+}
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+    int i;
+
+    do {
+	while ((i = take(&w->range)) >= 0)
+	    process(w, i);
+    } while (steal(w));
+    return NULL;
+}
+
+static int compare_values(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* all values of the workers, sorted */
+static struct values merge(struct fleet *f, size_t offset)
+{
+    struct values all = { 0, 0, NULL }, *v;
+    int i, j;
+
+    for (i = 0; i < f->n_workers; i++) {
+	v = (struct values *) ((char *) &f->workers[i] + offset);
+	for (j = 0; j < v->n; j++)
+	    add_value(&all, v->v[j]);
+    }
+    if (all.n)
+	qsort(all.v, all.n, sizeof(double), compare_values);
+    return all;
+}
+
+static void print_distribution(struct values *v, const char *what, const char *unit)
+{
+    static const double quantiles[] = { 0.1, 0.25, 0.5, 0.75, 0.9 };
+    static const char *names[] = { "10%", "25%", "median", "75%", "90%" };
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < v->n; i++)
+	sum += v->v[i];
+    fprintf(stderr, "%s (%s): mean %.1f, min %.1f", what, unit, sum / v->n, v->v[0]);
+    for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++)
+	fprintf(stderr, ", %s %.1f", names[i], v->v[(int) (quantiles[i] * (v->n - 1) + 0.5)]);
+    fprintf(stderr, ", max %.1f\n", v->v[v->n - 1]);
+}
+
+static void print_summary(struct fleet *f)
+{
+    struct values wear, hottest;
+    int hist[WEAR_BUCKETS] = { 0 };
+    int i, k, read = 0, failed = 0, batteries = 0;
+
+    for (i = 0; i < f->n_workers; i++) {
+	read += f->workers[i].read;
+	failed += f->workers[i].failed;
+	batteries += f->workers[i].batteries;
+    }
+    wear = merge(f, offsetof(struct worker, wear));
+    hottest = merge(f, offsetof(struct worker, hottest));
+
+    fprintf(stderr, "%d roots, %d read, %d could not be read\n", f->n_roots, read, failed);
+    if (f->show[BATTERY])
+	fprintf(stderr, "%d batteries, %d with their design capacity\n", batteries, wear.n);
+    if (wear.n) {
+	print_distribution(&wear, "last full of design capacity", "%");
+	for (i = 0; i < wear.n; i++) {
+	    k = wear.v[i] / 10;
+	    hist[k < 0 ? 0 : k >= WEAR_BUCKETS ? WEAR_BUCKETS - 1 : k]++;
+	}
+	for (k = 0; k < WEAR_BUCKETS; k++) {
+	    if (k == WEAR_BUCKETS - 1)
+		fprintf(stderr, "     >=%3d%%: %d\n", 10 * k, hist[k]);
+	    else
+		fprintf(stderr, "  %3d-%3d%%: %d\n", 10 * k, 10 * k + 10, hist[k]);
+	}
+    }
+    if (hottest.n)
+	print_distribution(&hottest, "hottest thermal zone", "degrees C");
+    free(wear.v);
+    free(hottest.v);
+}
+
+int fleet_run(char **roots, int n_roots, int *show, int proc_interface, int format, int threads)
+{
+    struct fleet f;
+    struct worker *w;
+    int i, started, ret;
+
+    memset(&f, 0, sizeof(f));
+    f.roots = roots;
+    f.n_roots = n_roots;
+    f.show = show;
+    f.proc_interface = proc_interface;
+    f.format = format;
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	if (show[i])
+	    f.classes |= 1 << i;
+    f.n_workers = threads < n_roots ? threads : n_roots > 0 ? n_roots : 1;
+    f.workers = calloc(f.n_workers, sizeof(struct worker));
+    f.results = calloc(n_roots ? n_roots : 1, sizeof(struct result));
+    if (!f.workers || !f.results)
+	out_of_memory("fleet_run");
+    pthread_mutex_init(&f.print_lock, NULL);
+
+    /* the roots are dealt out in ranges, in the order they come in */
+    for (i = 0; i < f.n_workers; i++) {
+	w = &f.workers[i];
+	w->f = &f;
+	pthread_mutex_init(&w->range.lock, NULL);
+	w->range.next = (long long) n_roots * i / f.n_workers;
+	w->range.end = (long long) n_roots * (i + 1) / f.n_workers;
+    }
+    /* the first worker is this thread, a worker that cannot be started
+     * leaves its range to be stolen */
+    for (started = 1; started < f.n_workers; started++)
+	if (pthread_create(&f.workers[started].thread, NULL, work, &f.workers[started]))
+	    break;
+    work(&f.workers[0]);
+    for (i = 1; i < started; i++)
+	pthread_join(f.workers[i].thread, NULL);
+
+    print_summary(&f);
+    ret = f.write_error != 0;
+    if (f.write_error)
+	fprintf(stderr, "Could not write the results: %s\n", strerror(f.write_error));
+    for (i = 0; i < f.n_workers; i++) {
+	if (f.workers[i].failed)
+	    ret = 1;
+	arena_free(&f.workers[i].arena);
+	free(f.workers[i].wear.v);
+	free(f.workers[i].hottest.v);
+	pthread_mutex_destroy(&f.workers[i].range.lock);
+    }
+    pthread_mutex_destroy(&f.print_lock);
+    free(f.workers);
+    free(f.results);
+    return ret;
+}
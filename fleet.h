@@ -0,0 +1,38 @@
+/* reading many captured trees at once
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _FLEET_H
+#define _FLEET_H
+
+/* the roots named by args, each of which is a root, a glob or - for a list
+ * of roots on stdin, one per line; no args also read stdin
+ *
+ * Post: returns the number of roots put in *roots, a message is printed
+ *       for every glob without matches
+ */
+int fleet_roots(char **args, int n_args, char ***roots);
+
+/* read every root like -d does, the classes set in show, on threads
+ * workers; one result per root is written in format to stdout in the
+ * order of roots, and a summary of all of them to stderr
+ *
+ * Pre: format is OUTPUT_JSON, OUTPUT_CSV or OUTPUT_NDJSON, threads > 0
+ * Post: returns 0, or 1 if a root could not be read or stdout written
+ */
+int fleet_run(char **roots, int n_roots, int *show, int proc_interface, int format, int threads);
+
+#endif
@@ -0,0 +1,376 @@
+/* reading battery, ac adapter, thermal, cooling and hwmon status into snapshots
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "arena.h"
+#include "acpi.h"
+#include "shm.h"
+#include "libacpi.h"
+
+#define ACPI_CLASSES	(ACPI_BATTERIES | ACPI_ADAPTERS | ACPI_THERMAL_ZONES | ACPI_COOLING_DEVICES | ACPI_HWMON)
+
+/* the flag of each class, by device_nr */
+static const unsigned int class_flags[DEVICE_CLASSES] = {
+    ACPI_BATTERIES, ACPI_ADAPTERS, ACPI_THERMAL_ZONES, ACPI_COOLING_DEVICES, ACPI_HWMON
+};
+
+struct acpi {
+    struct watch *watches[DEVICE_CLASSES];	/* by device_nr, NULL if not opened */
+    struct shm_reader *shm;	/* instead of the watches, see acpi_open_shared */
+    char *shm_name;		/* opened again when its publisher is replaced */
+    struct arena arena;		/* for the trip points of shared samples */
+    unsigned int classes;	/* of the last shared sample */
+    long long time_ms;
+    struct sample sample;
+};
+
+/* the bits of acpi_battery.valid, by attribute */
+static const struct {
+    int id;
+    unsigned int bit;
+} battery_valid[] = {
+    { ATTR_CURRENT_NOW, ACPI_CURRENT_NOW },
+    { ATTR_POWER_NOW, ACPI_POWER_NOW },
+    { ATTR_CHARGE_NOW, ACPI_CHARGE_NOW },
+    { ATTR_ENERGY_NOW, ACPI_ENERGY_NOW },
+    { ATTR_VOLTAGE_NOW, ACPI_VOLTAGE_NOW },
+    { ATTR_CHARGE_FULL, ACPI_CHARGE_FULL },
+    { ATTR_ENERGY_FULL, ACPI_ENERGY_FULL },
+    { ATTR_CHARGE_FULL_DESIGN, ACPI_CHARGE_FULL_DESIGN },
+    { ATTR_ENERGY_FULL_DESIGN, ACPI_ENERGY_FULL_DESIGN },
+};
+
+struct acpi *snapshot_open(const char *root, unsigned int classes, int proc_interface, unsigned int need,
+			   struct batch *b)
+{
+    struct acpi *h;
+    char *path;
+    int device_nr, err;
+
+    if (!root)
+	root = proc_interface ? ACPI_PATH_PROC : ACPI_PATH_SYS;
+    h = calloc(1, sizeof(struct acpi));
+    path = strdup(root);
+    if (!h || !path) {
+	free(h);
+	free(path);
+	errno = ENOMEM;
+	return NULL;
+    }
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	if (!(classes & (1 << device_nr)))
+	    continue;
+	h->watches[device_nr] = watch_open(path, device_nr, need, proc_interface, b);
+	if (!h->watches[device_nr]) {
+	    err = errno;
+	    free(path);
+	    acpi_close(h);
+	    errno = err;
+	    return NULL;
+	}
+    }
+    free(path);
+    return h;
+}
+
+struct acpi *acpi_open(const char *root, unsigned int flags)
+{
+    unsigned int classes = 0;
+    int device_nr;
+
+    if (!(flags & ACPI_CLASSES))
+	flags |= ACPI_CLASSES;
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (flags & class_flags[device_nr])
+	    classes |= 1 << device_nr;
+    return snapshot_open(root, classes, (flags & ACPI_PROC) != 0, ATTR_ALL, NULL);
+}
+
+struct acpi *acpi_open_shared(const char *name)
+{
+    struct acpi *h = calloc(1, sizeof(struct acpi));
+
+    if (!h) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    h->shm_name = strdup(name);
+    if (!h->shm_name) {
+	free(h);
+	errno = ENOMEM;
+	return NULL;
+    }
+    h->shm = shm_reader_open(name);
+    if (!h->shm) {
+	free(h->shm_name);
+	free(h);
+	return NULL;
+    }
+    return h;
+}
+
+/* follow a publisher that closed its segment to the one that took its
+ * place, if there is one */
+static int shared_reopen(struct acpi *h)
+{
+    struct shm_reader *r = shm_reader_open(h->shm_name);
+
+    if (!r) {
+	errno = errno == ENOMEM ? ENOMEM : ESTALE;
+	return -1;
+    }
+    shm_reader_close(h->shm);
+    h->shm = r;
+    return 0;
+}
+
+struct sample *snapshot_sample(struct acpi *h)
+{
+    return &h->sample;
+}
+
+unsigned int snapshot_shared(struct acpi *h, long long *time_ms)
+{
+    *time_ms = h->time_ms;
+    return h->classes;
+}
+
+void snapshot_adaptive(struct acpi *h, long min_ms, long max_ms)
+{
+    int device_nr;
+
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (h->watches[device_nr])
+	    watch_adaptive(h->watches[device_nr], min_ms, max_ms);
+}
+
+void snapshot_files(struct acpi *h, long *read, long *saved)
+{
+    int device_nr;
+
+    *read = *saved = 0;
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (h->watches[device_nr])
+	    watch_files(h->watches[device_nr], read, saved);
+}
+
+int acpi_snapshot_refresh(struct acpi *h)
+{
+    int device_nr, ret = 0;
+
+    if (h->shm) {
+	arena_reset(&h->arena);
+	if (shm_read(h->shm, &h->sample, &h->classes, &h->time_ms) < 0 &&
+	    (errno != ESTALE || shared_reopen(h) < 0 ||
+	     shm_read(h->shm, &h->sample, &h->classes, &h->time_ms) < 0))
+	    return -1;
+	finish_records(&h->arena, &h->sample, THERMAL_ZONE);
+	if (h->arena.failed) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	return 0;
+    }
+
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	if (h->watches[device_nr] && watch_read(h->watches[device_nr], &h->sample) < 0)
+	    ret = -1;
+    return ret;
+}
+
+int acpi_battery_count(const struct acpi *h)
+{
+    return h->sample.n_batteries;
+}
+
+int acpi_battery_get(const struct acpi *h, int i, struct acpi_battery *b)
+{
+    const struct battery_info *rec;
+    unsigned int j;
+
+    if (i < 0 || i >= h->sample.n_batteries) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.batteries[i];
+    memset(b, 0, sizeof(*b));
+    b->state = rec->state;
+    b->type = rec->type;
+    for (j = 0; j < sizeof(battery_valid) / sizeof(battery_valid[0]); j++)
+	if (HAS_ATTR(rec, battery_valid[j].id))
+	    b->valid |= battery_valid[j].bit;
+    b->current_now = rec->current_now;
+    b->power_now = rec->power_now;
+    b->charge_now = rec->charge_now;
+    b->energy_now = rec->energy_now;
+    b->voltage_now = rec->voltage_now;
+    b->charge_full = rec->charge_full;
+    b->energy_full = rec->energy_full;
+    b->charge_full_design = rec->charge_full_design;
+    b->energy_full_design = rec->energy_full_design;
+    return 0;
+}
+
+int acpi_adapter_count(const struct acpi *h)
+{
+    return h->sample.n_adapters;
+}
+
+int acpi_adapter_get(const struct acpi *h, int i, struct acpi_adapter *ac)
+{
+    const struct adapter_info *rec;
+
+    if (i < 0 || i >= h->sample.n_adapters) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.adapters[i];
+    ac->state = rec->state;
+    ac->type = rec->type;
+    ac->online = HAS_ATTR(rec, ATTR_ONLINE) ? rec->online : -1;
+    return 0;
+}
+
+static long millidegrees(float temperature)
+{
+    double t = (double) temperature * 1000;
+
+    return t < 0 ? -(long) (0.5 - t) : (long) (t + 0.5);
+}
+
+int acpi_thermal_zone_count(const struct acpi *h)
+{
+    return h->sample.n_zones;
+}
+
+int acpi_thermal_zone_get(const struct acpi *h, int i, struct acpi_thermal_zone *z)
+{
+    const struct thermal_info *rec;
+
+    if (i < 0 || i >= h->sample.n_zones) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.zones[i];
+    z->state = rec->state;
+    z->type = rec->type;
+    z->has_temperature = (rec->have & (ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE))) != 0;
+    z->temperature = z->has_temperature ? millidegrees(rec->temperature) : 0;
+    z->n_trip_points = rec->n_trip;
+    return 0;
+}
+
+int acpi_trip_point_get(const struct acpi *h, int zone, int i, struct acpi_trip_point *t)
+{
+    const struct thermal_info *rec;
+
+    if (zone < 0 || zone >= h->sample.n_zones || i < 0 || i >= h->sample.zones[zone].n_trip) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.zones[zone];
+    t->type = rec->trip[i].type;
+    t->temperature = millidegrees(rec->trip[i].temp);
+    return 0;
+}
+
+int acpi_cooling_device_count(const struct acpi *h)
+{
+    return h->sample.n_coolers;
+}
+
+int acpi_cooling_device_get(const struct acpi *h, int i, struct acpi_cooling_device *c)
+{
+    const struct cooling_info *rec;
+
+    if (i < 0 || i >= h->sample.n_coolers) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.coolers[i];
+    c->state = rec->state;
+    c->type = rec->type;
+    c->cur_state = HAS_ATTR(rec, ATTR_CUR_STATE) ? rec->cur_state : -1;
+    c->max_state = HAS_ATTR(rec, ATTR_MAX_STATE) ? rec->max_state : -1;
+    return 0;
+}
+
+int acpi_hwmon_count(const struct acpi *h)
+{
+    return h->sample.n_chips;
+}
+
+int acpi_hwmon_get(const struct acpi *h, int i, struct acpi_hwmon *c)
+{
+    const struct hwmon_info *rec;
+
+    if (i < 0 || i >= h->sample.n_chips) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.chips[i];
+    c->name = rec->type;
+    c->n_temps = rec->n_temp;
+    c->n_fans = rec->n_fan;
+    return 0;
+}
+
+int acpi_hwmon_temp_get(const struct acpi *h, int chip, int i, struct acpi_hwmon_temp *t)
+{
+    const struct hwmon_sensor *rec;
+
+    if (chip < 0 || chip >= h->sample.n_chips || i < 0 || i >= h->sample.chips[chip].n_temp) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.chips[chip].temp[i];
+    t->label = rec->label;
+    t->has_temperature = HAS_ATTR(rec, ATTR_TEMP_INPUT) != 0;
+    t->temperature = t->has_temperature ? millidegrees(rec->input) : 0;
+    t->has_crit = HAS_ATTR(rec, ATTR_TEMP_CRIT) != 0;
+    t->crit = t->has_crit ? millidegrees(rec->crit) : 0;
+    return 0;
+}
+
+int acpi_hwmon_fan_get(const struct acpi *h, int chip, int i, int *rpm)
+{
+    const struct hwmon_sensor *rec;
+
+    if (chip < 0 || chip >= h->sample.n_chips || i < 0 || i >= h->sample.chips[chip].n_fan) {
+	errno = ERANGE;
+	return -1;
+    }
+    rec = &h->sample.chips[chip].fan[i];
+    *rpm = HAS_ATTR(rec, ATTR_FAN_INPUT) ? (int) rec->input : -1;
+    return 0;
+}
+
+void acpi_close(struct acpi *h)
+{
+    int device_nr;
+
+    if (!h)
+	return;
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++)
+	watch_close(h->watches[device_nr]);
+    shm_reader_close(h->shm);
+    free(h->shm_name);
+    arena_free(&h->arena);
+    free(h);
+}
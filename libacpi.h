@@ -0,0 +1,157 @@
+/* reading battery, ac adapter, thermal, cooling and hwmon status into snapshots
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _LIBACPI_H
+#define _LIBACPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A handle keeps the files of its devices open, so refreshing a snapshot
+ * costs about one read per value. Handles share nothing: each may be used
+ * by one thread at a time, different handles by different threads. No
+ * function prints or exits, failures return -1 or NULL with errno set. */
+struct acpi;
+
+/* classes of devices for acpi_open, none means all */
+#define ACPI_BATTERIES		0x01
+#define ACPI_ADAPTERS		0x02
+#define ACPI_THERMAL_ZONES	0x04
+#define ACPI_COOLING_DEVICES	0x08
+/* root is laid out like /proc/acpi instead of /sys/class */
+#define ACPI_PROC		0x10
+#define ACPI_HWMON		0x20
+
+/* values are in micro units: uA, uW, uAh, uWh and uV; valid has a bit for
+ * each one that was read */
+#define ACPI_CURRENT_NOW		0x001
+#define ACPI_POWER_NOW			0x002
+#define ACPI_CHARGE_NOW			0x004
+#define ACPI_ENERGY_NOW			0x008
+#define ACPI_VOLTAGE_NOW		0x010
+#define ACPI_CHARGE_FULL		0x020
+#define ACPI_ENERGY_FULL		0x040
+#define ACPI_CHARGE_FULL_DESIGN		0x080
+#define ACPI_ENERGY_FULL_DESIGN		0x100
+
+/* strings are NULL if unknown and valid until the next refresh */
+struct acpi_battery {
+	const char *state;	/* "Charging", "Discharging", ... */
+	const char *type;
+	unsigned int valid;
+	long current_now;
+	long power_now;
+	long charge_now;
+	long energy_now;
+	long voltage_now;
+	long charge_full;
+	long energy_full;
+	long charge_full_design;
+	long energy_full_design;
+};
+
+struct acpi_adapter {
+	const char *state;	/* "on-line" or "off-line" */
+	const char *type;
+	int online;		/* -1 if unknown */
+};
+
+struct acpi_thermal_zone {
+	const char *state;	/* only the proc interface has one */
+	const char *type;
+	int has_temperature;
+	long temperature;	/* millidegrees Celsius */
+	int n_trip_points;	/* numbered from 0, not all of them need be set */
+};
+
+struct acpi_trip_point {
+	const char *type;	/* NULL if not set */
+	long temperature;	/* millidegrees Celsius */
+};
+
+struct acpi_cooling_device {
+	const char *state;	/* only the proc interface has one */
+	const char *type;
+	int cur_state;		/* -1 if unknown */
+	int max_state;
+};
+
+/* a chip of /sys/class/hwmon, its sensors and fans are numbered like their
+ * files, from 1 on most chips */
+struct acpi_hwmon {
+	const char *name;
+	int n_temps;		/* the highest number of a sensor plus one */
+	int n_fans;
+};
+
+struct acpi_hwmon_temp {
+	const char *label;	/* NULL if there is none */
+	int has_temperature;	/* 0 if there is no such sensor */
+	long temperature;	/* millidegrees Celsius */
+	int has_crit;
+	long crit;
+};
+
+/* open the devices of the classes in flags below root, NULL for the
+ * default of /sys/class or /proc/acpi; the snapshot is empty until the
+ * first refresh */
+struct acpi *acpi_open(const char *root, unsigned int flags);
+
+/* open the snapshots that "acpi --publish name" keeps in shared memory,
+ * of the classes it reads; a refresh copies the last one without locks or
+ * system calls, so any number of handles cost the publisher nothing */
+struct acpi *acpi_open_shared(const char *name);
+
+/* read all values again, the strings of the last snapshot are given back;
+ * returns 0, or -1 if some values were left out for lack of memory, or
+ * with errno EAGAIN if a shared handle has no snapshot yet, ESTALE if its
+ * publisher stopped and no other took its place */
+int acpi_snapshot_refresh(struct acpi *h);
+
+/* the devices of the snapshot, i counts from 0; the get functions return 0,
+ * or -1 if there is no such device */
+int acpi_battery_count(const struct acpi *h);
+int acpi_battery_get(const struct acpi *h, int i, struct acpi_battery *b);
+
+int acpi_adapter_count(const struct acpi *h);
+int acpi_adapter_get(const struct acpi *h, int i, struct acpi_adapter *ac);
+
+int acpi_thermal_zone_count(const struct acpi *h);
+int acpi_thermal_zone_get(const struct acpi *h, int i, struct acpi_thermal_zone *z);
+int acpi_trip_point_get(const struct acpi *h, int zone, int i, struct acpi_trip_point *t);
+
+int acpi_cooling_device_count(const struct acpi *h);
+int acpi_cooling_device_get(const struct acpi *h, int i, struct acpi_cooling_device *c);
+
+int acpi_hwmon_count(const struct acpi *h);
+int acpi_hwmon_get(const struct acpi *h, int i, struct acpi_hwmon *c);
+int acpi_hwmon_temp_get(const struct acpi *h, int chip, int i, struct acpi_hwmon_temp *t);
+/* the speed of a fan in RPM, or -1 if there is no such fan */
+int acpi_hwmon_fan_get(const struct acpi *h, int chip, int i, int *rpm);
+
+/* close the files and free the snapshot
+ *
+ * Pre: h is NULL or returned by acpi_open
+ */
+void acpi_close(struct acpi *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,6 +20,8 @@
 #ifndef _LIST_H
 #define _LIST_H
 
+#include "prefix.h"
+
 struct list {
     void *data;
     struct list *next;
@@ -33,14 +35,15 @@ struct field {
 /* create a new list
  * 
  * Pre: 
- * Post: returns a pointer to a valid linked-list
+ * Post: returns a pointer to a valid linked-list, or NULL if there is no
+ *       memory left
  */
 struct list *list_new(void *data);
 
 /* append to a list
  * 
  * Pre: none. if node == NULL this is equivalent to list_new
- * Post: returns a pointer to a valid linked-list
+ * Post: returns a pointer to a valid linked-list, or NULL like list_new
  */
 struct list *list_append(struct list *node, void *data);
 
@@ -22,48 +22,494 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <getopt.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <signal.h>
+#include "arena.h"
+#include "batch.h"
+#include "event.h"
+#include "record.h"
+#include "output.h"
+#include "exporter.h"
+#include "fleet.h"
+#include "collector.h"
+#include "shm.h"
+#include "window.h"
+#include "stats.h"
 #include "acpi.h"
+#include "libacpi.h"
 
-struct device device[4] = {
-			{ BATTERY, "battery", "power_supply", "BAT" },
-			{ AC_ADAPTER, "ac_adapter", "power_supply", "AC" },
-			{ THERMAL_ZONE, "thermal_zone", "thermal", "thermal_zone" },
-			{ COOLING_DEV, "fan", "thermal", "cooling_device" }
-			  };
+/* files read at the same time, see batch.c */
+#define DEFAULT_JOBS	8
 
-static void do_show_batteries(char *acpi_path, int show_empty_slots, int show_details, int proc_interface)
+/* seconds between samples of the exporter, publisher and collector if no
+ * --watch is given */
+#define DEFAULT_SERVE_INTERVAL	5
+
+/* options without a short form */
+#define OPT_STATS	256
+#define OPT_ROOTS	257
+#define OPT_SNAPSHOT	258
+#define OPT_CHANGES	259
+#define OPT_DEAD_BAND	260
+#define OPT_PUBLISH	261
+#define OPT_FROM_SHM	262
+#define OPT_COLLECT	263
+#define OPT_DIRECT	264
+#define OPT_SUMMARIZE	265
+#define OPT_WINDOW	266
+
+/* the dead-bands of --changes-only unless --dead-band is given */
+#define DEFAULT_DEAD_BANDS	{ 1, 0.5, 5 }
+
+/* how samples are shown, or where they are recorded or served */
+struct output {
+	unsigned int classes;	/* bits of device_nr */
+	unsigned int optional;	/* classes that are not reported missing */
+	int show_empty_slots;
+	int show_details;
+	int temperature_units;
+	int format;		/* one of OUTPUT_* */
+	unsigned int need;	/* the attributes read for it */
+	int first;		/* nothing was printed yet */
+	struct outbuf buf;	/* the sample being printed */
+	struct changes *changes;	/* with --changes-only */
+	struct recorder *recorder;
+	struct exporter *exporter;
+	struct shm_writer *publisher;
+	struct window *window;	/* with --summarize */
+	struct stats *stats;	/* with --stats */
+};
+
+/* set by SIGINT and SIGTERM while recording, serving, collecting,
+ * summarizing or counting with --stats, so the last block is written, the
+ * socket is removed, the last summary and the counts are printed */
+static volatile sig_atomic_t stop;
+
+static void show_devices(int device_nr, struct sample *s, struct output *out)
 {
-	struct list *batteries;
+	switch (device_nr) {
+		case BATTERY:
+			print_battery_information(&out->buf, s->batteries, s->n_batteries, out->show_empty_slots, out->show_details,
+						  out->changes);
+			break;
+		case AC_ADAPTER:
+			print_ac_adapter_information(&out->buf, s->adapters, s->n_adapters, out->show_empty_slots, out->changes);
+			break;
+		case THERMAL_ZONE:
+			print_thermal_information(&out->buf, s->zones, s->n_zones, out->show_empty_slots, out->temperature_units, out->show_details,
+						  out->changes);
+			break;
+		case COOLING_DEV:
+			print_cooling_information(&out->buf, s->coolers, s->n_coolers, out->show_empty_slots, out->changes);
+			break;
+		case HWMON:
+			print_hwmon_information(&out->buf, s->chips, s->n_chips, out->show_empty_slots, out->temperature_units,
+						out->show_details, out->changes);
+			break;
+	}
+}
 
-	batteries = find_devices(acpi_path, BATTERY, proc_interface);
-	print_battery_information(batteries, show_empty_slots, show_details);
-	free_devices(batteries);
+static long long now_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
 }
 
-static void do_show_ac_adapter(char *acpi_path, int show_empty_slots, int proc_interface)
+/* print the summary of the window, also of the samples since the last
+ * one when the program stops */
+static void emit_summary(struct output *out)
 {
-	struct list *ac_adapter;
+	if (out->format == OUTPUT_TEXT)
+		print_window_summary(&out->buf, window_summarize(out->window), out->temperature_units);
+	else
+		out_window(&out->buf, out->format, window_summarize(out->window), out->first);
+	out->first = FALSE;
+	out_flush(&out->buf, STDOUT_FILENO);
+}
 
-	ac_adapter = find_devices(acpi_path, AC_ADAPTER, proc_interface);
-	print_ac_adapter_information(ac_adapter, show_empty_slots);
-	free_devices(ac_adapter);
+/* print the classes of a sample with a single write, append it to the
+ * recording, publish it to the exporter or in shared memory, or add it to
+ * the window and print its summary when one is due */
+static void emit_sample(struct sample *s, unsigned int classes, long long time_ms, struct output *out)
+{
+	int i;
+	STATS_START(out->stats, start);
+
+	if (out->recorder) {
+		recorder_add(out->recorder, s, classes, time_ms);
+	} else if (out->exporter) {
+		exporter_publish(out->exporter, s, classes, time_ms);
+	} else if (out->publisher) {
+		shm_write(out->publisher, s, classes, time_ms);
+	} else if (out->window) {
+		if (window_add(out->window, s, time_ms))
+			emit_summary(out);
+	} else {
+		if (out->format == OUTPUT_TEXT) {
+			for (i = 0; i < DEVICE_CLASSES; i++)
+				if (classes & (1 << i))
+					show_devices(i, s, out);
+		} else {
+			out_sample(&out->buf, out->format, s, classes, time_ms, NULL, out->changes, out->first);
+		}
+		out->first = FALSE;
+		out_flush(&out->buf, STDOUT_FILENO);
+	}
+	STATS_LAP(out->stats, STATS_RENDER, start);
+}
+
+/* the library returns its errors, the program gives up on them */
+static void fail(char *acpi_path, char *func)
+{
+	if (errno == ENOMEM)
+		fprintf(stderr, "Out of memory. Could not allocate memory in %s.\n", func);
+	else
+		fprintf(stderr, "No ACPI support in kernel, or incorrect acpi_path (\"%s\").\n", acpi_path);
+	exit(1);
 }
 
-static void do_show_thermal(char *acpi_path, int show_empty_slots, int temperature_units, int show_details, int proc_interface) {
-	struct list *thermal;
+static void report_missing(unsigned int missing, int proc_interface, struct output *out)
+{
+	int i;
 
-	thermal = find_devices(acpi_path, THERMAL_ZONE, proc_interface);
-	print_thermal_information(thermal, show_empty_slots, temperature_units, show_details);
-	free_devices(thermal);
+	missing &= ~out->optional;
+	for (i = 0; i < DEVICE_CLASSES; i++)
+		if (missing & (1 << i))
+			fprintf(stderr, "No support for device type: %s\n", proc_interface ? device[i].proc : device[i].sys);
 }
 
-static void do_show_cooling(char *acpi_path, int show_empty_slots, int proc_interface) {
-	struct list *cooling;
+/* the last snapshot of a collector on the socket collector if one reads
+ * acpi_path, the devices themselves otherwise */
+static void do_show(struct arena *arena, struct batch *batch, char *acpi_path, int *show, int proc_interface,
+		    char *collector, struct output *out)
+{
+	struct sample s;
+	int fd, ret = -1;
 
-	cooling = find_devices(acpi_path, COOLING_DEV, proc_interface);
-	print_cooling_information(cooling, show_empty_slots);
-	free_devices(cooling);
+	fd = collector ? collector_query(collector, acpi_path, proc_interface) : -1;
+	if (fd >= 0) {
+		ret = find_snapshot(arena, &s, fd, show, out->need);
+		close(fd);
+	}
+	if (ret < 0 && find_devices(arena, &s, acpi_path, show, out->need, proc_interface, batch) < 0)
+		fail(acpi_path, "find_devices");
+	report_missing(s.missing, proc_interface, out);
+	emit_sample(&s, out->classes, now_ms(), out);
+	arena_reset(arena);
+}
+
+static void replayed(struct sample *s, unsigned int classes, long long time_ms, void *arg)
+{
+	struct output *out = arg;
+
+	emit_sample(s, classes & out->classes, time_ms, out);
+}
+
+/* watch mode keeps a descriptor per attribute open, allow as many as we may */
+static void raise_fd_limit(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+/* a sample every interval seconds; with an adaptive_max a device is only
+ * read again when it is due, after up to adaptive_max seconds */
+static int do_watch(struct batch *batch, char *acpi_path, double interval, double adaptive_max,
+		    int proc_interface, struct output *out)
+{
+	struct acpi *h;
+	struct sample *s;
+	struct timespec next;
+	long step = interval * 1e9;
+	long read, saved;
+	int first = TRUE;
+
+	raise_fd_limit();
+	h = snapshot_open(acpi_path, out->classes, proc_interface, out->need, batch);
+	if (!h)
+		fail(acpi_path, "watch_open");
+	if (adaptive_max > 0)
+		snapshot_adaptive(h, interval * 1000, adaptive_max * 1000);
+	s = snapshot_sample(h);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!stop) {
+		if (acpi_snapshot_refresh(h) < 0)
+			fail(acpi_path, "watch_read");
+		if (first)
+			report_missing(s->missing, proc_interface, out);
+		first = FALSE;
+		emit_sample(s, out->classes, now_ms(), out);
+
+		/* sleep until an absolute deadline so samples do not drift */
+		next.tv_sec += (next.tv_nsec + step) / 1000000000L;
+		next.tv_nsec = (next.tv_nsec + step) % 1000000000L;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !stop)
+			;
+	}
+	if (adaptive_max > 0) {
+		snapshot_files(h, &read, &saved);
+		fprintf(stderr, "Adaptive sampling read %ld files, %ld fewer (%.0f%%) than reading every device every %g seconds.\n",
+			read, saved, read + saved ? 100.0 * saved / (read + saved) : 0.0, interval);
+	}
+	acpi_close(h);
+	return 0;
+}
+
+/* print the last sample of acpi --publish name, and again every interval
+ * seconds if one is given; nothing but the clock is asked for it */
+static int do_from_shm(char *name, double interval, struct output *out)
+{
+	struct acpi *h;
+	struct sample *s;
+	struct timespec next;
+	long step = interval * 1e9;
+	long long time_ms;
+	unsigned int classes;
+
+	h = acpi_open_shared(name);
+	if (!h) {
+		fprintf(stderr, "Could not open the samples published as %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+	s = snapshot_sample(h);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	do {
+		if (acpi_snapshot_refresh(h) < 0) {
+			if (errno == ENOMEM)
+				fail(name, "do_from_shm");
+			if (errno == ESTALE)
+				fprintf(stderr, "Nothing is published as %s any more.\n", name);
+			else
+				fprintf(stderr, "Nothing was published as %s yet.\n", name);
+			acpi_close(h);
+			return 1;
+		}
+		classes = snapshot_shared(h, &time_ms);
+		emit_sample(s, classes & out->classes, time_ms, out);
+		if (interval <= 0)
+			break;
+		next.tv_sec += (next.tv_nsec + step) / 1000000000L;
+		next.tv_nsec = (next.tv_nsec + step) % 1000000000L;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && !stop)
+			;
+	} while (!stop);
+	acpi_close(h);
+	return 0;
+}
+
+/* print a sample when the kernel sends a uevent or notifies a change of an
+ * attribute, and every interval seconds if one is given */
+static int do_events(struct batch *batch, char *acpi_path, int *show, int event_fd, double interval, int proc_interface, struct output *out)
+{
+	struct watch *watches[DEVICE_CLASSES];
+	struct sample s;
+	struct pollfd *fds = NULL, *p;
+	struct timespec now, next;
+	unsigned int pending = 0, watched = 0, changed;
+	long step = interval * 1e9;
+	int first[DEVICE_CLASSES], count[DEVICE_CLASSES];
+	int i, j, n, n_fds, size = 0, timeout, reported = FALSE, closed;
+
+	raise_fd_limit();
+	if (event_fd < 0 && (event_fd = event_open()) < 0)
+		fprintf(stderr, "Could not listen for kernel uevents: %s\n", strerror(errno));
+	memset(&s, 0, sizeof(s));
+	for (i = 0; i < DEVICE_CLASSES; i++) {
+		watches[i] = show[i] ? watch_open(acpi_path, i, out->need, proc_interface, batch) : NULL;
+		if (show[i] && !watches[i])
+			fail(acpi_path, "watch_open");
+		if (watches[i])
+			watched |= 1 << i;
+	}
+	pending = watched;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	next.tv_sec += (next.tv_nsec + step) / 1000000000L;
+	next.tv_nsec = (next.tv_nsec + step) % 1000000000L;
+	while (!stop) {
+		/* only the classes that changed are read again, the others keep
+		 * their records */
+		if (pending) {
+			for (i = 0; i < DEVICE_CLASSES; i++)
+				if ((pending & (1 << i)) && watch_read(watches[i], &s) < 0)
+					fail(acpi_path, "watch_read");
+			if (!reported)
+				report_missing(s.missing, proc_interface, out);
+			reported = TRUE;
+			emit_sample(&s, watched, now_ms(), out);
+			pending = 0;
+		}
+
+		/* the event socket first, then the files of each class */
+		n_fds = 1;
+		for (i = 0; i < DEVICE_CLASSES; i++) {
+			first[i] = n_fds;
+			count[i] = watches[i] ? watch_fds(watches[i], NULL, 0) : 0;
+			n_fds += count[i];
+		}
+		if (n_fds > size) {
+			p = realloc(fds, n_fds * sizeof(struct pollfd));
+			if (!p) {
+				fprintf(stderr, "Out of memory. Could not allocate memory in do_events.\n");
+				exit(1);
+			}
+			fds = p;
+			size = n_fds;
+		}
+		fds[0].fd = event_fd;
+		fds[0].events = POLLIN;
+		fds[0].revents = 0;
+		for (i = 0; i < DEVICE_CLASSES; i++)
+			if (watches[i])
+				watch_fds(watches[i], fds + first[i], count[i]);
+
+		timeout = -1;
+		if (step > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_nsec - now.tv_nsec) / 1000000;
+			if (timeout < 0)
+				timeout = 0;
+		}
+		n = poll(fds, n_fds, timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Could not wait for events: %s\n", strerror(errno));
+			return 1;
+		}
+		if (n == 0) {
+			/* the periodic refresh, without catching up on missed ones */
+			pending = watched;
+			do {
+				next.tv_sec += (next.tv_nsec + step) / 1000000000L;
+				next.tv_nsec = (next.tv_nsec + step) % 1000000000L;
+			} while (next.tv_sec < now.tv_sec || (next.tv_sec == now.tv_sec && next.tv_nsec <= now.tv_nsec));
+			continue;
+		}
+
+		closed = FALSE;
+		if (fds[0].revents & POLLIN) {
+			changed = 0;
+			pending |= event_read(event_fd, &changed, &closed);
+			for (i = 0; i < DEVICE_CLASSES; i++)
+				if ((changed & (1 << i)) && watches[i])
+					watch_rescan(watches[i]);
+		} else if (fds[0].revents) {
+			closed = TRUE;
+		}
+		if (closed) {
+			/* the stand-in went away */
+			close(event_fd);
+			event_fd = -1;
+		}
+		for (i = 0; i < DEVICE_CLASSES; i++)
+			for (j = 0; j < count[i]; j++)
+				if (fds[first[i] + j].revents)
+					pending |= 1 << i;
+		pending &= watched;
+	}
+	for (i = 0; i < DEVICE_CLASSES; i++)
+		watch_close(watches[i]);
+	free(fds);
+	return 0;
+}
+
+/* answer the commands that ask from a snapshot taken every interval
+ * seconds */
+static int do_collect(struct batch *batch, char *acpi_path, double interval, struct collector *c)
+{
+	struct timespec now, next;
+	struct pollfd pfd;
+	long step = interval * 1e9;
+	int timeout;
+
+	if (collector_update(c, batch) < 0)
+		fail(acpi_path, "collector_update");
+	pfd.fd = collector_fd(c);
+	pfd.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!stop) {
+		next.tv_sec += (next.tv_nsec + step) / 1000000000L;
+		next.tv_nsec = (next.tv_nsec + step) % 1000000000L;
+		for (;;) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_nsec - now.tv_nsec) / 1000000;
+			if (timeout <= 0 || stop)
+				break;
+			if (poll(&pfd, 1, timeout) > 0)
+				collector_answer(c);
+		}
+		/* the commands keep getting the last snapshot until one can
+		 * be taken again */
+		if (!stop && collector_update(c, batch) < 0)
+			fprintf(stderr, "Could not take a snapshot of %s: %s\n", acpi_path, strerror(errno));
+	}
+	return 0;
+}
+
+static void stop_sampling(int sig)
+{
+	stop = TRUE;
+}
+
+/* <from>:<to> in seconds, either may be empty */
+static int parse_range(char *arg, long long *from_ms, long long *to_ms)
+{
+	char *end;
+
+	if (*arg != ':') {
+		*from_ms = strtod(arg, &end) * 1000;
+		if (end == arg || (*end && *end != ':'))
+			return -1;
+		arg = end;
+	}
+	if (*arg == ':' && *++arg) {
+		*to_ms = strtod(arg, &end) * 1000;
+		if (*end)
+			return -1;
+	}
+	return 0;
+}
+
+/* name=value pairs separated by commas, the names being those of struct
+ * dead_bands */
+static int parse_dead_bands(char *arg, struct dead_bands *bands)
+{
+	double *band;
+	char *end;
+
+	for (;;) {
+		if (!strncmp(arg, "charge=", 7))
+			band = &bands->charge;
+		else if (!strncmp(arg, "temperature=", 12))
+			band = &bands->temperature;
+		else if (!strncmp(arg, "rate=", 5))
+			band = &bands->rate;
+		else
+			return -1;
+		arg = strchr(arg, '=') + 1;
+		*band = strtod(arg, &end);
+		if (end == arg || *band < 0 || (*end && *end != ','))
+			return -1;
+		if (!*end)
+			return 0;
+		arg = end + 1;
+	}
 }
 
 static int version(void)
@@ -82,6 +528,7 @@ static int usage(char *argv[])
 {
 	printf(
 "Usage: acpi [OPTION]...\n"
+"  or:  acpi --roots [OPTION]... [ROOT|GLOB|-]...\n"
 "Shows information from the /proc filesystem, such as battery status or\n"
 "thermal information.\n"
 "\n"
@@ -89,15 +536,70 @@ static int usage(char *argv[])
 "  -i, --details            show additional details if available:\n"
 "                             - battery capacity information\n"
 "                             - temperature trip points\n"
+"                             - critical temperatures of hwmon sensors\n"
 "  -a, --ac-adapter         ac adapter information\n"
 "  -t, --thermal            thermal information\n"
 "  -c, --cooling            cooling information\n"
+"  -H, --hwmon              temperature and fan sensors of /sys/class/hwmon\n"
 "  -V, --everything         show every device, overrides above options\n"
 "  -s, --show-empty         show non-operational devices\n"
 "  -f, --fahrenheit         use fahrenheit as the temperature unit\n"
 "  -k, --kelvin             use kelvin as the temperature unit\n"
-"  -d, --directory <dir>    path to ACPI info (/sys/class resp. /proc/acpi)\n"
+"  -d, --directory <dir>    path to ACPI info (/sys/class resp. /proc/acpi), or a\n"
+"                           file written by --snapshot\n"
 "  -p, --proc               use old proc interface instead of new sys interface\n"
+"  -w, --watch <secs>       print a new sample every <secs> seconds\n"
+"  -A, --adaptive <max>     with --watch, read a device again after <secs> to\n"
+"                           <max> seconds depending on how fast it changes\n"
+"  -u, --io-uring           read the files in batches with io_uring if possible\n"
+"  -j, --jobs <n>           read up to <n> files at the same time\n"
+"  -D, --deadline <ms>      give up on reads that take longer than <ms>\n"
+"                           milliseconds, the values read before are shown\n"
+"                           with their age instead\n"
+"  -e, --events             print a new sample when the kernel reports a change,\n"
+"                           and every <secs> seconds if --watch is given\n"
+"  -E, --event-fd <fd>      read the uevents from <fd> instead of the kernel\n"
+"  -r, --record <file>      append the samples to <file> instead of printing them\n"
+"  -R, --replay <file>      print the samples recorded in <file>\n"
+"  -T, --range <from>:<to>  only replay the samples taken between the two times,\n"
+"                           in seconds since the epoch, either may be left out\n"
+"  -S, --serve <addr>       serve the values in the OpenMetrics format over HTTP on\n"
+"                           [<host>:]<port> or unix:<path>, sampled every <secs>\n"
+"                           seconds of --watch or on changes with --events\n"
+"  -o, --output <format>    print the raw values as json, ndjson or csv instead\n"
+"                           of text\n"
+"      --roots              read every ROOT like --directory, on all CPUs or --jobs\n"
+"                           threads, and print a result per root as ndjson or the\n"
+"                           --output format and a summary of all of them; GLOBs\n"
+"                           are expanded, - or no ROOT reads roots from stdin\n"
+"      --snapshot <file>    write every value of every device to <file> instead\n"
+"                           of printing them, for --directory to read later\n"
+"      --changes-only       print only the values that changed since they were\n"
+"                           last printed, and only the devices with such values\n"
+"      --dead-band <bands>  how far values may move before --changes-only prints\n"
+"                           them, as charge=<percent of the full capacity>,\n"
+"                           temperature=<degrees> and rate=<percent> of currents,\n"
+"                           powers and voltages; charge=1,temperature=0.5,rate=5\n"
+"                           if not given\n"
+"      --publish <name>     keep the last sample in the shared memory segment\n"
+"                           <name> for any number of readers, sampled every\n"
+"                           <secs> seconds of --watch or on changes with --events\n"
+"      --from-shm <name>    print the last sample of acpi --publish <name>, every\n"
+"                           <secs> seconds with --watch\n"
+"      --collect <socket>   answer the acpi commands run meanwhile from a snapshot\n"
+"                           taken every <secs> seconds of --watch, on the unix\n"
+"                           <socket> they look for in ACPI_COLLECTOR or\n"
+"                           " COLLECTOR_SOCKET "\n"
+"      --direct             read the devices even if a collector is running\n"
+"      --summarize <secs>   with --watch, --events or --replay, print every <secs>\n"
+"                           seconds the min, max, mean, p50, p95 and p99 of the\n"
+"                           power of each battery and the temperature of each\n"
+"                           thermal zone, and how long it was above each trip\n"
+"                           point, instead of the samples\n"
+"      --window <secs>      summarize the last <secs> seconds, up to %d times\n"
+"                           --summarize; as long as --summarize if not given\n"
+"      --stats              print the time, syscalls and bytes of every stage of a\n"
+"                           sample and every file read to stderr at the end\n"
 "  -h, --help               display this help and exit\n"
 "  -v, --version            output version information and exit\n"
 "\n"
@@ -106,7 +608,7 @@ static int usage(char *argv[])
 "The default unit of temperature is degrees celsius.\n"
 "\n"
 "Report bugs to Michael Meskes <meskes@debian.org>.\n"
-);
+, WINDOW_PANES);
 	return 1;
 }
 
@@ -118,6 +620,7 @@ static struct option long_options[] = {
 	{ "ac-adapter", 0, 0, 'a' }, 
 	{ "thermal", 0, 0, 't' }, 
 	{ "cooling", 0, 0, 'c' }, 
+	{ "hwmon", 0, 0, 'H' },
 	{ "show-empty", 0, 0, 's' }, 
 	{ "fahrenheit", 0, 0, 'f' }, 
 	{ "kelvin", 0, 0, 'k' }, 
@@ -125,6 +628,29 @@ static struct option long_options[] = {
 	{ "everything", 0, 0, 'V' }, 
 	{ "proc", 0, 0, 'p' }, 
 	{ "details", 0, 0, 'i' }, 
+	{ "watch", 1, 0, 'w' },
+	{ "adaptive", 1, 0, 'A' },
+	{ "io-uring", 0, 0, 'u' },
+	{ "jobs", 1, 0, 'j' },
+	{ "deadline", 1, 0, 'D' },
+	{ "events", 0, 0, 'e' },
+	{ "event-fd", 1, 0, 'E' },
+	{ "record", 1, 0, 'r' },
+	{ "replay", 1, 0, 'R' },
+	{ "range", 1, 0, 'T' },
+	{ "output", 1, 0, 'o' },
+	{ "serve", 1, 0, 'S' },
+	{ "stats", 0, 0, OPT_STATS },
+	{ "roots", 0, 0, OPT_ROOTS },
+	{ "snapshot", 1, 0, OPT_SNAPSHOT },
+	{ "changes-only", 0, 0, OPT_CHANGES },
+	{ "dead-band", 1, 0, OPT_DEAD_BAND },
+	{ "publish", 1, 0, OPT_PUBLISH },
+	{ "from-shm", 1, 0, OPT_FROM_SHM },
+	{ "collect", 1, 0, OPT_COLLECT },
+	{ "direct", 0, 0, OPT_DIRECT },
+	{ "summarize", 1, 0, OPT_SUMMARIZE },
+	{ "window", 1, 0, OPT_WINDOW },
 	{ 0, 0, 0, 0 }, 
 };
 
@@ -134,11 +660,39 @@ int main(int argc, char *argv[])
 	int show_ac_adapter = FALSE;
 	int show_thermal = FALSE;
 	int show_cooling = FALSE;
+	int show_hwmon = FALSE, hwmon_asked = FALSE;
 	int show_empty_slots = FALSE;
 	int show_details = FALSE;
 	int proc_interface = FALSE;
 	int temperature_units = TEMP_CELSIUS;
-	int ch, option_index;
+	double watch_interval = 0;
+	double adaptive_max = 0;
+	int use_io_uring = FALSE;
+	int jobs = 0;
+	int roots = FALSE;
+	char **root_list;
+	long cpus;
+	int deadline_ms = 0;
+	int events = FALSE;
+	int event_fd = -1;
+	char *record_path = NULL, *replay_path = NULL, *snapshot_path = NULL;
+	long long from_ms = LLONG_MIN, to_ms = LLONG_MAX;
+	int format = OUTPUT_TEXT;
+	char *serve_addr = NULL;
+	char *publish_name = NULL, *shm_name = NULL;
+	char *collect_path = NULL, *collector;
+	int direct = FALSE;
+	struct collector *c = NULL;
+	int changes_only = FALSE;
+	int count_stats = FALSE;
+	double summarize = 0, window = 0;
+	struct dead_bands bands = DEFAULT_DEAD_BANDS;
+	struct output out;
+	struct sigaction sa;
+	struct batch *batch;
+	int show[DEVICE_CLASSES];
+	struct arena arena = { NULL, NULL, 0 };
+	int ch, option_index, i, n, ret = 0;
 	char *acpi_path = strdup(ACPI_PATH_SYS);
 
 	if (!acpi_path) {
@@ -146,10 +700,10 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	while ((ch = getopt_long(argc, argv, "ipVbtashvfkcd:", long_options, &option_index)) != -1) {
+	while ((ch = getopt_long(argc, argv, "ipVbtashvfkcHued:w:A:j:D:E:r:R:T:o:S:", long_options, &option_index)) != -1) {
 		switch (ch) {
 			case 'V':
-				show_batteries = show_ac_adapter = show_thermal = show_cooling = show_details = TRUE;
+				show_batteries = show_ac_adapter = show_thermal = show_cooling = show_hwmon = show_details = TRUE;
 				break;
 			case 'b':
 				show_batteries = TRUE;
@@ -163,6 +717,9 @@ int main(int argc, char *argv[])
 			case 'c':
 				show_cooling = TRUE;
 				break;
+			case 'H':
+				show_hwmon = hwmon_asked = TRUE;
+				break;
 			case 's':
 				show_empty_slots = TRUE;
 				break;
@@ -195,28 +752,328 @@ int main(int argc, char *argv[])
 					return -1;
 				}
 				break;
+			case 'u':
+				use_io_uring = TRUE;
+				break;
+			case 'e':
+				events = TRUE;
+				break;
+			case 'E':
+				events = TRUE;
+				event_fd = atoi(optarg);
+				if (event_fd < 0 || fcntl(event_fd, F_SETFL, fcntl(event_fd, F_GETFL) | O_NONBLOCK) < 0) {
+					fprintf(stderr, "Invalid event descriptor: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'r':
+				record_path = optarg;
+				break;
+			case 'R':
+				replay_path = optarg;
+				break;
+			case 'T':
+				if (parse_range(optarg, &from_ms, &to_ms) < 0) {
+					fprintf(stderr, "Invalid time range: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'S':
+				serve_addr = optarg;
+				break;
+			case 'o':
+				format = output_format(optarg);
+				if (format < 0) {
+					fprintf(stderr, "Invalid output format: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case OPT_ROOTS:
+				roots = TRUE;
+				break;
+			case OPT_SNAPSHOT:
+				snapshot_path = optarg;
+				break;
+			case OPT_CHANGES:
+				changes_only = TRUE;
+				break;
+			case OPT_PUBLISH:
+				publish_name = optarg;
+				break;
+			case OPT_FROM_SHM:
+				shm_name = optarg;
+				break;
+			case OPT_COLLECT:
+				collect_path = optarg;
+				break;
+			case OPT_DIRECT:
+				direct = TRUE;
+				break;
+			case OPT_SUMMARIZE:
+				summarize = strtod(optarg, NULL);
+				if (summarize <= 0) {
+					fprintf(stderr, "Invalid summary interval: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case OPT_WINDOW:
+				window = strtod(optarg, NULL);
+				if (window <= 0) {
+					fprintf(stderr, "Invalid window: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case OPT_DEAD_BAND:
+				if (parse_dead_bands(optarg, &bands) < 0) {
+					fprintf(stderr, "Invalid dead-bands: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+#ifdef ENABLE_STATS
+				count_stats = TRUE;
+				break;
+#else
+				fprintf(stderr, "This acpi was built without --stats.\n");
+				return 1;
+#endif
+			case 'j':
+				jobs = atoi(optarg);
+				if (jobs < 1) {
+					fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'D':
+				deadline_ms = atoi(optarg);
+				if (deadline_ms < 1) {
+					fprintf(stderr, "Invalid deadline: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'w':
+				watch_interval = strtod(optarg, NULL);
+				if (watch_interval <= 0) {
+					fprintf(stderr, "Invalid watch interval: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'A':
+				adaptive_max = strtod(optarg, NULL);
+				if (adaptive_max <= 0) {
+					fprintf(stderr, "Invalid adaptive interval: %s\n", optarg);
+					return 1;
+				}
+				break;
 			case 'h':
 			default:
 				return usage(argv);
 		}
 	}
 
+	if (adaptive_max > 0 && (events || watch_interval <= 0 || adaptive_max < watch_interval)) {
+		fprintf(stderr, "--adaptive needs --watch with a shorter interval and no --events\n");
+		return 1;
+	}
+
 	/* if nothing was chosen, we show the battery information */
-	if (!show_batteries && !show_ac_adapter && !show_thermal && !show_cooling)
+	if (!show_batteries && !show_ac_adapter && !show_thermal && !show_cooling && !show_hwmon)
 		show_batteries = TRUE;
 
-	if (show_batteries) {
-		do_show_batteries(acpi_path, show_empty_slots, show_details, proc_interface);
+	show[BATTERY] = show_batteries;
+	show[AC_ADAPTER] = show_ac_adapter;
+	show[THERMAL_ZONE] = show_thermal;
+	show[COOLING_DEV] = show_cooling;
+	show[HWMON] = show_hwmon;
+
+	if (snapshot_path && (roots || events || watch_interval > 0 || record_path || replay_path || serve_addr)) {
+		fprintf(stderr, "--snapshot cannot be used with --roots, --watch, --events, --record, --replay or --serve\n");
+		return 1;
 	}
-	if (show_ac_adapter) {
-		do_show_ac_adapter(acpi_path, show_empty_slots, proc_interface);
+
+	if (changes_only && (roots || snapshot_path || record_path || serve_addr || publish_name)) {
+		fprintf(stderr, "--changes-only cannot be used with --roots, --snapshot, --record, --serve or --publish\n");
+		return 1;
 	}
-	if (show_thermal) {
-		do_show_thermal(acpi_path, show_empty_slots, temperature_units, show_details, proc_interface);
+
+	if (publish_name && (roots || snapshot_path || record_path || replay_path || serve_addr || shm_name)) {
+		fprintf(stderr, "--publish cannot be used with --roots, --snapshot, --record, --replay, --serve or --from-shm\n");
+		return 1;
 	}
-	if (show_cooling) {
-		do_show_cooling(acpi_path, show_empty_slots, proc_interface);
+
+	if (shm_name && (roots || snapshot_path || events || replay_path)) {
+		fprintf(stderr, "--from-shm cannot be used with --roots, --snapshot, --events or --replay\n");
+		return 1;
 	}
-	return 0;
+
+	if (collect_path && (roots || snapshot_path || events || adaptive_max > 0 || record_path || replay_path ||
+			     serve_addr || publish_name || shm_name || changes_only)) {
+		fprintf(stderr, "--collect cannot be used with --roots, --snapshot, --events, --adaptive, --record, --replay, --serve, --publish, --from-shm or --changes-only\n");
+		return 1;
+	}
+
+	if (window > 0 && summarize <= 0) {
+		fprintf(stderr, "--window needs --summarize\n");
+		return 1;
+	}
+
+	if (summarize > 0) {
+		if (roots || snapshot_path || record_path || serve_addr || publish_name || collect_path || changes_only) {
+			fprintf(stderr, "--summarize cannot be used with --roots, --snapshot, --record, --serve, --publish, --collect or --changes-only\n");
+			return 1;
+		}
+		if (!events && watch_interval <= 0 && !replay_path) {
+			fprintf(stderr, "--summarize needs --watch, --events or --replay\n");
+			return 1;
+		}
+		if (window <= 0)
+			window = summarize;
+		if (window < summarize || window > summarize * WINDOW_PANES) {
+			fprintf(stderr, "--window must be from one to %d times --summarize\n", WINDOW_PANES);
+			return 1;
+		}
+	}
+
+	/* a result per root, on as many threads as there are CPUs */
+	if (roots) {
+		if (events || watch_interval > 0 || record_path || replay_path || serve_addr || count_stats) {
+			fprintf(stderr, "--roots cannot be used with --watch, --events, --record, --replay, --serve or --stats\n");
+			return 1;
+		}
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n = fleet_roots(argv + optind, argc - optind, &root_list);
+		ret = fleet_run(root_list, n, show, proc_interface, format == OUTPUT_TEXT ? OUTPUT_NDJSON : format,
+				jobs ? jobs : cpus > 0 ? cpus : 1);
+		for (i = 0; i < n; i++)
+			free(root_list[i]);
+		free(root_list);
+		free(acpi_path);
+		return ret;
+	}
+
+	memset(&out, 0, sizeof(out));
+	for (i = 0; i < DEVICE_CLASSES; i++)
+		if (show[i])
+			out.classes |= 1 << i;
+	/* machines without sensors are common, -V does not complain about them */
+	if (!hwmon_asked)
+		out.optional = 1 << HWMON;
+	out.show_empty_slots = show_empty_slots;
+	out.show_details = show_details;
+	out.temperature_units = temperature_units;
+	out.format = format;
+	out.first = TRUE;
+	if (count_stats) {
+		out.stats = STATS_NEW();
+		if (!out.stats) {
+			fprintf(stderr, "Out of memory. Could not allocate memory in main.\n");
+			return 1;
+		}
+	}
+	if (changes_only) {
+		out.changes = changes_new(&bands);
+		if (!out.changes) {
+			fprintf(stderr, "Out of memory. Could not allocate memory in main.\n");
+			return 1;
+		}
+	}
+	if (summarize > 0) {
+		out.window = window_open(out.classes, window * 1000, summarize * 1000);
+		if (!out.window) {
+			fprintf(stderr, "Out of memory. Could not allocate memory in main.\n");
+			return 1;
+		}
+	}
+	if (record_path) {
+		out.recorder = recorder_open(record_path);
+		if (!out.recorder)
+			return 1;
+	}
+	if (serve_addr) {
+		out.exporter = exporter_open(serve_addr);
+		if (!out.exporter) {
+			recorder_close(out.recorder);
+			return 1;
+		}
+		if (!events && watch_interval <= 0)
+			watch_interval = DEFAULT_SERVE_INTERVAL;
+	}
+	if (publish_name) {
+		out.publisher = shm_writer_open(publish_name);
+		if (!out.publisher) {
+			fprintf(stderr, "Could not publish the samples as %s: %s\n", publish_name, strerror(errno));
+			return 1;
+		}
+		if (!events && watch_interval <= 0)
+			watch_interval = DEFAULT_SERVE_INTERVAL;
+	}
+	if (collect_path) {
+		c = collector_open(collect_path, acpi_path, proc_interface);
+		if (!c)
+			return 1;
+		if (watch_interval <= 0)
+			watch_interval = DEFAULT_SERVE_INTERVAL;
+	}
+	/* recordings, the exporter and readers of the shared memory keep
+	 * every value */
+	out.need = out.recorder || out.exporter || out.publisher || out.window ? ATTR_ALL :
+		output_needs(format, show_details);
+	if (out.recorder || out.exporter || out.publisher || c || out.window || adaptive_max > 0 || count_stats) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = stop_sampling;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+
+	if (replay_path) {
+		ret = replay(replay_path, from_ms, to_ms, replayed, &out) < 0;
+		if (out.window && window_pending(out.window))
+			emit_summary(&out);
+		recorder_close(out.recorder);
+		exporter_close(out.exporter);
+		out_free(&out.buf);
+		changes_free(out.changes);
+		window_close(out.window);
+		STATS_PRINT(out.stats, stderr);
+		STATS_FREE(out.stats);
+		return ret;
+	}
+
+	batch = batch_open(jobs ? jobs : DEFAULT_JOBS, use_io_uring, deadline_ms, out.stats);
+	if (snapshot_path) {
+		ret = snapshot_capture(acpi_path, proc_interface, batch, snapshot_path) < 0;
+		if (ret)
+			fprintf(stderr, "Could not take a snapshot of %s into %s: %s\n", acpi_path, snapshot_path,
+				strerror(errno));
+	} else if (c)
+		ret = do_collect(batch, acpi_path, watch_interval, c);
+	else if (shm_name)
+		ret = do_from_shm(shm_name, watch_interval, &out);
+	else if (events)
+		ret = do_events(batch, acpi_path, show, event_fd, watch_interval, proc_interface, &out);
+	else if (watch_interval > 0)
+		ret = do_watch(batch, acpi_path, watch_interval, adaptive_max, proc_interface, &out);
+	else {
+		/* unless one is named, only ask a collector whose socket is there */
+		collector = getenv("ACPI_COLLECTOR");
+		if (!collector && access(COLLECTOR_SOCKET, F_OK) == 0)
+			collector = COLLECTOR_SOCKET;
+		do_show(&arena, batch, acpi_path, show, proc_interface,
+			direct || !collector || !*collector ? NULL : collector, &out);
+	}
+	if (out.window && window_pending(out.window))
+		emit_summary(&out);
+	collector_close(c);
+	recorder_close(out.recorder);
+	exporter_close(out.exporter);
+	shm_writer_close(out.publisher);
+	out_free(&out.buf);
+	changes_free(out.changes);
+	window_close(out.window);
+	arena_free(&arena);
+	batch_close(batch);
+	STATS_PRINT(out.stats, stderr);
+	STATS_FREE(out.stats);
+	return ret;
 }
 
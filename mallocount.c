@@ -0,0 +1,83 @@
+/* count the allocations of a program, for make check
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Loaded with LD_PRELOAD, it counts the calls of malloc, calloc and
+ * realloc of all threads and writes their number so far to the file named
+ * by MALLOC_COUNT whenever the program gets SIGUSR1. The allocations are
+ * left to the allocator of glibc. */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static long count;
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(p, size);
+}
+
+/* only what is safe in a signal handler */
+static void report(int sig)
+{
+    long n = __atomic_load_n(&count, __ATOMIC_RELAXED);
+    const char *path = getenv("MALLOC_COUNT");
+    char buf[32];
+    char *p = buf + sizeof(buf);
+    int fd;
+
+    (void)sig;
+    *--p = '\n';
+    do {
+	*--p = '0' + n % 10;
+	n /= 10;
+    } while (n);
+    if (!path || (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+    if (write(fd, p, buf + sizeof(buf) - p) < 0)
+	unlink(path);
+    close(fd);
+}
+
+static void __attribute__ ((constructor)) setup(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = report;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+}
@@ -0,0 +1,1245 @@
+/* building the output of a sample in memory
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "acpi.h"
+#include "window.h"
+#include "output.h"
+
+#define OUTBUF_MIN_SIZE	4096
+#define BATTERY_DESC	"Battery"
+#define AC_ADAPTER_DESC "Adapter"
+#define THERMAL_DESC	"Thermal"
+#define COOLING_DESC	"Cooling"
+#define HWMON_DESC	"Hwmon"
+
+#define MIN_PRESENT_RATE 0.01
+#define MIN_CAPACITY	 0.01
+
+static void out_reserve(struct outbuf *ob, size_t size)
+{
+    char *data;
+    size_t new_size;
+
+    if (ob->len + size <= ob->size)
+	return;
+    new_size = ob->size ? ob->size : OUTBUF_MIN_SIZE;
+    while (new_size < ob->len + size)
+	new_size *= 2;
+    data = realloc(ob->data, new_size);
+    if (!data) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in out_printf.\n");
+	exit(1);
+    }
+    ob->data = data;
+    ob->size = new_size;
+}
+
+void out_printf(struct outbuf *ob, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    out_reserve(ob, 1);
+    va_start(ap, fmt);
+    n = vsnprintf(ob->data + ob->len, ob->size - ob->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+	return;
+    if ((size_t) n >= ob->size - ob->len) {
+	out_reserve(ob, n + 1);
+	va_start(ap, fmt);
+	vsnprintf(ob->data + ob->len, ob->size - ob->len, fmt, ap);
+	va_end(ap);
+    }
+    ob->len += n;
+}
+
+static void out_char(struct outbuf *ob, char c)
+{
+    out_reserve(ob, 1);
+    ob->data[ob->len++] = c;
+}
+
+static void out_string(struct outbuf *ob, const char *s)
+{
+    size_t n = strlen(s);
+
+    out_reserve(ob, n);
+    memcpy(ob->data + ob->len, s, n);
+    ob->len += n;
+}
+
+int out_flush(struct outbuf *ob, int fd)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    /* a pipe or file takes it all at once, only a signal or a full
+     * device leaves a rest */
+    while (done < ob->len) {
+	n = write(fd, ob->data + done, ob->len - done);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    ob->len = 0;
+	    return -1;
+	}
+	done += n;
+    }
+    ob->len = 0;
+    return 0;
+}
+
+void out_free(struct outbuf *ob)
+{
+    free(ob->data);
+    ob->data = NULL;
+    ob->len = ob->size = 0;
+}
+
+int output_format(char *name)
+{
+    if (!strcmp(name, "text"))
+	return OUTPUT_TEXT;
+    if (!strcmp(name, "json"))
+	return OUTPUT_JSON;
+    if (!strcmp(name, "csv"))
+	return OUTPUT_CSV;
+    if (!strcmp(name, "ndjson"))
+	return OUTPUT_NDJSON;
+    return -1;
+}
+
+/* the value of a field as it was last printed */
+struct last_field {
+    int have;
+    long long value;
+    char *str;			/* a copy */
+};
+
+/* the fields of a device in the order they are printed in */
+struct last_device {
+    int n;
+    struct last_field *fields;
+};
+
+struct changes {
+    struct dead_bands bands;
+    int n[DEVICE_CLASSES];
+    struct last_device *devices[DEVICE_CLASSES];
+};
+
+/* where the fields of the device being printed go */
+struct fields {
+    struct outbuf *ob;		/* NULL to only look for changes */
+    int format;
+    int depth;		/* of the device object for OUTPUT_JSON */
+    int first;		/* no field printed yet */
+    long long time_ms;
+    const char *root;		/* NULL if the sample is not of a root */
+    const char *class;
+    int index;
+    struct changes *changes;	/* NULL unless only changes are printed */
+    struct last_device *last;	/* of the device */
+    int field;			/* the number of its next field */
+    int changed;		/* how many of its fields changed */
+};
+
+static void *changes_alloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (!p) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in changes.\n");
+	exit(1);
+    }
+    return p;
+}
+
+struct changes *changes_new(const struct dead_bands *bands)
+{
+    struct changes *c = calloc(1, sizeof(struct changes));
+
+    if (!c)
+	return NULL;
+    c->bands = *bands;
+    return c;
+}
+
+void changes_free(struct changes *c)
+{
+    int device_nr, i, j;
+
+    if (!c)
+	return;
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	for (i = 0; i < c->n[device_nr]; i++) {
+	    for (j = 0; j < c->devices[device_nr][i].n; j++)
+		free(c->devices[device_nr][i].fields[j].str);
+	    free(c->devices[device_nr][i].fields);
+	}
+	free(c->devices[device_nr]);
+    }
+    free(c);
+}
+
+/* the fields of device i that follow are compared with its last ones */
+static void start_device(struct fields *f, int device_nr, int i)
+{
+    struct changes *c = f->changes;
+
+    f->field = 0;
+    f->changed = 0;
+    if (!c)
+	return;
+    if (i >= c->n[device_nr]) {
+	c->devices[device_nr] = changes_alloc(c->devices[device_nr], (i + 1) * sizeof(struct last_device));
+	memset(&c->devices[device_nr][c->n[device_nr]], 0, (i + 1 - c->n[device_nr]) * sizeof(struct last_device));
+	c->n[device_nr] = i + 1;
+    }
+    f->last = &c->devices[device_nr][i];
+}
+
+/* Whether the next field of a device is to be printed: always, unless
+ * only changes are. A number that moved less than band since it was last
+ * printed has not changed, so it cannot creep away unnoticed. A value
+ * that was never there is taken as missing before. */
+static int field_changed(struct fields *f, int have, long long value, const char *str, long long band)
+{
+    struct last_device *d = f->last;
+    struct last_field *l;
+    long long diff;
+
+    if (!f->changes)
+	return TRUE;
+    if (f->field >= d->n) {
+	d->fields = changes_alloc(d->fields, (f->field + 1) * sizeof(struct last_field));
+	memset(&d->fields[d->n], 0, (f->field + 1 - d->n) * sizeof(struct last_field));
+	d->n = f->field + 1;
+    }
+    l = &d->fields[f->field++];
+    diff = value > l->value ? value - l->value : l->value - value;
+    if (have == l->have && (!have || (str ? !strcmp(str, l->str) : diff == 0 || diff < band)))
+	return FALSE;
+    free(l->str);
+    l->str = NULL;
+    if (have && str) {
+	l->str = strdup(str);
+	if (!l->str)
+	    changes_alloc(NULL, 0);
+    }
+    l->have = have;
+    l->value = value;
+    f->changed++;
+    return TRUE;
+}
+
+static void json_string(struct outbuf *ob, const char *s)
+{
+    if (!s) {
+	out_string(ob, "null");
+	return;
+    }
+    out_char(ob, '"');
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\') {
+	    out_char(ob, '\\');
+	    out_char(ob, *s);
+	} else if ((unsigned char) *s < 0x20) {
+	    out_printf(ob, "\\u%04x", (unsigned char) *s);
+	} else {
+	    out_char(ob, *s);
+	}
+    }
+    out_char(ob, '"');
+}
+
+static void csv_string(struct outbuf *ob, const char *s)
+{
+    if (!strpbrk(s, ",\"\r\n")) {
+	out_string(ob, s);
+	return;
+    }
+    out_char(ob, '"');
+    for (; *s; s++) {
+	if (*s == '"')
+	    out_char(ob, '"');
+	out_char(ob, *s);
+    }
+    out_char(ob, '"');
+}
+
+/* a line break and indentation, only pretty printed JSON has them */
+static void json_break(struct outbuf *ob, int format, int depth)
+{
+    if (format != OUTPUT_JSON)
+	return;
+    out_char(ob, '\n');
+    while (depth-- > 0)
+	out_string(ob, "  ");
+}
+
+static void field_name(struct fields *f, const char *name)
+{
+    if (f->format == OUTPUT_CSV) {
+	if (f->root) {
+	    csv_string(f->ob, f->root);
+	    out_char(f->ob, ',');
+	}
+	out_printf(f->ob, "%lld,%s,%d,", f->time_ms, f->class, f->index);
+	out_string(f->ob, name);
+	out_char(f->ob, ',');
+	return;
+    }
+    if (!f->first)
+	out_char(f->ob, ',');
+    f->first = FALSE;
+    out_printf(f->ob, f->format == OUTPUT_JSON ? " \"%s\": " : "\"%s\":", name);
+}
+
+/* missing values are null in JSON, CSV leaves out their rows */
+static void field_str(struct fields *f, const char *name, const char *value)
+{
+    if (!field_changed(f, value != NULL, 0, value, 0) || !f->ob)
+	return;
+    if (f->format == OUTPUT_CSV) {
+	if (!value)
+	    return;
+	field_name(f, name);
+	csv_string(f->ob, value);
+	out_char(f->ob, '\n');
+	return;
+    }
+    field_name(f, name);
+    json_string(f->ob, value);
+}
+
+/* a number of JSON that is null if it is missing */
+static void json_num(struct outbuf *ob, int have, long long value)
+{
+    if (have)
+	out_printf(ob, "%lld", value);
+    else
+	out_string(ob, "null");
+}
+
+/* a number that only counts as changed once it moved by band */
+static void field_band(struct fields *f, const char *name, int have, long long value, long long band)
+{
+    if (!field_changed(f, have, value, NULL, band) || !f->ob)
+	return;
+    if (f->format == OUTPUT_CSV) {
+	if (!have)
+	    return;
+	field_name(f, name);
+	out_printf(f->ob, "%lld\n", value);
+	return;
+    }
+    field_name(f, name);
+    json_num(f->ob, have, value);
+}
+
+static void field_num(struct fields *f, const char *name, int have, long long value)
+{
+    field_band(f, name, have, value, 0);
+}
+
+/* only a device with values that missed their deadline has the fields,
+ * but they are compared for changes as missing otherwise */
+static void field_stale(struct fields *f, long stale_ms)
+{
+    if (stale_ms > 0 || f->changes)
+	field_num(f, "stale_ms", stale_ms > 0, stale_ms);
+    if (stale_ms == STALE_TIMED_OUT || f->changes)
+	field_num(f, "timed_out", stale_ms == STALE_TIMED_OUT, 1);
+}
+
+/* the band of a charge or energy: the dead-band of the full capacity, or
+ * of what the capacity in percent makes it */
+static long long charge_band(struct fields *f, struct battery_info *b, int full_id, long full, long now)
+{
+    if (!f->changes)
+	return 0;
+    if (HAS_ATTR(b, full_id))
+	return full * f->changes->bands.charge / 100;
+    if (HAS_ATTR(b, ATTR_CAPACITY) && b->capacity > 0)
+	return now * f->changes->bands.charge / b->capacity;
+    return 0;
+}
+
+static long long rate_band(struct fields *f, long value)
+{
+    return f->changes ? (value < 0 ? -value : value) * f->changes->bands.rate / 100 : 0;
+}
+
+static long long millidegrees(float temperature)
+{
+    double t = (double) temperature * 1000;
+
+    return t < 0 ? -(long long) (0.5 - t) : (long long) (t + 0.5);
+}
+
+static void battery_fields(struct fields *f, struct battery_info *b)
+{
+    field_str(f, "state", b->state);
+    field_str(f, "type", b->type);
+    field_band(f, "current_now", HAS_ATTR(b, ATTR_CURRENT_NOW), b->current_now, rate_band(f, b->current_now));
+    field_band(f, "power_now", HAS_ATTR(b, ATTR_POWER_NOW), b->power_now, rate_band(f, b->power_now));
+    field_band(f, "charge_now", HAS_ATTR(b, ATTR_CHARGE_NOW), b->charge_now,
+	       charge_band(f, b, ATTR_CHARGE_FULL, b->charge_full, b->charge_now));
+    field_band(f, "energy_now", HAS_ATTR(b, ATTR_ENERGY_NOW), b->energy_now,
+	       charge_band(f, b, ATTR_ENERGY_FULL, b->energy_full, b->energy_now));
+    field_band(f, "voltage_now", HAS_ATTR(b, ATTR_VOLTAGE_NOW), b->voltage_now, rate_band(f, b->voltage_now));
+    field_num(f, "charge_full", HAS_ATTR(b, ATTR_CHARGE_FULL), b->charge_full);
+    field_num(f, "energy_full", HAS_ATTR(b, ATTR_ENERGY_FULL), b->energy_full);
+    field_num(f, "charge_full_design", HAS_ATTR(b, ATTR_CHARGE_FULL_DESIGN), b->charge_full_design);
+    field_num(f, "energy_full_design", HAS_ATTR(b, ATTR_ENERGY_FULL_DESIGN), b->energy_full_design);
+    field_stale(f, b->stale_ms);
+}
+
+static void adapter_fields(struct fields *f, struct adapter_info *ac)
+{
+    field_str(f, "state", ac->state);
+    field_str(f, "type", ac->type);
+    field_num(f, "online", HAS_ATTR(ac, ATTR_ONLINE), ac->online);
+    field_stale(f, ac->stale_ms);
+}
+
+/* a JSON array of numbered parts of a device, like trip points; CSV names
+ * the parts like their sys files, JSON nests them and has them all if one
+ * changed */
+struct nested {
+    size_t mark;
+    int first_field;
+    int changed;
+    int first;			/* no element printed yet */
+};
+
+static void nested_open(struct fields *f, struct nested *n, const char *name)
+{
+    n->first = TRUE;
+    if (f->format == OUTPUT_CSV)
+	return;
+    n->mark = f->ob->len;
+    n->first_field = f->first;
+    n->changed = f->changed;
+    field_name(f, name);
+    out_char(f->ob, '[');
+}
+
+/* the start of an element, whose fields the caller prints */
+static void nested_element(struct fields *f, struct nested *n)
+{
+    if (!n->first)
+	out_char(f->ob, ',');
+    n->first = FALSE;
+    json_break(f->ob, f->format, f->depth + 1);
+}
+
+static void nested_close(struct fields *f, struct nested *n)
+{
+    if (f->format == OUTPUT_CSV)
+	return;
+    if (!n->first)
+	json_break(f->ob, f->format, f->depth);
+    out_char(f->ob, ']');
+    if (f->changes && f->changed == n->changed) {
+	f->ob->len = n->mark;
+	f->first = n->first_field;
+    }
+}
+
+static long long temperature_band(struct fields *f)
+{
+    return f->changes ? (long long) (f->changes->bands.temperature * 1000) : 0;
+}
+
+static void thermal_fields(struct fields *f, struct thermal_info *z)
+{
+    struct trip_point *t;
+    struct nested n;
+    char name[64];
+    int j;
+
+    field_str(f, "state", z->state);
+    field_str(f, "type", z->type);
+    field_band(f, "temperature", z->have & (ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE)),
+	       millidegrees(z->temperature), temperature_band(f));
+
+    nested_open(f, &n, "trip_points");
+    for (j = 0; j < z->n_trip; j++) {
+	t = &z->trip[j];
+	if (!t->type && !t->temp)
+	    continue;
+	if (f->format == OUTPUT_CSV) {
+	    snprintf(name, sizeof(name), "trip_point_%d_type", j);
+	    field_str(f, name, t->type);
+	    snprintf(name, sizeof(name), "trip_point_%d_temp", j);
+	    field_num(f, name, TRUE, millidegrees(t->temp));
+	    continue;
+	}
+	field_changed(f, t->type != NULL, 0, t->type, 0);
+	field_changed(f, TRUE, millidegrees(t->temp), NULL, 0);
+	nested_element(f, &n);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? "{ \"index\": %d, \"type\": " : "{\"index\":%d,\"type\":", j);
+	json_string(f->ob, t->type);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? ", \"temperature\": %lld }" : ",\"temperature\":%lld}",
+		   millidegrees(t->temp));
+    }
+    nested_close(f, &n);
+    field_stale(f, z->stale_ms);
+}
+
+static void cooling_fields(struct fields *f, struct cooling_info *c)
+{
+    field_str(f, "state", c->state);
+    field_str(f, "type", c->type);
+    field_num(f, "cur_state", HAS_ATTR(c, ATTR_CUR_STATE), c->cur_state);
+    field_num(f, "max_state", HAS_ATTR(c, ATTR_MAX_STATE), c->max_state);
+    field_stale(f, c->stale_ms);
+}
+
+/* the sensors are numbered like their files, from 1 on most chips */
+static void hwmon_fields(struct fields *f, struct hwmon_info *h)
+{
+    struct hwmon_sensor *t;
+    struct nested n;
+    char name[64];
+    int j, have_input, have_crit;
+    long long band = temperature_band(f);
+
+    field_str(f, "type", h->type);
+
+    nested_open(f, &n, "temperatures");
+    for (j = 0; j < h->n_temp; j++) {
+	t = &h->temp[j];
+	if (!t->have)
+	    continue;
+	have_input = HAS_ATTR(t, ATTR_TEMP_INPUT) != 0;
+	have_crit = HAS_ATTR(t, ATTR_TEMP_CRIT) != 0;
+	if (f->format == OUTPUT_CSV) {
+	    snprintf(name, sizeof(name), "temp%d_label", j);
+	    field_str(f, name, t->label);
+	    snprintf(name, sizeof(name), "temp%d_input", j);
+	    field_band(f, name, have_input, millidegrees(t->input), band);
+	    snprintf(name, sizeof(name), "temp%d_crit", j);
+	    field_num(f, name, have_crit, millidegrees(t->crit));
+	    continue;
+	}
+	field_changed(f, t->label != NULL, 0, t->label, 0);
+	field_changed(f, have_input, millidegrees(t->input), NULL, band);
+	field_changed(f, have_crit, millidegrees(t->crit), NULL, 0);
+	nested_element(f, &n);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? "{ \"index\": %d, \"label\": " : "{\"index\":%d,\"label\":", j);
+	json_string(f->ob, t->label);
+	out_string(f->ob, f->format == OUTPUT_JSON ? ", \"temperature\": " : ",\"temperature\":");
+	json_num(f->ob, have_input, millidegrees(t->input));
+	out_string(f->ob, f->format == OUTPUT_JSON ? ", \"crit\": " : ",\"crit\":");
+	json_num(f->ob, have_crit, millidegrees(t->crit));
+	out_string(f->ob, f->format == OUTPUT_JSON ? " }" : "}");
+    }
+    nested_close(f, &n);
+
+    nested_open(f, &n, "fans");
+    for (j = 0; j < h->n_fan; j++) {
+	t = &h->fan[j];
+	if (!t->have)
+	    continue;
+	if (f->format == OUTPUT_CSV) {
+	    snprintf(name, sizeof(name), "fan%d_input", j);
+	    field_num(f, name, TRUE, (long long) t->input);
+	    continue;
+	}
+	field_changed(f, TRUE, (long long) t->input, NULL, 0);
+	nested_element(f, &n);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? "{ \"index\": %d, \"rpm\": %lld }" : "{\"index\":%d,\"rpm\":%lld}",
+		   j, (long long) t->input);
+    }
+    nested_close(f, &n);
+    field_stale(f, h->stale_ms);
+}
+
+static int class_size(struct sample *s, int device_nr)
+{
+    switch (device_nr) {
+    case BATTERY:
+	return s->n_batteries;
+    case AC_ADAPTER:
+	return s->n_adapters;
+    case THERMAL_ZONE:
+	return s->n_zones;
+    case HWMON:
+	return s->n_chips;
+    default:
+	return s->n_coolers;
+    }
+}
+
+static void record_fields(struct fields *f, int device_nr, void *rec)
+{
+    switch (device_nr) {
+    case BATTERY:
+	battery_fields(f, rec);
+	break;
+    case AC_ADAPTER:
+	adapter_fields(f, rec);
+	break;
+    case THERMAL_ZONE:
+	thermal_fields(f, rec);
+	break;
+    case HWMON:
+	hwmon_fields(f, rec);
+	break;
+    default:
+	cooling_fields(f, rec);
+	break;
+    }
+}
+
+static void device_fields(struct fields *f, struct sample *s, int device_nr, int i)
+{
+    void *rec;
+
+    switch (device_nr) {
+    case BATTERY:
+	rec = &s->batteries[i];
+	break;
+    case AC_ADAPTER:
+	rec = &s->adapters[i];
+	break;
+    case THERMAL_ZONE:
+	rec = &s->zones[i];
+	break;
+    case HWMON:
+	rec = &s->chips[i];
+	break;
+    default:
+	rec = &s->coolers[i];
+	break;
+    }
+    start_device(f, device_nr, i);
+    record_fields(f, device_nr, rec);
+}
+
+/* the text lines of a device are printed if any of its fields changed */
+static int device_changed(struct changes *c, int device_nr, int i, void *rec)
+{
+    struct fields f;
+
+    if (!c)
+	return TRUE;
+    memset(&f, 0, sizeof(f));
+    f.format = OUTPUT_CSV;
+    f.changes = c;
+    start_device(&f, device_nr, i);
+    record_fields(&f, device_nr, rec);
+    return f.changed > 0;
+}
+
+static void csv_header(struct outbuf *ob, const char *root)
+{
+    out_string(ob, root ? "root,time,class,index,field,value\n" : "time,class,index,field,value\n");
+}
+
+/* the start of the JSON object of a sample */
+static void json_time(struct outbuf *ob, int format, long long time_ms, const char *root)
+{
+    out_printf(ob, format == OUTPUT_JSON ? "{\n  \"time\": %lld" : "{\"time\":%lld", time_ms);
+    if (root) {
+	out_char(ob, ',');
+	json_break(ob, format, 1);
+	out_string(ob, format == OUTPUT_JSON ? "\"root\": " : "\"root\":");
+	json_string(ob, root);
+    }
+}
+
+void out_sample(struct outbuf *ob, int format, struct sample *s, unsigned int classes, long long time_ms,
+		const char *root, struct changes *changes, int first)
+{
+    /* the name of a class is its JSON key, and singular in a CSV row */
+    static const char *json_keys[DEVICE_CLASSES] = {
+	"batteries", "ac_adapters", "thermal_zones", "cooling_devices", "hwmon"
+    };
+    static const char *csv_classes[DEVICE_CLASSES] = {
+	"battery", "ac_adapter", "thermal_zone", "cooling_device", "hwmon"
+    };
+    struct fields f;
+    size_t sample_mark, class_mark, device_mark;
+    int device_nr, i, n, shown, classes_shown = 0;
+
+    f.ob = ob;
+    f.format = format;
+    f.time_ms = time_ms;
+    f.root = root;
+    f.changes = changes;
+
+    if (format == OUTPUT_CSV) {
+	if (first)
+	    csv_header(ob, root);
+	for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	    if (!(classes & (1 << device_nr)))
+		continue;
+	    f.class = csv_classes[device_nr];
+	    n = class_size(s, device_nr);
+	    for (i = 0; i < n; i++) {
+		f.index = i;
+		device_fields(&f, s, device_nr, i);
+	    }
+	}
+	return;
+    }
+
+    /* with changes, what turns out to have none is taken back */
+    sample_mark = ob->len;
+    json_time(ob, format, time_ms, root);
+    for (device_nr = 0; device_nr < DEVICE_CLASSES; device_nr++) {
+	if (!(classes & (1 << device_nr)))
+	    continue;
+	class_mark = ob->len;
+	out_char(ob, ',');
+	json_break(ob, format, 1);
+	out_printf(ob, format == OUTPUT_JSON ? "\"%s\": [" : "\"%s\":[", json_keys[device_nr]);
+	n = class_size(s, device_nr);
+	for (shown = 0, i = 0; i < n; i++) {
+	    device_mark = ob->len;
+	    if (shown)
+		out_char(ob, ',');
+	    json_break(ob, format, 2);
+	    out_printf(ob, format == OUTPUT_JSON ? "{ \"index\": %d" : "{\"index\":%d", i);
+	    f.depth = 2;
+	    f.first = FALSE;
+	    device_fields(&f, s, device_nr, i);
+	    if (changes && !f.changed) {
+		ob->len = device_mark;
+		continue;
+	    }
+	    out_string(ob, format == OUTPUT_JSON ? " }" : "}");
+	    shown++;
+	}
+	if (shown)
+	    json_break(ob, format, 1);
+	out_char(ob, ']');
+	if (changes && !shown)
+	    ob->len = class_mark;
+	else
+	    classes_shown++;
+    }
+    if (changes && !classes_shown) {
+	ob->len = sample_mark;
+	return;
+    }
+    json_break(ob, format, 0);
+    out_string(ob, "}\n");
+}
+
+void out_error(struct outbuf *ob, int format, const char *root, long long time_ms, const char *error, int first)
+{
+    if (format == OUTPUT_CSV) {
+	if (first)
+	    csv_header(ob, root);
+	csv_string(ob, root);
+	out_printf(ob, ",%lld,,,error,", time_ms);
+	csv_string(ob, error);
+	out_char(ob, '\n');
+	return;
+    }
+    json_time(ob, format, time_ms, root);
+    out_char(ob, ',');
+    json_break(ob, format, 1);
+    out_string(ob, format == OUTPUT_JSON ? "\"error\": " : "\"error\":");
+    json_string(ob, error);
+    json_break(ob, format, 0);
+    out_string(ob, "}\n");
+}
+
+/* the statistics of a device, in the units of its records scaled by unit */
+static void summary_fields(struct fields *f, struct series_summary *sum, double unit)
+{
+    field_num(f, "samples", TRUE, sum->n);
+    field_num(f, "min", sum->n > 0, llround(sum->min * unit));
+    field_num(f, "max", sum->n > 0, llround(sum->max * unit));
+    field_num(f, "mean", sum->n > 0, llround(sum->mean * unit));
+    field_num(f, "p50", sum->n > 0, llround(sum->p50 * unit));
+    field_num(f, "p95", sum->n > 0, llround(sum->p95 * unit));
+    field_num(f, "p99", sum->n > 0, llround(sum->p99 * unit));
+}
+
+static void zone_summary_fields(struct fields *f, struct series_summary *sum)
+{
+    struct trip_point *t;
+    struct nested n;
+    char name[64];
+    int j;
+
+    summary_fields(f, sum, 1000);
+    nested_open(f, &n, "above_trip_points");
+    for (j = 0; j < sum->n_trip; j++) {
+	t = &sum->trip[j];
+	if (t->temp < MIN_TEMP)
+	    continue;
+	if (f->format == OUTPUT_CSV) {
+	    snprintf(name, sizeof(name), "above_trip_point_%d_ms", j);
+	    field_num(f, name, TRUE, sum->above_ms[j]);
+	    continue;
+	}
+	nested_element(f, &n);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? "{ \"index\": %d, \"type\": " : "{\"index\":%d,\"type\":", j);
+	json_string(f->ob, t->type);
+	out_printf(f->ob, f->format == OUTPUT_JSON ? ", \"temperature\": %lld, \"ms\": %lld }" :
+		   ",\"temperature\":%lld,\"ms\":%lld}", millidegrees(t->temp), sum->above_ms[j]);
+    }
+    nested_close(f, &n);
+}
+
+void out_window(struct outbuf *ob, int format, struct window_summary *sum, int first)
+{
+    struct fields f;
+    int i;
+
+    memset(&f, 0, sizeof(f));
+    f.ob = ob;
+    f.format = format;
+    f.time_ms = sum->time_ms;
+
+    if (format == OUTPUT_CSV) {
+	if (first)
+	    csv_header(ob, NULL);
+	f.class = "battery";
+	for (i = 0; i < sum->n_batteries; i++) {
+	    f.index = i;
+	    field_num(&f, "window_ms", TRUE, sum->window_ms);
+	    summary_fields(&f, &sum->batteries[i], 1);
+	}
+	f.class = "thermal_zone";
+	for (i = 0; i < sum->n_zones; i++) {
+	    f.index = i;
+	    field_num(&f, "window_ms", TRUE, sum->window_ms);
+	    zone_summary_fields(&f, &sum->zones[i]);
+	}
+	return;
+    }
+
+    json_time(ob, format, sum->time_ms, NULL);
+    out_printf(ob, format == OUTPUT_JSON ? ",\n  \"window_ms\": %lld" : ",\"window_ms\":%lld", sum->window_ms);
+    f.depth = 2;
+    if (sum->n_batteries) {
+	out_char(ob, ',');
+	json_break(ob, format, 1);
+	out_string(ob, format == OUTPUT_JSON ? "\"batteries\": [" : "\"batteries\":[");
+	for (i = 0; i < sum->n_batteries; i++) {
+	    if (i)
+		out_char(ob, ',');
+	    json_break(ob, format, 2);
+	    out_printf(ob, format == OUTPUT_JSON ? "{ \"index\": %d" : "{\"index\":%d", i);
+	    f.first = FALSE;
+	    summary_fields(&f, &sum->batteries[i], 1);
+	    out_string(ob, format == OUTPUT_JSON ? " }" : "}");
+	}
+	json_break(ob, format, 1);
+	out_char(ob, ']');
+    }
+    if (sum->n_zones) {
+	out_char(ob, ',');
+	json_break(ob, format, 1);
+	out_string(ob, format == OUTPUT_JSON ? "\"thermal_zones\": [" : "\"thermal_zones\":[");
+	for (i = 0; i < sum->n_zones; i++) {
+	    if (i)
+		out_char(ob, ',');
+	    json_break(ob, format, 2);
+	    out_printf(ob, format == OUTPUT_JSON ? "{ \"index\": %d" : "{\"index\":%d", i);
+	    f.first = FALSE;
+	    zone_summary_fields(&f, &sum->zones[i]);
+	    out_string(ob, format == OUTPUT_JSON ? " }" : "}");
+	}
+	json_break(ob, format, 1);
+	out_char(ob, ']');
+    }
+    json_break(ob, format, 0);
+    out_string(ob, "}\n");
+}
+
+/* a device some of whose values missed the deadline of their reads */
+static void print_stale(struct outbuf *ob, const char *desc, int i, long stale_ms)
+{
+    if (stale_ms > 0)
+	out_printf(ob, "%s %d: some values are %.1f seconds old\n", desc, i, stale_ms / 1000.0);
+    else if (stale_ms == STALE_TIMED_OUT)
+	out_printf(ob, "%s %d: some values timed out\n", desc, i);
+}
+
+unsigned int output_needs(int format, int show_details)
+{
+    if (format != OUTPUT_TEXT)
+	return ATTR_ALL;
+    if (show_details)
+	return ATTR_ALL | NEED_PRINTED;
+    return (ATTR_ALL & ~(ATTR_BIT(ATTR_CHARGE_FULL) | ATTR_BIT(ATTR_ENERGY_FULL) |
+			 ATTR_BIT(ATTR_CHARGE_FULL_DESIGN) | ATTR_BIT(ATTR_ENERGY_FULL_DESIGN))) |
+	ATTR_BIT(ATTR_CAPACITY) | NEED_PRINTED;
+}
+
+/* values are printed in mA, mAh, mV etc. like they were in /proc */
+static int milli_value(struct battery_info *b, int id, long value)
+{
+    return HAS_ATTR(b, id) ? (int) (value / 1000) : -1;
+}
+
+void print_battery_information(struct outbuf *ob, struct battery_info *batteries, int n, int show_empty_slots, int show_capacity,
+			       struct changes *changes)
+{
+    struct battery_info *b;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	int remaining_capacity, remaining_energy, present_rate, voltage;
+	int design_capacity, design_capacity_unit, last_capacity, last_capacity_unit;
+	int hours, minutes, seconds;
+	int percentage;
+	char *state, *poststr;
+	char capacity_unit[4] = "mAh";
+
+	b = &batteries[i];
+	if (!device_changed(changes, BATTERY, i, b))
+	    continue;
+	remaining_capacity = milli_value(b, ATTR_CHARGE_NOW, b->charge_now);
+	remaining_energy = milli_value(b, ATTR_ENERGY_NOW, b->energy_now);
+	if (HAS_ATTR(b, ATTR_CURRENT_NOW))
+	    present_rate = milli_value(b, ATTR_CURRENT_NOW, b->current_now);
+	else
+	    present_rate = milli_value(b, ATTR_POWER_NOW, b->power_now);
+	voltage = milli_value(b, ATTR_VOLTAGE_NOW, b->voltage_now);
+	if (!voltage) /* zero voltage makes all calculations mood */
+	    voltage = -1;
+	design_capacity = milli_value(b, ATTR_CHARGE_FULL_DESIGN, b->charge_full_design);
+	design_capacity_unit = milli_value(b, ATTR_ENERGY_FULL_DESIGN, b->energy_full_design);
+	last_capacity = milli_value(b, ATTR_CHARGE_FULL, b->charge_full);
+	last_capacity_unit = milli_value(b, ATTR_ENERGY_FULL, b->energy_full);
+
+	state = b->state;
+	if (!state && (b->have & (ATTR_BIT(ATTR_CHARGE_NOW) | ATTR_BIT(ATTR_ENERGY_NOW) |
+				  ATTR_BIT(ATTR_CHARGE_FULL) | ATTR_BIT(ATTR_ENERGY_FULL))))
+	    state = "available";
+
+	if (!state) {
+	    if (show_empty_slots) 
+		out_printf(ob, "%s %d: slot empty\n", BATTERY_DESC, i);
+	    continue;
+	}
+
+	/* convert energy values (in mWh) to charge values (in mAh) if needed and possible */
+	if (last_capacity_unit != -1 && last_capacity == -1) {
+	    if (voltage != -1) {
+		last_capacity = last_capacity_unit * 1000 / voltage;
+	    } else {
+		last_capacity = last_capacity_unit;
+		strcpy(capacity_unit, "mWh");
+	    }
+	}
+	if (design_capacity_unit != -1 && design_capacity == -1) {
+	    if (voltage != -1) {
+		design_capacity = design_capacity_unit * 1000 / voltage;
+	    } else {
+		design_capacity = design_capacity_unit;
+		strcpy(capacity_unit, "mWh");
+	    }
+	}
+	if (remaining_energy != -1 && remaining_capacity == -1) {
+	    if (voltage != -1) {
+		remaining_capacity = remaining_energy * 1000 / voltage;
+		present_rate = present_rate * 1000 / voltage;
+	    } else {
+		remaining_capacity = remaining_energy;
+	    }
+	}
+	if ((last_capacity == -1 || remaining_capacity == -1) && HAS_ATTR(b, ATTR_CAPACITY))
+	    percentage = b->capacity;	/* the full or remaining capacity was not read */
+	else if (last_capacity < MIN_CAPACITY)
+	    percentage = 0;
+	else
+	    percentage = remaining_capacity * 100 / last_capacity;
+
+	if (percentage > 100)
+	    percentage = 100;
+
+	out_printf(ob, "%s %d: %s, %d%%", BATTERY_DESC, i, state, percentage);
+
+	if (present_rate == -1) {
+	    poststr = "rate information unavailable";
+	    seconds = -1;
+	} else if (remaining_capacity == -1 || (last_capacity == -1 && !strcasecmp(state, "charging"))) {
+	    /* the values did not come, print_stale says if a read timed out */
+	    poststr = NULL;
+	    seconds = -1;
+	} else if (!strcasecmp(state, "charging")) {
+	    if (present_rate > MIN_PRESENT_RATE) {
+		seconds = 3600 * (last_capacity - remaining_capacity) / present_rate;
+		poststr = " until charged";
+	    } else {
+		poststr = "charging at zero rate - will never fully charge.";
+		seconds = -1;
+	    }
+	} else if (!strcasecmp(state, "discharging")) {
+	    if (present_rate > MIN_PRESENT_RATE) {
+		seconds = 3600 * remaining_capacity / present_rate;
+		poststr = " remaining";
+	    } else {
+		poststr = "discharging at zero rate - will never fully discharge.";
+		seconds = -1;
+	    }
+	} else {
+	    poststr = NULL;
+	    seconds = -1;
+	}
+
+	if (seconds > 0) {
+	    hours = seconds / 3600;
+	    seconds -= 3600 * hours;
+	    minutes = seconds / 60;
+	    seconds -= 60 * minutes;
+	    out_printf(ob, ", %02d:%02d:%02d%s", hours, minutes, seconds, poststr);
+	} else if (poststr != NULL) {
+	    out_printf(ob, ", %s", poststr);
+	}
+
+	out_printf(ob, "\n");
+
+	if (show_capacity && design_capacity > 0) {
+	    if (last_capacity <= 100) {
+		/* some broken systems just give a percentage here */
+		percentage = last_capacity;
+		last_capacity = percentage * design_capacity / 100;
+	    } else {
+		percentage = last_capacity * 100 / design_capacity;
+	    }
+	    if (percentage > 100)
+		percentage = 100;
+
+	    out_printf(ob, "%s %d: design capacity %d %s, last full capacity %d %s = %d%%\n",
+		 BATTERY_DESC, i, design_capacity, capacity_unit, last_capacity, capacity_unit, percentage);
+	}
+	print_stale(ob, BATTERY_DESC, i, b->stale_ms);
+    }
+}
+
+void print_ac_adapter_information(struct outbuf *ob, struct adapter_info *adapters, int n, int show_empty_slots,
+				  struct changes *changes)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (!device_changed(changes, AC_ADAPTER, i, &adapters[i]))
+	    continue;
+	if (!adapters[i].state) {
+	    if (show_empty_slots) 
+		out_printf(ob, "%s %d: slot empty\n", AC_ADAPTER_DESC, i);
+	} else  {
+	    out_printf(ob, "%s %d: %s\n", AC_ADAPTER_DESC, i, adapters[i].state);
+	    print_stale(ob, AC_ADAPTER_DESC, i, adapters[i].stale_ms);
+	}
+    }
+}
+
+static double get_real_temp(float temperature, char **scale, int temp_units)
+{
+	double real_temp = (double) temperature;
+
+	switch (temp_units) {
+	case TEMP_CELSIUS:
+	    *scale = "degrees C";
+	    break;
+	case TEMP_FAHRENHEIT:
+	    real_temp = (real_temp * 1.8) + 32;
+	    *scale = "degrees F";
+	    break;
+	case TEMP_KELVIN:
+	default:
+	    real_temp += ABSOLUTE_ZERO;
+	    *scale = "kelvin";
+	    break;
+	}
+	return (real_temp);
+}
+
+/* the hottest trip point the zone has reached */
+static struct trip_point *find_trip_point(struct thermal_info *z)
+{
+    int lo = 0, hi = z->n_by_temp, mid;
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (z->by_temp[mid]->temp <= z->temperature)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo ? z->by_temp[lo - 1] : NULL;
+}
+
+void print_thermal_information(struct outbuf *ob, struct thermal_info *zones, int n, int show_empty_slots, int temp_units, int show_trip_points,
+			       struct changes *changes)
+{
+    struct thermal_info *z;
+    struct trip_point *trip;
+    char *state, *scale;
+    double real_temp;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+	z = &zones[i];
+	if (!device_changed(changes, THERMAL_ZONE, i, z))
+	    continue;
+	state = z->state;
+	if (!state && (z->have & (ATTR_BIT(ATTR_TYPE) | ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE))))
+	    state = "ok";
+
+	trip = find_trip_point(z);
+	if (trip)
+	    state = trip->type;
+	if (!state) {
+	    if (show_empty_slots) 
+		out_printf(ob, "%s %d: slot empty\n", THERMAL_DESC, i);
+	    continue;
+	}
+	real_temp = get_real_temp(z->temperature, &scale, temp_units);
+	out_printf(ob, "%s %d: %s, %.1f %s\n", THERMAL_DESC, i, state, real_temp, scale);
+	if (show_trip_points) {
+	    for (j = 0; j <= z->trip_points; j++)
+	    {
+		if (z->trip[j].temp >= MIN_TEMP) {
+		    real_temp = get_real_temp(z->trip[j].temp, &scale, temp_units);
+		    out_printf(ob, "%s %d: trip point %d switches to mode %s at temperature %.1f %s\n",
+			THERMAL_DESC, i, j, z->trip[j].type, real_temp, scale);
+		}
+	    }
+	}
+	print_stale(ob, THERMAL_DESC, i, z->stale_ms);
+    }
+}
+
+void print_cooling_information(struct outbuf *ob, struct cooling_info *coolers, int n, int show_empty_slots,
+			       struct changes *changes)
+{
+    struct cooling_info *c;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	c = &coolers[i];
+	if (!device_changed(changes, COOLING_DEV, i, c))
+	    continue;
+	if (!c->state && !c->type) {
+	    if (show_empty_slots)
+		out_printf(ob, "%s %d: slot empty\n", COOLING_DESC, i);
+	    continue;
+	} else if (c->state) {
+	    out_printf(ob, "%s %d: %s\n", COOLING_DESC, i, c->state);
+	} else if (c->cur_state < 0 || c->max_state < 0) {
+	    out_printf(ob, "%s %d: %s no state information available\n", COOLING_DESC, i, c->type);
+	} else {
+	    out_printf(ob, "%s %d: %s %d of %d\n", COOLING_DESC, i, c->type, c->cur_state, c->max_state);
+	}
+	print_stale(ob, COOLING_DESC, i, c->stale_ms);
+    }
+}
+
+void print_hwmon_information(struct outbuf *ob, struct hwmon_info *chips, int n, int show_empty_slots, int temp_units,
+			     int show_crit, struct changes *changes)
+{
+    struct hwmon_info *h;
+    struct hwmon_sensor *t;
+    char *name, *scale, label[32];
+    double real_temp;
+    int i, j, shown;
+
+    for (i = 0; i < n; i++) {
+	h = &chips[i];
+	if (!device_changed(changes, HWMON, i, h))
+	    continue;
+	name = h->type ? h->type : "unknown";
+	shown = 0;
+	for (j = 0; j < h->n_temp; j++) {
+	    t = &h->temp[j];
+	    if (!HAS_ATTR(t, ATTR_TEMP_INPUT))
+		continue;
+	    snprintf(label, sizeof(label), "temp%d", j);
+	    real_temp = get_real_temp(t->input, &scale, temp_units);
+	    out_printf(ob, "%s %d: %s %s, %.1f %s\n", HWMON_DESC, i, name, t->label ? t->label : label, real_temp, scale);
+	    if (show_crit && HAS_ATTR(t, ATTR_TEMP_CRIT)) {
+		real_temp = get_real_temp(t->crit, &scale, temp_units);
+		out_printf(ob, "%s %d: %s %s critical at temperature %.1f %s\n", HWMON_DESC, i, name,
+			   t->label ? t->label : label, real_temp, scale);
+	    }
+	    shown++;
+	}
+	for (j = 0; j < h->n_fan; j++) {
+	    if (!HAS_ATTR(&h->fan[j], ATTR_FAN_INPUT))
+		continue;
+	    out_printf(ob, "%s %d: %s fan%d, %.0f RPM\n", HWMON_DESC, i, name, j, h->fan[j].input);
+	    shown++;
+	}
+	if (!shown && show_empty_slots)
+	    out_printf(ob, "%s %d: %s no sensors\n", HWMON_DESC, i, name);
+	print_stale(ob, HWMON_DESC, i, h->stale_ms);
+    }
+}
+
+void print_window_summary(struct outbuf *ob, struct window_summary *sum, int temp_units)
+{
+    struct series_summary *b, *z;
+    struct trip_point *t;
+    char *scale;
+    double secs = sum->window_ms / 1000.0;
+    int i, j;
+
+    for (i = 0; i < sum->n_batteries; i++) {
+	b = &sum->batteries[i];
+	if (!b->n) {
+	    out_printf(ob, "%s %d: no power readings over %.1f seconds\n", BATTERY_DESC, i, secs);
+	    continue;
+	}
+	out_printf(ob, "%s %d: power over %.1f seconds min %.2f, mean %.2f, max %.2f, p50 %.2f, p95 %.2f, p99 %.2f W\n",
+		   BATTERY_DESC, i, secs, b->min / 1e6, b->mean / 1e6, b->max / 1e6, b->p50 / 1e6, b->p95 / 1e6,
+		   b->p99 / 1e6);
+    }
+    for (i = 0; i < sum->n_zones; i++) {
+	z = &sum->zones[i];
+	if (!z->n) {
+	    out_printf(ob, "%s %d: no temperature readings over %.1f seconds\n", THERMAL_DESC, i, secs);
+	    continue;
+	}
+	/* the units are linear, so are the statistics in them */
+	out_printf(ob, "%s %d: over %.1f seconds min %.1f, mean %.1f, max %.1f, p50 %.1f, p95 %.1f, p99 %.1f",
+		   THERMAL_DESC, i, secs, get_real_temp(z->min, &scale, temp_units),
+		   get_real_temp(z->mean, &scale, temp_units), get_real_temp(z->max, &scale, temp_units),
+		   get_real_temp(z->p50, &scale, temp_units), get_real_temp(z->p95, &scale, temp_units),
+		   get_real_temp(z->p99, &scale, temp_units));
+	out_printf(ob, " %s\n", scale);
+	for (j = 0; j < z->n_trip; j++) {
+	    t = &z->trip[j];
+	    if (t->temp < MIN_TEMP)
+		continue;
+	    out_printf(ob, "%s %d: %.1f of %.1f seconds above trip point %d (%s at %.1f %s)\n", THERMAL_DESC, i,
+		       z->above_ms[j] / 1000.0, secs, j, t->type ? t->type : "unknown",
+		       get_real_temp(t->temp, &scale, temp_units), scale);
+	}
+    }
+}
@@ -0,0 +1,139 @@
+/* building the output of a sample in memory
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+
+#define OUTPUT_TEXT	0
+#define OUTPUT_JSON	1
+#define OUTPUT_CSV	2
+#define OUTPUT_NDJSON	3
+
+/* a sample is printed into a buffer and written with a single write(), a
+ * zero initialized buffer is empty and ready to use */
+struct outbuf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/* how far a number may move before --changes-only prints it again */
+struct dead_bands {
+	double charge;		/* percentage points of the full capacity */
+	double temperature;	/* degrees */
+	double rate;		/* percent of a current, power or voltage */
+};
+
+/* the values of every device as they were last printed */
+struct changes;
+
+struct sample;
+struct battery_info;
+struct adapter_info;
+struct thermal_info;
+struct cooling_info;
+struct hwmon_info;
+struct window_summary;
+
+/* append formatted text to a buffer
+ *
+ * Pre: ob != NULL
+ */
+void out_printf(struct outbuf *ob, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+/* write out and empty a buffer, its memory is kept for the next sample
+ *
+ * Pre: ob != NULL
+ * Post: returns 0, or -1 if the write failed
+ */
+int out_flush(struct outbuf *ob, int fd);
+
+/* release the memory of a buffer
+ *
+ * Pre: ob != NULL
+ */
+void out_free(struct outbuf *ob);
+
+/* find an output format by name
+ *
+ * Post: returns one of OUTPUT_*, or -1 if there is no such format
+ */
+int output_format(char *name);
+
+/* start printing only the fields that changed
+ *
+ * Post: returns NULL if there is no memory; the samples printed after it
+ *       exit if they run out of it, like out_printf does
+ */
+struct changes *changes_new(const struct dead_bands *bands);
+
+void changes_free(struct changes *c);
+
+/* append the classes of a sample, set as bits of device_nr, with their raw
+ * values in micro units and millidegrees, and the root it was read from
+ * unless that is NULL; with changes only the fields, devices and classes
+ * that changed since they were printed with it, and nothing at all if
+ * none did
+ *
+ * Pre: format is OUTPUT_JSON, OUTPUT_CSV or OUTPUT_NDJSON
+ * Post: the CSV header is added if first is set
+ */
+void out_sample(struct outbuf *ob, int format, struct sample *s, unsigned int classes, long long time_ms,
+		const char *root, struct changes *changes, int first);
+
+/* append why a root could not be read, in place of its sample
+ *
+ * Pre: like out_sample, root != NULL
+ */
+void out_error(struct outbuf *ob, int format, const char *root, long long time_ms, const char *error, int first);
+
+/* append a summary of window.h, with its statistics in micro units and
+ * millidegrees like out_sample
+ *
+ * Pre: like out_sample
+ */
+void out_window(struct outbuf *ob, int format, struct window_summary *sum, int first);
+
+/* the attributes an output format reads, for find_devices and watch_open;
+ * show_details is -i of the text lines */
+unsigned int output_needs(int format, int show_details);
+
+/* append the text lines of a class, with changes only those of the
+ * devices that changed */
+void print_battery_information(struct outbuf *ob, struct battery_info *batteries, int n, int show_empty_slots, int show_capacity,
+			       struct changes *changes);
+
+void print_ac_adapter_information(struct outbuf *ob, struct adapter_info *adapters, int n, int show_empty_slots,
+				  struct changes *changes);
+
+void print_thermal_information(struct outbuf *ob, struct thermal_info *zones, int n, int show_empty_slots, int temp_units, int show_trip_points,
+			       struct changes *changes);
+
+void print_cooling_information(struct outbuf *ob, struct cooling_info *coolers, int n, int show_empty_slots,
+			       struct changes *changes);
+
+/* append the text lines of a summary of window.h */
+void print_window_summary(struct outbuf *ob, struct window_summary *sum, int temp_units);
+
+/* show_crit is -i, which adds the critical temperatures of the sensors */
+void print_hwmon_information(struct outbuf *ob, struct hwmon_info *chips, int n, int show_empty_slots, int temp_units,
+			     int show_crit, struct changes *changes);
+
+#endif
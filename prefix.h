@@ -0,0 +1,91 @@
+/* names of the internals of libacpi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _PREFIX_H
+#define _PREFIX_H
+
+/* The shared library only exports acpi_*, but a program linking the
+ * static one sees every global of its objects. The internal ones are
+ * given the prefix libacpi_ here, so they do not clash with the names of
+ * the program; the sources keep using the short names. */
+#define ac_adapter_files		libacpi_ac_adapter_files
+#define archive_add_device		libacpi_archive_add_device
+#define archive_add_value		libacpi_archive_add_value
+#define archive_classes			libacpi_archive_classes
+#define archive_device			libacpi_archive_device
+#define archive_devices			libacpi_archive_devices
+#define archive_map			libacpi_archive_map
+#define archive_proc			libacpi_archive_proc
+#define archive_unmap			libacpi_archive_unmap
+#define archive_value			libacpi_archive_value
+#define archive_write			libacpi_archive_write
+#define archive_write_fd		libacpi_archive_write_fd
+#define archive_writer_free		libacpi_archive_writer_free
+#define archive_writer_new		libacpi_archive_writer_new
+#define arena_alloc			libacpi_arena_alloc
+#define arena_free			libacpi_arena_free
+#define arena_reset			libacpi_arena_reset
+#define arena_strndup			libacpi_arena_strndup
+#define batch_close			libacpi_batch_close
+#define batch_deadline			libacpi_batch_deadline
+#define batch_open			libacpi_batch_open
+#define batch_read			libacpi_batch_read
+#define batch_stats			libacpi_batch_stats
+#define battery_files			libacpi_battery_files
+#define cooling_files			libacpi_cooling_files
+#define device				libacpi_device
+#define find_devices			libacpi_find_devices
+#define find_snapshot			libacpi_find_snapshot
+#define finish_records			libacpi_finish_records
+#define hwmon_files			libacpi_hwmon_files
+#define list_append			libacpi_list_append
+#define list_free			libacpi_list_free
+#define list_length			libacpi_list_length
+#define list_new			libacpi_list_new
+#define list_next			libacpi_list_next
+#define shm_read			libacpi_shm_read
+#define shm_reader_close		libacpi_shm_reader_close
+#define shm_reader_open			libacpi_shm_reader_open
+#define shm_write			libacpi_shm_write
+#define shm_writer_close		libacpi_shm_writer_close
+#define shm_writer_open			libacpi_shm_writer_open
+#define snapshot_adaptive		libacpi_snapshot_adaptive
+#define snapshot_capture		libacpi_snapshot_capture
+#define snapshot_capture_fd		libacpi_snapshot_capture_fd
+#define snapshot_files			libacpi_snapshot_files
+#define snapshot_open			libacpi_snapshot_open
+#define snapshot_sample			libacpi_snapshot_sample
+#define snapshot_shared			libacpi_snapshot_shared
+#define stats_clock			libacpi_stats_clock
+#define stats_file			libacpi_stats_file
+#define stats_free			libacpi_stats_free
+#define stats_new			libacpi_stats_new
+#define stats_print			libacpi_stats_print
+#define stats_stage			libacpi_stats_stage
+#define thermal_files			libacpi_thermal_files
+#define uring_close			libacpi_uring_close
+#define uring_open			libacpi_uring_open
+#define uring_read			libacpi_uring_read
+#define watch_adaptive			libacpi_watch_adaptive
+#define watch_close			libacpi_watch_close
+#define watch_fds			libacpi_watch_fds
+#define watch_files			libacpi_watch_files
+#define watch_open			libacpi_watch_open
+#define watch_read			libacpi_watch_read
+#define watch_rescan			libacpi_watch_rescan
+
+#endif
@@ -0,0 +1,828 @@
+/* a compact file of samples taken over time
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "arena.h"
+#include "acpi.h"
+#include "record.h"
+
+/* A recording starts with RECORD_MAGIC and is followed by blocks of up to
+ * BLOCK_SAMPLES samples that all have the same devices. A block is
+ *
+ *	"ABLK", u32 length of the rest, i64 first and i64 last time
+ *	varint samples, the classes and devices, the strings
+ *	the times: the first one is in the header, then the delta-of-deltas
+ *	the columns: every value of a record is a column, stored for all
+ *	    samples of the block, XORed with the value before it
+ *
+ * so mostly unchanged values take a byte per sample, and the header of a
+ * block is all a reader needs to skip it. Numbers are little endian, a
+ * varint has 7 bits per byte, signed ones are zigzag encoded first. */
+#define RECORD_MAGIC	"ACPIREC\001"
+#define MAGIC_LEN	8
+#define BLOCK_MAGIC	"ABLK"
+#define BLOCK_HEADER	24
+#define BLOCK_SAMPLES	120
+
+/* floats are XORed as their bits, which leaves trailing zeros to drop */
+#define COL_INT		0
+#define COL_FLOAT	1
+
+struct buffer {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+};
+
+/* the devices of a block, each of which adds its columns */
+struct schema {
+    unsigned int classes;
+    int n_devices[DEVICE_CLASSES];
+    int *trips;			/* trip points of each thermal zone */
+    int trips_size;
+    int *temps;			/* temperature sensors of each hwmon chip */
+    int *fans;
+    int chips_size;
+};
+
+struct recorder {
+    char *path;
+    int fd;
+    struct schema schema;
+    int n_cols;
+    unsigned char *kinds;
+    uint64_t *values;		/* a row of n_cols per sample */
+    long long times[BLOCK_SAMPLES];
+    int n_samples;
+    char **strings;		/* a column holds the number of a string */
+    int n_strings;
+    int strings_size;
+    struct buffer out;
+};
+
+/* moves the values of a record into a row or back */
+struct xfer {
+    int store;
+    uint64_t *row;
+    int col;
+    unsigned char *kinds;
+    struct recorder *r;
+    char **strings;
+    int n_strings;
+};
+
+static void *xmalloc(void *p, size_t size, char *func)
+{
+    p = realloc(p, size ? size : 1);
+    if (!p) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in %s.\n", func);
+	exit(1);
+    }
+    return p;
+}
+
+/* the arenas of a replay hold a block and one sample */
+static void *block_alloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+
+    if (!p) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in replay.\n");
+	exit(1);
+    }
+    return p;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static void put_bytes(struct buffer *b, const void *p, size_t n)
+{
+    if (b->len + n > b->size) {
+	b->size = b->size ? 2 * b->size : 4096;
+	while (b->len + n > b->size)
+	    b->size *= 2;
+	b->data = xmalloc(b->data, b->size, "put_bytes");
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_varint(struct buffer *b, uint64_t v)
+{
+    unsigned char c[10];
+    int n = 0;
+
+    while (v >= 0x80) {
+	c[n++] = (v & 0x7f) | 0x80;
+	v >>= 7;
+    }
+    c[n++] = v;
+    put_bytes(b, c, n);
+}
+
+static void put_fixed(struct buffer *b, uint64_t v, int n)
+{
+    unsigned char c[8];
+    int i;
+
+    for (i = 0; i < n; i++)
+	c[i] = v >> (8 * i);
+    put_bytes(b, c, n);
+}
+
+static uint64_t get_fixed(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+	v |= (uint64_t) p[i] << (8 * i);
+    return v;
+}
+
+/* decoding a block, running past its end marks it as damaged */
+struct reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    int damaged;
+};
+
+static uint64_t get_varint(struct reader *rd)
+{
+    uint64_t v = 0;
+    int shift = 0;
+
+    while (rd->p < rd->end && shift < 64) {
+	v |= (uint64_t) (*rd->p & 0x7f) << shift;
+	if (!(*rd->p++ & 0x80))
+	    return v;
+	shift += 7;
+    }
+    rd->damaged = TRUE;
+    return 0;
+}
+
+/* a count that has to fit into what is left of the block */
+static int get_count(struct reader *rd)
+{
+    uint64_t v = get_varint(rd);
+
+    if (v > (uint64_t) (rd->end - rd->p)) {
+	rd->damaged = TRUE;
+	return 0;
+    }
+    return v;
+}
+
+static void put_float_xor(struct buffer *b, uint64_t x)
+{
+    int tz = 0;
+
+    if (!x) {
+	put_varint(b, 0);
+	return;
+    }
+    while (!(x & 1)) {
+	x >>= 1;
+	tz++;
+    }
+    put_varint(b, x << 5 | tz);
+}
+
+static uint64_t get_float_xor(struct reader *rd)
+{
+    uint64_t v = get_varint(rd);
+
+    return v ? (v >> 5) << (v & 31) : 0;
+}
+
+static int string_number(struct recorder *r, char *s)
+{
+    int i;
+
+    if (!s)
+	return 0;
+    for (i = 0; i < r->n_strings; i++)
+	if (!strcmp(r->strings[i], s))
+	    return i + 1;
+    if (r->n_strings == r->strings_size) {
+	r->strings_size = r->strings_size ? 2 * r->strings_size : 16;
+	r->strings = xmalloc(r->strings, r->strings_size * sizeof(char *), "string_number");
+    }
+    r->strings[r->n_strings] = strdup(s);
+    if (!r->strings[r->n_strings]) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in string_number.\n");
+	exit(1);
+    }
+    return ++r->n_strings;
+}
+
+static void xfer_raw(struct xfer *x, uint64_t *v, int kind)
+{
+    if (x->store)
+	x->row[x->col] = *v;
+    else
+	*v = x->row[x->col];
+    if (x->kinds)
+	x->kinds[x->col] = kind;
+    x->col++;
+}
+
+static void xfer_long(struct xfer *x, long *v)
+{
+    uint64_t u = zigzag(*v);
+
+    xfer_raw(x, &u, COL_INT);
+    *v = unzigzag(u);
+}
+
+static void xfer_int(struct xfer *x, int *v)
+{
+    uint64_t u = zigzag(*v);
+
+    xfer_raw(x, &u, COL_INT);
+    *v = unzigzag(u);
+}
+
+static void xfer_uint(struct xfer *x, unsigned int *v)
+{
+    uint64_t u = *v;
+
+    xfer_raw(x, &u, COL_INT);
+    *v = u;
+}
+
+static void xfer_float(struct xfer *x, float *v)
+{
+    uint32_t bits;
+    uint64_t u;
+
+    memcpy(&bits, v, sizeof(bits));
+    u = bits;
+    xfer_raw(x, &u, COL_FLOAT);
+    bits = u;
+    memcpy(v, &bits, sizeof(bits));
+}
+
+static void xfer_string(struct xfer *x, char **v)
+{
+    uint64_t u = x->store ? string_number(x->r, *v) : 0;
+
+    xfer_raw(x, &u, COL_INT);
+    if (!x->store)
+	*v = u && u <= (uint64_t) x->n_strings ? x->strings[u - 1] : NULL;
+}
+
+static void xfer_record(struct xfer *x, int device_nr, void *rec)
+{
+    struct battery_info *b = rec;
+    struct adapter_info *ac = rec;
+    struct thermal_info *z = rec;
+    struct cooling_info *c = rec;
+    struct hwmon_info *h = rec;
+    int i;
+
+    switch (device_nr) {
+    case BATTERY:
+	xfer_uint(x, &b->have);
+	/* the capacity has no column, replays work it out from the values */
+	if (!x->store)
+	    b->have &= ~ATTR_BIT(ATTR_CAPACITY);
+	xfer_string(x, &b->state);
+	xfer_string(x, &b->type);
+	xfer_long(x, &b->current_now);
+	xfer_long(x, &b->power_now);
+	xfer_long(x, &b->charge_now);
+	xfer_long(x, &b->energy_now);
+	xfer_long(x, &b->voltage_now);
+	xfer_long(x, &b->charge_full);
+	xfer_long(x, &b->energy_full);
+	xfer_long(x, &b->charge_full_design);
+	xfer_long(x, &b->energy_full_design);
+	break;
+    case AC_ADAPTER:
+	xfer_uint(x, &ac->have);
+	xfer_string(x, &ac->state);
+	xfer_string(x, &ac->type);
+	xfer_int(x, &ac->online);
+	break;
+    case THERMAL_ZONE:
+	xfer_uint(x, &z->have);
+	xfer_string(x, &z->state);
+	xfer_string(x, &z->type);
+	xfer_float(x, &z->temperature);
+	xfer_int(x, &z->trip_points);
+	for (i = 0; i < z->n_trip; i++) {
+	    xfer_float(x, &z->trip[i].temp);
+	    xfer_string(x, &z->trip[i].type);
+	}
+	break;
+    case COOLING_DEV:
+	xfer_uint(x, &c->have);
+	xfer_string(x, &c->state);
+	xfer_string(x, &c->type);
+	xfer_int(x, &c->cur_state);
+	xfer_int(x, &c->max_state);
+	break;
+    case HWMON:
+	xfer_uint(x, &h->have);
+	xfer_string(x, &h->type);
+	for (i = 0; i < h->n_temp; i++) {
+	    xfer_uint(x, &h->temp[i].have);
+	    xfer_float(x, &h->temp[i].input);
+	    xfer_float(x, &h->temp[i].crit);
+	    xfer_string(x, &h->temp[i].label);
+	}
+	for (i = 0; i < h->n_fan; i++) {
+	    xfer_uint(x, &h->fan[i].have);
+	    xfer_float(x, &h->fan[i].input);
+	}
+	break;
+    }
+}
+
+static void *class_records(struct sample *s, int device_nr, int *n, size_t *size)
+{
+    switch (device_nr) {
+    case BATTERY:
+	*n = s->n_batteries;
+	*size = sizeof(struct battery_info);
+	return s->batteries;
+    case AC_ADAPTER:
+	*n = s->n_adapters;
+	*size = sizeof(struct adapter_info);
+	return s->adapters;
+    case THERMAL_ZONE:
+	*n = s->n_zones;
+	*size = sizeof(struct thermal_info);
+	return s->zones;
+    case HWMON:
+	*n = s->n_chips;
+	*size = sizeof(struct hwmon_info);
+	return s->chips;
+    default:
+	*n = s->n_coolers;
+	*size = sizeof(struct cooling_info);
+	return s->coolers;
+    }
+}
+
+static void set_class_records(struct sample *s, int device_nr, void *records, int n)
+{
+    switch (device_nr) {
+    case BATTERY:
+	s->batteries = records;
+	s->n_batteries = n;
+	break;
+    case AC_ADAPTER:
+	s->adapters = records;
+	s->n_adapters = n;
+	break;
+    case THERMAL_ZONE:
+	s->zones = records;
+	s->n_zones = n;
+	break;
+    case HWMON:
+	s->chips = records;
+	s->n_chips = n;
+	break;
+    default:
+	s->coolers = records;
+	s->n_coolers = n;
+	break;
+    }
+}
+
+static int schema_columns(struct schema *sc)
+{
+    static const int per_device[DEVICE_CLASSES] = { 12, 4, 5, 5, 2 };
+    int i, n = 0;
+
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	if (sc->classes & (1 << i))
+	    n += sc->n_devices[i] * per_device[i];
+    for (i = 0; i < sc->n_devices[THERMAL_ZONE]; i++)
+	n += 2 * sc->trips[i];
+    for (i = 0; i < sc->n_devices[HWMON]; i++)
+	n += 4 * sc->temps[i] + 2 * sc->fans[i];
+    return n;
+}
+
+static int schema_matches(struct schema *sc, struct sample *s, unsigned int classes)
+{
+    size_t size;
+    int i, n;
+
+    if (sc->classes != classes)
+	return FALSE;
+    for (i = 0; i < DEVICE_CLASSES; i++) {
+	class_records(s, i, &n, &size);
+	if ((classes & (1 << i)) && n != sc->n_devices[i])
+	    return FALSE;
+    }
+    for (i = 0; (classes & (1 << THERMAL_ZONE)) && i < s->n_zones; i++)
+	if (s->zones[i].n_trip != sc->trips[i])
+	    return FALSE;
+    for (i = 0; (classes & (1 << HWMON)) && i < s->n_chips; i++)
+	if (s->chips[i].n_temp != sc->temps[i] || s->chips[i].n_fan != sc->fans[i])
+	    return FALSE;
+    return TRUE;
+}
+
+static void write_block(struct recorder *r)
+{
+    struct buffer *b = &r->out;
+    uint64_t v, prev;
+    long long delta = 0;
+    int i, c;
+
+    if (!r->n_samples)
+	return;
+    b->len = 0;
+    put_bytes(b, BLOCK_MAGIC, 4);
+    put_fixed(b, 0, 4);
+    put_fixed(b, r->times[0], 8);
+    put_fixed(b, r->times[r->n_samples - 1], 8);
+    put_varint(b, r->n_samples);
+
+    put_varint(b, r->schema.classes);
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	if (r->schema.classes & (1 << i))
+	    put_varint(b, r->schema.n_devices[i]);
+    for (i = 0; (r->schema.classes & (1 << THERMAL_ZONE)) && i < r->schema.n_devices[THERMAL_ZONE]; i++)
+	put_varint(b, r->schema.trips[i]);
+    for (i = 0; (r->schema.classes & (1 << HWMON)) && i < r->schema.n_devices[HWMON]; i++) {
+	put_varint(b, r->schema.temps[i]);
+	put_varint(b, r->schema.fans[i]);
+    }
+    put_varint(b, r->n_strings);
+    for (i = 0; i < r->n_strings; i++) {
+	put_varint(b, strlen(r->strings[i]));
+	put_bytes(b, r->strings[i], strlen(r->strings[i]));
+    }
+
+    for (i = 1; i < r->n_samples; i++) {
+	put_varint(b, zigzag(r->times[i] - r->times[i - 1] - delta));
+	delta = r->times[i] - r->times[i - 1];
+    }
+    for (c = 0; c < r->n_cols; c++) {
+	for (prev = 0, i = 0; i < r->n_samples; i++) {
+	    v = r->values[i * r->n_cols + c];
+	    if (r->kinds[c] == COL_FLOAT)
+		put_float_xor(b, v ^ prev);
+	    else
+		put_varint(b, v ^ prev);
+	    prev = v;
+	}
+    }
+    v = b->len - BLOCK_HEADER;
+    for (i = 0; i < 4; i++)
+	b->data[4 + i] = v >> (8 * i);
+
+    /* a block goes out with a single write, so it is there or not */
+    if (write(r->fd, b->data, b->len) != (ssize_t) b->len) {
+	fprintf(stderr, "Could not write to %s: %s\n", r->path, strerror(errno));
+	exit(1);
+    }
+
+    for (i = 0; i < r->n_strings; i++)
+	free(r->strings[i]);
+    r->n_strings = 0;
+    r->n_samples = 0;
+}
+
+static void set_schema(struct recorder *r, struct sample *s, unsigned int classes)
+{
+    struct schema *sc = &r->schema;
+    size_t size;
+    int i;
+
+    sc->classes = classes;
+    for (i = 0; i < DEVICE_CLASSES; i++) {
+	class_records(s, i, &sc->n_devices[i], &size);
+	if (!(classes & (1 << i)))
+	    sc->n_devices[i] = 0;
+    }
+    if (sc->n_devices[THERMAL_ZONE] > sc->trips_size) {
+	sc->trips_size = sc->n_devices[THERMAL_ZONE];
+	sc->trips = xmalloc(sc->trips, sc->trips_size * sizeof(int), "set_schema");
+    }
+    for (i = 0; i < sc->n_devices[THERMAL_ZONE]; i++)
+	sc->trips[i] = s->zones[i].n_trip;
+    if (sc->n_devices[HWMON] > sc->chips_size) {
+	sc->chips_size = sc->n_devices[HWMON];
+	sc->temps = xmalloc(sc->temps, sc->chips_size * sizeof(int), "set_schema");
+	sc->fans = xmalloc(sc->fans, sc->chips_size * sizeof(int), "set_schema");
+    }
+    for (i = 0; i < sc->n_devices[HWMON]; i++) {
+	sc->temps[i] = s->chips[i].n_temp;
+	sc->fans[i] = s->chips[i].n_fan;
+    }
+    r->n_cols = schema_columns(sc);
+    r->kinds = xmalloc(r->kinds, r->n_cols, "set_schema");
+    r->values = xmalloc(r->values, (size_t) r->n_cols * BLOCK_SAMPLES * sizeof(uint64_t), "set_schema");
+}
+
+/* drop a block a crash left half written, later ones would not be found */
+static int check_recording(int fd, char *path)
+{
+    unsigned char header[BLOCK_HEADER];
+    off_t size, off = MAGIC_LEN;
+    ssize_t n;
+
+    size = lseek(fd, 0, SEEK_END);
+    if (size == 0)
+	return write(fd, RECORD_MAGIC, MAGIC_LEN) == MAGIC_LEN ? 0 : -1;
+    n = pread(fd, header, MAGIC_LEN, 0);
+    if (n != MAGIC_LEN || memcmp(header, RECORD_MAGIC, MAGIC_LEN)) {
+	fprintf(stderr, "%s is not a recording of acpi\n", path);
+	return -1;
+    }
+    while (off < size) {
+	n = pread(fd, header, BLOCK_HEADER, off);
+	if (n != BLOCK_HEADER || memcmp(header, BLOCK_MAGIC, 4) ||
+	    off + BLOCK_HEADER + (off_t) get_fixed(header + 4, 4) > size)
+	    return ftruncate(fd, off);
+	off += BLOCK_HEADER + get_fixed(header + 4, 4);
+    }
+    return 0;
+}
+
+struct recorder *recorder_open(char *path)
+{
+    struct recorder *r;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+	fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+	return NULL;
+    }
+    if (check_recording(fd, path) < 0) {
+	close(fd);
+	return NULL;
+    }
+    r = calloc(1, sizeof(struct recorder));
+    if (!r) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in recorder_open.\n");
+	exit(1);
+    }
+    r->fd = fd;
+    r->path = strdup(path);
+    if (!r->path) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in recorder_open.\n");
+	exit(1);
+    }
+    return r;
+}
+
+void recorder_add(struct recorder *r, struct sample *s, unsigned int classes, long long time_ms)
+{
+    struct xfer x;
+    size_t size;
+    char *records;
+    int i, j, n;
+
+    if (!r->n_samples || !schema_matches(&r->schema, s, classes)) {
+	write_block(r);
+	set_schema(r, s, classes);
+    }
+    x.store = TRUE;
+    x.row = r->values + (size_t) r->n_samples * r->n_cols;
+    x.col = 0;
+    x.kinds = r->kinds;
+    x.r = r;
+    for (i = 0; i < DEVICE_CLASSES; i++) {
+	if (!(classes & (1 << i)))
+	    continue;
+	records = class_records(s, i, &n, &size);
+	for (j = 0; j < n; j++)
+	    xfer_record(&x, i, records + j * size);
+    }
+    r->times[r->n_samples++] = time_ms;
+    if (r->n_samples == BLOCK_SAMPLES)
+	write_block(r);
+}
+
+void recorder_close(struct recorder *r)
+{
+    int i;
+
+    if (!r)
+	return;
+    write_block(r);
+    close(r->fd);
+    for (i = 0; i < r->n_strings; i++)
+	free(r->strings[i]);
+    free(r->strings);
+    free(r->schema.trips);
+    free(r->schema.temps);
+    free(r->schema.fans);
+    free(r->kinds);
+    free(r->values);
+    free(r->out.data);
+    free(r->path);
+    free(r);
+}
+
+/* turn a row back into the records of a sample, and tell the kinds of its
+ * columns if kinds is not NULL */
+static void replay_sample(struct arena *a, struct schema *sc, uint64_t *row, char **strings, int n_strings,
+			  unsigned char *kinds, struct sample *s)
+{
+    struct thermal_info *z;
+    struct hwmon_info *h;
+    struct xfer x;
+    size_t size;
+    char *records;
+    int i, j, n;
+
+    memset(s, 0, sizeof(*s));
+    memset(&x, 0, sizeof(x));
+    x.row = row;
+    x.kinds = kinds;
+    x.strings = strings;
+    x.n_strings = n_strings;
+    for (i = 0; i < DEVICE_CLASSES; i++) {
+	if (!(sc->classes & (1 << i)))
+	    continue;
+	class_records(s, i, &n, &size);
+	n = sc->n_devices[i];
+	records = block_alloc(a, n * size);
+	memset(records, 0, n * size);
+	for (j = 0; j < n; j++) {
+	    if (i == THERMAL_ZONE) {
+		z = (struct thermal_info *) records + j;
+		z->n_trip = z->trip_size = sc->trips[j];
+		z->trip = block_alloc(a, z->n_trip * sizeof(struct trip_point));
+	    } else if (i == HWMON) {
+		h = (struct hwmon_info *) records + j;
+		h->n_temp = h->temp_size = sc->temps[j];
+		h->temp = block_alloc(a, h->n_temp * sizeof(struct hwmon_sensor));
+		h->n_fan = h->fan_size = sc->fans[j];
+		h->fan = block_alloc(a, h->n_fan * sizeof(struct hwmon_sensor));
+	    }
+	    xfer_record(&x, i, records + j * size);
+	}
+	set_class_records(s, i, records, n);
+	finish_records(a, s, i);
+    }
+}
+
+static int replay_block(struct arena *block, struct arena *a, const unsigned char *data, size_t len,
+			long long first, long long from_ms, long long to_ms, replay_func *func, void *arg)
+{
+    struct reader rd = { data, data + len, FALSE };
+    struct schema sc;
+    struct sample s;
+    long long *times, delta = 0;
+    unsigned char *kinds;
+    uint64_t *values, prev;
+    char **strings;
+    int n_samples, n_strings, n_cols, i, c, l;
+
+    memset(&sc, 0, sizeof(sc));
+    n_samples = get_count(&rd);
+    sc.classes = get_varint(&rd) & ALL_CLASSES;
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	if (sc.classes & (1 << i))
+	    sc.n_devices[i] = get_count(&rd);
+    sc.trips = block_alloc(block, sc.n_devices[THERMAL_ZONE] * sizeof(int));
+    for (i = 0; i < sc.n_devices[THERMAL_ZONE]; i++)
+	sc.trips[i] = get_count(&rd);
+    sc.temps = block_alloc(block, sc.n_devices[HWMON] * sizeof(int));
+    sc.fans = block_alloc(block, sc.n_devices[HWMON] * sizeof(int));
+    for (i = 0; i < sc.n_devices[HWMON]; i++) {
+	sc.temps[i] = get_count(&rd);
+	sc.fans[i] = get_count(&rd);
+    }
+    n_strings = get_count(&rd);
+    strings = block_alloc(block, n_strings * sizeof(char *));
+    for (i = 0; i < n_strings; i++) {
+	l = get_count(&rd);
+	strings[i] = arena_strndup(block, (const char *) rd.p, l);
+	if (!strings[i]) {
+	    fprintf(stderr, "Out of memory. Could not allocate memory in replay.\n");
+	    exit(1);
+	}
+	rd.p += l;
+    }
+    if (rd.damaged || !n_samples)
+	return -1;
+
+    times = block_alloc(block, n_samples * sizeof(long long));
+    times[0] = first;
+    for (i = 1; i < n_samples; i++) {
+	delta += unzigzag(get_varint(&rd));
+	times[i] = times[i - 1] + delta;
+    }
+
+    /* the kinds of the columns follow from the devices */
+    n_cols = schema_columns(&sc);
+    if ((uint64_t) n_cols * n_samples > (uint64_t) (rd.end - rd.p))
+	return -1;
+    kinds = block_alloc(block, n_cols);
+    values = block_alloc(block, (size_t) n_cols * n_samples * sizeof(uint64_t));
+    memset(values, 0, (size_t) n_cols * sizeof(uint64_t));
+    replay_sample(a, &sc, values, strings, n_strings, kinds, &s);
+    arena_reset(a);
+
+    for (c = 0; c < n_cols; c++) {
+	for (prev = 0, i = 0; i < n_samples; i++) {
+	    prev ^= kinds[c] == COL_FLOAT ? get_float_xor(&rd) : get_varint(&rd);
+	    values[i * n_cols + c] = prev;
+	}
+    }
+    if (rd.damaged)
+	return -1;
+
+    for (i = 0; i < n_samples; i++) {
+	if (times[i] < from_ms || times[i] > to_ms)
+	    continue;
+	replay_sample(a, &sc, values + (size_t) i * n_cols, strings, n_strings, NULL, &s);
+	func(&s, sc.classes, times[i], arg);
+	arena_reset(a);
+    }
+    return 0;
+}
+
+int replay(char *path, long long from_ms, long long to_ms, replay_func *func, void *arg)
+{
+    unsigned char header[BLOCK_HEADER];
+    unsigned char *data = NULL;
+    struct arena block = { NULL, NULL, 0 }, a = { NULL, NULL, 0 };
+    long long first, last;
+    off_t off = MAGIC_LEN;
+    size_t len;
+    int fd, ret = 0;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+	fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    if (pread(fd, header, MAGIC_LEN, 0) != MAGIC_LEN || memcmp(header, RECORD_MAGIC, MAGIC_LEN)) {
+	fprintf(stderr, "%s is not a recording of acpi\n", path);
+	close(fd);
+	return -1;
+    }
+
+    /* a block that is cut off at the end is one being written */
+    while (pread(fd, header, BLOCK_HEADER, off) == BLOCK_HEADER) {
+	if (memcmp(header, BLOCK_MAGIC, 4)) {
+	    fprintf(stderr, "%s is damaged\n", path);
+	    ret = -1;
+	    break;
+	}
+	len = get_fixed(header + 4, 4);
+	first = get_fixed(header + 8, 8);
+	last = get_fixed(header + 16, 8);
+	off += BLOCK_HEADER;
+	if (last >= from_ms && first <= to_ms) {
+	    data = xmalloc(data, len, "replay");
+	    if (pread(fd, data, len, off) != (ssize_t) len)
+		break;
+	    if (replay_block(&block, &a, data, len, first, from_ms, to_ms, func, arg) < 0) {
+		fprintf(stderr, "%s is damaged\n", path);
+		ret = -1;
+		break;
+	    }
+	    arena_reset(&block);
+	}
+	off += len;
+    }
+    free(data);
+    arena_free(&block);
+    arena_free(&a);
+    close(fd);
+    return ret;
+}
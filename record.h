@@ -0,0 +1,56 @@
+/* a compact file of samples taken over time
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+struct sample;
+struct recorder;
+
+/* open a file to append samples to
+ *
+ * Post: returns NULL with a message printed if the file cannot be used
+ */
+struct recorder *recorder_open(char *path);
+
+/* append a sample
+ *
+ * Pre: r != NULL, the classes set as bits of device_nr are filled in s
+ * Post: the sample is written with the block it belongs to, when that is
+ *       full, its layout of devices changes or the recorder is closed
+ */
+void recorder_add(struct recorder *r, struct sample *s, unsigned int classes, long long time_ms);
+
+/* write what is left and close the file
+ *
+ * Pre: r is NULL or returned by recorder_open
+ */
+void recorder_close(struct recorder *r);
+
+/* called for every sample replayed, s and its records are valid until it
+ * returns */
+typedef void replay_func(struct sample *s, unsigned int classes, long long time_ms, void *arg);
+
+/* read the samples of a file taken between from_ms and to_ms, blocks that
+ * lie outside are skipped without being decoded
+ *
+ * Post: returns 0, or -1 with a message printed if the file is not a
+ *       recording or is damaged
+ */
+int replay(char *path, long long from_ms, long long to_ms, replay_func *func, void *arg);
+
+#endif
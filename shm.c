@@ -0,0 +1,557 @@
+/* samples published in shared memory
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "acpi.h"
+#include "shm.h"
+
+/* The segment has room for a fixed number of devices of each class, so
+ * it never moves and a reader maps it once. It is guarded by a seqlock:
+ * the writer makes seq odd, writes the sample in place and makes seq even
+ * again; a reader copies what it needs and takes the copy only if seq was
+ * even and the same before and after. Nobody ever waits for anybody.
+ *
+ * A segment is never resized while it may be mapped. A writer that goes
+ * away, or replaces the segment of one that died, sets closed and unlinks
+ * it; the readers then open the name again. */
+#define SHM_MAGIC	"ACPISHM\003"
+#define MAGIC_LEN	8
+#define SHM_DEVICES	1024		/* of each class */
+#define SHM_TRIP_POINTS	16
+#define SHM_CHIPS	64
+#define SHM_SENSORS	16		/* of each kind of a chip */
+#define SHM_STRING	32
+#define SHM_RETRIES	1000
+
+/* bits of shm_device.strings, which of them are set */
+#define SHM_STATE	1
+#define SHM_TYPE	2
+
+struct shm_device {
+    uint32_t have;
+    uint32_t strings;
+    int64_t stale_ms;
+    char state[SHM_STRING];
+    char type[SHM_STRING];
+};
+
+struct shm_battery {
+    struct shm_device d;
+    int64_t current_now;
+    int64_t power_now;
+    int64_t charge_now;
+    int64_t energy_now;
+    int64_t voltage_now;
+    int64_t charge_full;
+    int64_t energy_full;
+    int64_t charge_full_design;
+    int64_t energy_full_design;
+    int64_t capacity;
+};
+
+struct shm_adapter {
+    struct shm_device d;
+    int32_t online;
+};
+
+struct shm_trip {
+    float temp;
+    int32_t has_type;
+    char type[SHM_STRING];
+};
+
+struct shm_zone {
+    struct shm_device d;
+    float temperature;
+    int32_t trip_points;
+    int32_t n_trip;
+    struct shm_trip trip[SHM_TRIP_POINTS];
+};
+
+struct shm_cooler {
+    struct shm_device d;
+    int32_t cur_state;
+    int32_t max_state;
+};
+
+struct shm_sensor {
+    uint32_t have;
+    float input;
+    float crit;
+    int32_t has_label;
+    char label[SHM_STRING];
+};
+
+struct shm_chip {
+    struct shm_device d;
+    int32_t n_temp;
+    int32_t n_fan;
+    struct shm_sensor temp[SHM_SENSORS];
+    struct shm_sensor fan[SHM_SENSORS];
+};
+
+struct shm_segment {
+    char magic[MAGIC_LEN];
+    uint32_t size;		/* of the segment, layouts differ in it */
+    uint32_t seq;		/* odd while a sample is written */
+    uint32_t closed;		/* the writer is gone */
+    int64_t time_ms;
+    uint32_t classes;
+    uint32_t missing;
+    int32_t n[DEVICE_CLASSES];
+    struct shm_battery batteries[SHM_DEVICES];
+    struct shm_adapter adapters[SHM_DEVICES];
+    struct shm_zone zones[SHM_DEVICES];
+    struct shm_cooler coolers[SHM_DEVICES];
+    struct shm_chip chips[SHM_CHIPS];
+};
+
+struct shm_writer {
+    int fd;			/* locked as long as it is written */
+    char *name;
+    struct shm_segment *seg;
+};
+
+/* the copy of a sample and the records made of it */
+struct shm_reader {
+    struct shm_segment *seg;
+    struct shm_segment copy;
+    struct battery_info batteries[SHM_DEVICES];
+    struct adapter_info adapters[SHM_DEVICES];
+    struct thermal_info zones[SHM_DEVICES];
+    struct cooling_info coolers[SHM_DEVICES];
+    struct trip_point trips[SHM_DEVICES][SHM_TRIP_POINTS];
+    struct hwmon_info chips[SHM_CHIPS];
+    struct hwmon_sensor temps[SHM_CHIPS][SHM_SENSORS];
+    struct hwmon_sensor fans[SHM_CHIPS][SHM_SENSORS];
+};
+
+/* shm_open wants a name with a slash in front */
+static char *shm_name(const char *name)
+{
+    char *s = malloc(strlen(name) + 2);
+
+    if (!s) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    s[0] = '/';
+    strcpy(s + (name[0] != '/'), name);
+    return s;
+}
+
+/* mark the segment of a writer that died closed, if it is one */
+static void retire(int fd)
+{
+    struct shm_segment *seg;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || st.st_size != sizeof(struct shm_segment))
+	return;
+    seg = mmap(NULL, sizeof(struct shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+	return;
+    if (!memcmp(seg->magic, SHM_MAGIC, MAGIC_LEN))
+	__atomic_store_n(&seg->closed, 1, __ATOMIC_RELEASE);
+    munmap(seg, sizeof(struct shm_segment));
+}
+
+struct shm_writer *shm_writer_open(const char *name)
+{
+    struct shm_writer *w = calloc(1, sizeof(struct shm_writer));
+    void *map;
+    int old, err;
+
+    if (!w) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    w->fd = -1;
+    w->name = shm_name(name);
+    if (!w->name)
+	goto fail;
+    /* a segment left by a writer that died is replaced by a new one */
+    old = shm_open(w->name, O_RDWR | O_CLOEXEC, 0);
+    if (old >= 0) {
+	if (flock(old, LOCK_EX | LOCK_NB) < 0) {
+	    errno = errno == EWOULDBLOCK ? EBUSY : errno;
+	    close(old);
+	    goto fail;
+	}
+	retire(old);
+	shm_unlink(w->name);
+	close(old);
+    }
+    w->fd = shm_open(w->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (w->fd < 0) {
+	errno = errno == EEXIST ? EBUSY : errno;
+	goto fail;
+    }
+    if (flock(w->fd, LOCK_EX | LOCK_NB) < 0) {
+	errno = errno == EWOULDBLOCK ? EBUSY : errno;
+	goto fail;
+    }
+    /* nobody has mapped it yet */
+    if (ftruncate(w->fd, sizeof(struct shm_segment)) < 0)
+	goto fail;
+    map = mmap(NULL, sizeof(struct shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (map == MAP_FAILED)
+	goto fail;
+    w->seg = map;
+    w->seg->size = sizeof(struct shm_segment);
+    memcpy(w->seg->magic, SHM_MAGIC, MAGIC_LEN);
+    return w;
+
+fail:
+    err = errno;
+    if (w->fd >= 0)
+	close(w->fd);
+    free(w->name);
+    free(w);
+    errno = err;
+    return NULL;
+}
+
+static void put_string(char *dst, const char *s, uint32_t *strings, uint32_t bit)
+{
+    if (!s) {
+	dst[0] = '\0';
+	return;
+    }
+    strncpy(dst, s, SHM_STRING - 1);
+    dst[SHM_STRING - 1] = '\0';
+    *strings |= bit;
+}
+
+static void put_device(struct shm_device *d, unsigned int have, long stale_ms, const char *state, const char *type)
+{
+    d->have = have;
+    d->stale_ms = stale_ms;
+    d->strings = 0;
+    put_string(d->state, state, &d->strings, SHM_STATE);
+    put_string(d->type, type, &d->strings, SHM_TYPE);
+}
+
+static int room(int n)
+{
+    return n < SHM_DEVICES ? n : SHM_DEVICES;
+}
+
+/* the room there is for n of something, a torn n is caught by seq and
+ * only has to be kept in bounds */
+static int bounded(int32_t n, int max)
+{
+    return n < 0 ? 0 : n < max ? n : max;
+}
+
+static void put_sensors(struct shm_sensor *dst, int32_t *n_dst, struct hwmon_sensor *src, int n)
+{
+    uint32_t has_label;
+    int i;
+
+    *n_dst = bounded(n, SHM_SENSORS);
+    for (i = 0; i < *n_dst; i++) {
+	has_label = 0;
+	put_string(dst[i].label, src[i].label, &has_label, 1);
+	dst[i].has_label = has_label;
+	dst[i].have = src[i].have;
+	dst[i].input = src[i].input;
+	dst[i].crit = src[i].crit;
+    }
+}
+
+static int get_sensors(struct hwmon_sensor *dst, struct shm_sensor *src, int32_t n)
+{
+    int i;
+
+    n = bounded(n, SHM_SENSORS);
+    for (i = 0; i < n; i++) {
+	dst[i].have = src[i].have;
+	dst[i].input = src[i].input;
+	dst[i].crit = src[i].crit;
+	dst[i].label = src[i].has_label ? src[i].label : NULL;
+    }
+    return n;
+}
+
+void shm_write(struct shm_writer *w, struct sample *s, unsigned int classes, long long time_ms)
+{
+    struct shm_segment *seg = w->seg;
+    struct battery_info *b;
+    struct thermal_info *z;
+    struct shm_zone *sz;
+    struct hwmon_info *h;
+    uint32_t seq = seg->seq, has_type;
+    int i, j;
+
+    __atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    seg->time_ms = time_ms;
+    seg->classes = classes;
+    seg->missing = s->missing;
+    seg->n[BATTERY] = classes & (1 << BATTERY) ? room(s->n_batteries) : 0;
+    seg->n[AC_ADAPTER] = classes & (1 << AC_ADAPTER) ? room(s->n_adapters) : 0;
+    seg->n[THERMAL_ZONE] = classes & (1 << THERMAL_ZONE) ? room(s->n_zones) : 0;
+    seg->n[COOLING_DEV] = classes & (1 << COOLING_DEV) ? room(s->n_coolers) : 0;
+    seg->n[HWMON] = classes & (1 << HWMON) ? bounded(s->n_chips, SHM_CHIPS) : 0;
+    for (i = 0; i < seg->n[BATTERY]; i++) {
+	b = &s->batteries[i];
+	put_device(&seg->batteries[i].d, b->have, b->stale_ms, b->state, b->type);
+	seg->batteries[i].current_now = b->current_now;
+	seg->batteries[i].power_now = b->power_now;
+	seg->batteries[i].charge_now = b->charge_now;
+	seg->batteries[i].energy_now = b->energy_now;
+	seg->batteries[i].voltage_now = b->voltage_now;
+	seg->batteries[i].charge_full = b->charge_full;
+	seg->batteries[i].energy_full = b->energy_full;
+	seg->batteries[i].charge_full_design = b->charge_full_design;
+	seg->batteries[i].energy_full_design = b->energy_full_design;
+	seg->batteries[i].capacity = b->capacity;
+    }
+    for (i = 0; i < seg->n[AC_ADAPTER]; i++) {
+	put_device(&seg->adapters[i].d, s->adapters[i].have, s->adapters[i].stale_ms,
+		   s->adapters[i].state, s->adapters[i].type);
+	seg->adapters[i].online = s->adapters[i].online;
+    }
+    for (i = 0; i < seg->n[THERMAL_ZONE]; i++) {
+	z = &s->zones[i];
+	sz = &seg->zones[i];
+	put_device(&sz->d, z->have, z->stale_ms, z->state, z->type);
+	sz->temperature = z->temperature;
+	sz->n_trip = z->n_trip < SHM_TRIP_POINTS ? z->n_trip : SHM_TRIP_POINTS;
+	sz->trip_points = z->trip_points < sz->n_trip ? z->trip_points : sz->n_trip - 1;
+	for (j = 0; j < sz->n_trip; j++) {
+	    has_type = 0;
+	    put_string(sz->trip[j].type, z->trip[j].type, &has_type, 1);
+	    sz->trip[j].temp = z->trip[j].temp;
+	    sz->trip[j].has_type = has_type;
+	}
+    }
+    for (i = 0; i < seg->n[COOLING_DEV]; i++) {
+	put_device(&seg->coolers[i].d, s->coolers[i].have, s->coolers[i].stale_ms,
+		   s->coolers[i].state, s->coolers[i].type);
+	seg->coolers[i].cur_state = s->coolers[i].cur_state;
+	seg->coolers[i].max_state = s->coolers[i].max_state;
+    }
+    for (i = 0; i < seg->n[HWMON]; i++) {
+	h = &s->chips[i];
+	put_device(&seg->chips[i].d, h->have, h->stale_ms, NULL, h->type);
+	put_sensors(seg->chips[i].temp, &seg->chips[i].n_temp, h->temp, h->n_temp);
+	put_sensors(seg->chips[i].fan, &seg->chips[i].n_fan, h->fan, h->n_fan);
+    }
+
+    __atomic_store_n(&seg->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void shm_writer_close(struct shm_writer *w)
+{
+    if (!w)
+	return;
+    __atomic_store_n(&w->seg->closed, 1, __ATOMIC_RELEASE);
+    shm_unlink(w->name);
+    munmap(w->seg, sizeof(struct shm_segment));
+    close(w->fd);
+    free(w->name);
+    free(w);
+}
+
+struct shm_reader *shm_reader_open(const char *name)
+{
+    struct shm_reader *r;
+    struct stat st;
+    char *path;
+    void *map;
+    int fd, err;
+
+    path = shm_name(name);
+    if (!path)
+	return NULL;
+    fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+    free(path);
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &st) < 0) {
+	err = errno;
+	close(fd);
+	errno = err;
+	return NULL;
+    }
+    if (st.st_size != sizeof(struct shm_segment)) {
+	close(fd);
+	errno = EINVAL;
+	return NULL;
+    }
+    map = mmap(NULL, sizeof(struct shm_segment), PROT_READ, MAP_SHARED, fd, 0);
+    err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+	errno = err;
+	return NULL;
+    }
+    r = malloc(sizeof(struct shm_reader));
+    if (!r) {
+	munmap(map, sizeof(struct shm_segment));
+	errno = ENOMEM;
+	return NULL;
+    }
+    r->seg = map;
+    if (memcmp(r->seg->magic, SHM_MAGIC, MAGIC_LEN) || r->seg->size != sizeof(struct shm_segment)) {
+	shm_reader_close(r);
+	errno = EINVAL;
+	return NULL;
+    }
+    return r;
+}
+
+
+/* copy the devices that are there, returns FALSE if the writer got in
+ * between */
+static int copy_sample(struct shm_reader *r)
+{
+    struct shm_segment *seg = r->seg, *c = &r->copy;
+    uint32_t seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+    int i;
+
+    if (seq & 1)
+	return FALSE;
+    c->seq = seq;
+    c->time_ms = seg->time_ms;
+    c->classes = seg->classes;
+    c->missing = seg->missing;
+    for (i = 0; i < DEVICE_CLASSES; i++)
+	c->n[i] = bounded(seg->n[i], i == HWMON ? SHM_CHIPS : SHM_DEVICES);
+    memcpy(c->batteries, seg->batteries, c->n[BATTERY] * sizeof(struct shm_battery));
+    memcpy(c->adapters, seg->adapters, c->n[AC_ADAPTER] * sizeof(struct shm_adapter));
+    memcpy(c->zones, seg->zones, c->n[THERMAL_ZONE] * sizeof(struct shm_zone));
+    memcpy(c->coolers, seg->coolers, c->n[COOLING_DEV] * sizeof(struct shm_cooler));
+    memcpy(c->chips, seg->chips, c->n[HWMON] * sizeof(struct shm_chip));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static void get_device(struct shm_device *d, unsigned int *have, long *stale_ms, char **state, char **type)
+{
+    *have = d->have;
+    *stale_ms = d->stale_ms;
+    *state = d->strings & SHM_STATE ? d->state : NULL;
+    *type = d->strings & SHM_TYPE ? d->type : NULL;
+}
+
+int shm_read(struct shm_reader *r, struct sample *s, unsigned int *classes, long long *time_ms)
+{
+    struct shm_segment *c = &r->copy;
+    struct battery_info *b;
+    struct thermal_info *z;
+    struct shm_zone *sz;
+    struct hwmon_info *h;
+    char *state;
+    int i, j, tries;
+
+    if (__atomic_load_n(&r->seg->closed, __ATOMIC_ACQUIRE)) {
+	errno = ESTALE;
+	return -1;
+    }
+    for (tries = 0; tries < SHM_RETRIES && !copy_sample(r); tries++)
+	;
+    if (tries == SHM_RETRIES || !c->seq) {
+	errno = EAGAIN;
+	return -1;
+    }
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < c->n[BATTERY]; i++) {
+	b = &r->batteries[i];
+	memset(b, 0, sizeof(*b));
+	get_device(&c->batteries[i].d, &b->have, &b->stale_ms, &b->state, &b->type);
+	b->current_now = c->batteries[i].current_now;
+	b->power_now = c->batteries[i].power_now;
+	b->charge_now = c->batteries[i].charge_now;
+	b->energy_now = c->batteries[i].energy_now;
+	b->voltage_now = c->batteries[i].voltage_now;
+	b->charge_full = c->batteries[i].charge_full;
+	b->energy_full = c->batteries[i].energy_full;
+	b->charge_full_design = c->batteries[i].charge_full_design;
+	b->energy_full_design = c->batteries[i].energy_full_design;
+	b->capacity = c->batteries[i].capacity;
+    }
+    for (i = 0; i < c->n[AC_ADAPTER]; i++) {
+	get_device(&c->adapters[i].d, &r->adapters[i].have, &r->adapters[i].stale_ms,
+		   &r->adapters[i].state, &r->adapters[i].type);
+	r->adapters[i].online = c->adapters[i].online;
+    }
+    for (i = 0; i < c->n[THERMAL_ZONE]; i++) {
+	z = &r->zones[i];
+	sz = &c->zones[i];
+	memset(z, 0, sizeof(*z));
+	get_device(&sz->d, &z->have, &z->stale_ms, &z->state, &z->type);
+	z->temperature = sz->temperature;
+	z->n_trip = sz->n_trip < 0 ? 0 : sz->n_trip < SHM_TRIP_POINTS ? sz->n_trip : SHM_TRIP_POINTS;
+	z->trip_points = sz->trip_points < z->n_trip ? sz->trip_points : z->n_trip - 1;
+	z->trip_size = z->n_trip;
+	z->trip = r->trips[i];
+	for (j = 0; j < z->n_trip; j++) {
+	    z->trip[j].temp = sz->trip[j].temp;
+	    z->trip[j].type = sz->trip[j].has_type ? sz->trip[j].type : NULL;
+	}
+    }
+    for (i = 0; i < c->n[COOLING_DEV]; i++) {
+	get_device(&c->coolers[i].d, &r->coolers[i].have, &r->coolers[i].stale_ms,
+		   &r->coolers[i].state, &r->coolers[i].type);
+	r->coolers[i].cur_state = c->coolers[i].cur_state;
+	r->coolers[i].max_state = c->coolers[i].max_state;
+    }
+    for (i = 0; i < c->n[HWMON]; i++) {
+	h = &r->chips[i];
+	memset(h, 0, sizeof(*h));
+	get_device(&c->chips[i].d, &h->have, &h->stale_ms, &state, &h->type);
+	h->temp = r->temps[i];
+	h->n_temp = h->temp_size = get_sensors(h->temp, c->chips[i].temp, c->chips[i].n_temp);
+	h->fan = r->fans[i];
+	h->n_fan = h->fan_size = get_sensors(h->fan, c->chips[i].fan, c->chips[i].n_fan);
+    }
+    s->batteries = r->batteries;
+    s->n_batteries = c->n[BATTERY];
+    s->adapters = r->adapters;
+    s->n_adapters = c->n[AC_ADAPTER];
+    s->zones = r->zones;
+    s->n_zones = c->n[THERMAL_ZONE];
+    s->coolers = r->coolers;
+    s->n_coolers = c->n[COOLING_DEV];
+    s->chips = r->chips;
+    s->n_chips = c->n[HWMON];
+    s->missing = c->missing;
+    *classes = c->classes;
+    *time_ms = c->time_ms;
+    return 0;
+}
+
+void shm_reader_close(struct shm_reader *r)
+{
+    if (!r)
+	return;
+    munmap(r->seg, sizeof(struct shm_segment));
+    free(r);
+}
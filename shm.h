@@ -0,0 +1,66 @@
+/* samples published in shared memory
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "prefix.h"
+
+struct sample;
+
+/* the segment a sample is written to */
+struct shm_writer;
+
+/* a mapping of the segment of a writer */
+struct shm_reader;
+
+/* create the segment name, a POSIX shared memory name with or without its
+ * leading slash; there can be one writer per name
+ *
+ * Post: returns NULL with errno set, EBUSY if another writer has it
+ */
+struct shm_writer *shm_writer_open(const char *name);
+
+/* replace the sample in the segment, readers never wait for it; devices,
+ * trip points and sensors beyond the fixed number the segment has room for
+ * are left out, strings are cut to its fixed length
+ *
+ * Pre: the classes set as bits of device_nr are filled in s
+ */
+void shm_write(struct shm_writer *w, struct sample *s, unsigned int classes, long long time_ms);
+
+/* mark the segment closed for its readers and remove it */
+void shm_writer_close(struct shm_writer *w);
+
+/* Post: returns NULL with errno set, EINVAL if name is not a segment of
+ *       this version
+ */
+struct shm_reader *shm_reader_open(const char *name);
+
+/* copy the last sample written without locks or system calls; the records
+ * of s are those of r and valid until the next read, thermal zones have no
+ * by_temp yet
+ *
+ * Post: returns 0, or -1 with errno EAGAIN if nothing was written yet or
+ *       the writer did not finish a sample while it was being read, ESTALE
+ *       if the writer closed the segment or another replaced it
+ */
+int shm_read(struct shm_reader *r, struct sample *s, unsigned int *classes, long long *time_ms);
+
+void shm_reader_close(struct shm_reader *r);
+
+#endif
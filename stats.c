@@ -0,0 +1,238 @@
+/* counting what the reading of a sample costs
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#ifdef ENABLE_STATS
+
+/* bucket k of a histogram counts times below 2^k microseconds and at
+ * least half of that, the last one everything above */
+#define STATS_BUCKETS	24
+
+struct stats_entry {
+    char *name;
+    long count;
+    long errors;
+    long syscalls;
+    long long bytes;
+    long long ns;
+    long long max_ns;
+    long hist[STATS_BUCKETS];
+};
+
+/* entries in the order they were first seen, found through a hash table
+ * of their indexes plus one */
+struct stats_table {
+    int n;
+    int size;			/* of entries, slots has twice as many */
+    struct stats_entry *entries;
+    int *slots;
+};
+
+struct stats {
+    struct stats_entry stages[STATS_STAGES];
+    struct stats_table devices;
+    struct stats_table attrs;
+    long lost;			/* reads not counted for lack of memory */
+};
+
+static const char *stage_names[STATS_STAGES] = { "enumerate", "read", "parse", "render" };
+
+struct stats *stats_new(void)
+{
+    return calloc(1, sizeof(struct stats));
+}
+
+static void free_table(struct stats_table *t)
+{
+    int i;
+
+    for (i = 0; i < t->n; i++)
+	free(t->entries[i].name);
+    free(t->entries);
+    free(t->slots);
+}
+
+void stats_free(struct stats *st)
+{
+    if (!st)
+	return;
+    free_table(&st->devices);
+    free_table(&st->attrs);
+    free(st);
+}
+
+long long stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void add_time(struct stats_entry *e, long long ns)
+{
+    long long us = ns / 1000;
+    int k = 0;
+
+    while (us && k < STATS_BUCKETS - 1) {
+	us >>= 1;
+	k++;
+    }
+    e->hist[k]++;
+    e->count++;
+    e->ns += ns;
+    if (ns > e->max_ns)
+	e->max_ns = ns;
+}
+
+void stats_stage(struct stats *st, int stage, long long ns)
+{
+    add_time(&st->stages[stage], ns);
+}
+
+static unsigned int hash(const char *s)
+{
+    unsigned int h = 5381;
+
+    while (*s)
+	h = h * 33 + (unsigned char) *s++;
+    return h;
+}
+
+static int *find_slot(struct stats_table *t, const char *name)
+{
+    unsigned int i = hash(name) & (2 * t->size - 1);
+
+    while (t->slots[i] && strcmp(t->entries[t->slots[i] - 1].name, name))
+	i = (i + 1) & (2 * t->size - 1);
+    return &t->slots[i];
+}
+
+/* returns NULL if there is no memory for a new entry */
+static struct stats_entry *lookup(struct stats_table *t, const char *name)
+{
+    struct stats_entry *entries;
+    int *slots, *slot, size, i;
+
+    if (t->size) {
+	slot = find_slot(t, name);
+	if (*slot)
+	    return &t->entries[*slot - 1];
+    }
+    if (t->n == t->size) {
+	size = t->size ? 2 * t->size : 64;
+	entries = realloc(t->entries, size * sizeof(struct stats_entry));
+	if (!entries)
+	    return NULL;
+	t->entries = entries;
+	slots = calloc(2 * size, sizeof(int));
+	if (!slots)
+	    return NULL;
+	free(t->slots);
+	t->slots = slots;
+	t->size = size;
+	for (i = 0; i < t->n; i++)
+	    *find_slot(t, t->entries[i].name) = i + 1;
+    }
+    memset(&t->entries[t->n], 0, sizeof(struct stats_entry));
+    t->entries[t->n].name = strdup(name);
+    if (!t->entries[t->n].name)
+	return NULL;
+    *find_slot(t, name) = ++t->n;
+    return &t->entries[t->n - 1];
+}
+
+static void add_file(struct stats_entry *e, long long ns, long bytes, int syscalls)
+{
+    add_time(e, ns);
+    e->syscalls += syscalls;
+    if (bytes < 0)
+	e->errors++;
+    else
+	e->bytes += bytes;
+}
+
+long long stats_file(struct stats *st, const char *device, const char *attr, long long ns, long bytes,
+		     int syscalls)
+{
+    struct stats_entry *d = lookup(&st->devices, device);
+    struct stats_entry *a = lookup(&st->attrs, attr);
+
+    if (!d || !a) {
+	st->lost++;
+	return ns;
+    }
+    add_file(d, ns, bytes, syscalls);
+    add_file(a, ns, bytes, syscalls);
+    return ns;
+}
+
+static void print_histogram(FILE *f, struct stats_entry *e)
+{
+    int k;
+
+    for (k = 0; k < STATS_BUCKETS; k++)
+	if (e->hist[k]) {
+	    if (k == STATS_BUCKETS - 1)
+		fprintf(f, " >=%ld:%ld", 1L << (k - 1), e->hist[k]);
+	    else
+		fprintf(f, " <%ld:%ld", 1L << k, e->hist[k]);
+	}
+    fputc('\n', f);
+}
+
+static void print_files(FILE *f, const char *what, struct stats_table *t)
+{
+    struct stats_entry *e;
+    int i;
+
+    fprintf(f, "\n%-20s %8s %10s %9s %7s %10s %10s  %s\n", what, "reads", "bytes", "syscalls", "errors",
+	    "mean us", "max us", "histogram (us)");
+    for (i = 0; i < t->n; i++) {
+	e = &t->entries[i];
+	fprintf(f, "%-20s %8ld %10lld %9ld %7ld %10.1f %10.1f ", e->name, e->count, e->bytes, e->syscalls,
+		e->errors, e->ns / 1e3 / e->count, e->max_ns / 1e3);
+	print_histogram(f, e);
+    }
+}
+
+void stats_print(struct stats *st, FILE *f)
+{
+    struct stats_entry *e;
+    long samples = st->stages[STATS_RENDER].count;
+    int i;
+
+    fprintf(f, "samples: %ld\n", samples);
+    fprintf(f, "\n%-20s %8s %12s %12s %10s  %s\n", "stage", "count", "total us", "per sample", "max us",
+	    "histogram (us)");
+    for (i = 0; i < STATS_STAGES; i++) {
+	e = &st->stages[i];
+	fprintf(f, "%-20s %8ld %12.1f %12.1f %10.1f ", stage_names[i], e->count, e->ns / 1e3,
+		samples ? e->ns / 1e3 / samples : 0, e->max_ns / 1e3);
+	print_histogram(f, e);
+    }
+    print_files(f, "attribute", &st->attrs);
+    print_files(f, "device", &st->devices);
+    if (st->lost)
+	fprintf(f, "\n%ld reads were not counted for lack of memory\n", st->lost);
+}
+
+#endif
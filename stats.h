@@ -0,0 +1,116 @@
+/* counting what the reading of a sample costs
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include "config.h"
+#include "prefix.h"
+
+/* the stages of a sample */
+enum stats_stage {
+    STATS_ENUMERATE,		/* listing the devices and their files */
+    STATS_READ,			/* reading the files */
+    STATS_PARSE,		/* turning what was read into records */
+    STATS_RENDER,		/* printing, recording or serving a sample */
+    STATS_STAGES
+};
+
+/* the counts of --stats, nothing is measured where there are none */
+struct stats;
+
+/* Only the STATS_* macros are used by the code that is measured, with the
+ * counts st to add to or NULL; in a build configured with --disable-stats
+ * they expand to nothing and their arguments are never evaluated. */
+#ifdef ENABLE_STATS
+
+/* Post: returns NULL if there is no memory */
+struct stats *stats_new(void);
+
+void stats_free(struct stats *st);
+
+/* nanoseconds of the monotonic clock */
+long long stats_clock(void);
+
+/* add ns to a stage */
+void stats_stage(struct stats *st, int stage, long long ns);
+
+/* count one read of attribute attr of device that returned bytes, or
+ * failed if it is negative, took ns and made syscalls syscalls; returns ns
+ *
+ * Not thread safe, the reader threads of a batch only note ns and syscalls
+ * in the file_read and the thread that started the batch counts them.
+ */
+long long stats_file(struct stats *st, const char *device, const char *attr, long long ns, long bytes,
+		     int syscalls);
+
+/* print the counts and latency histograms per stage, attribute and device */
+void stats_print(struct stats *st, FILE *f);
+
+#define STATS_NEW()		stats_new()
+#define STATS_FREE(st)		stats_free(st)
+#define STATS_START(st, start)	long long start = (st) ? stats_clock() : 0
+#define STATS_ADD(st, stage, ns) \
+    do { if (st) stats_stage(st, stage, ns); } while (0)
+/* add the time since start to a stage and start again */
+#define STATS_LAP(st, stage, start) \
+    do { if (st) { long long now_ = stats_clock(); stats_stage(st, stage, now_ - (start)); (start) = now_; } } while (0)
+#define STATS_FILE(st, device, attr, ns, bytes, syscalls) \
+    do { if (st) stats_file(st, device, attr, ns, bytes, syscalls); } while (0)
+/* add part of the time since start to one stage and the rest to another,
+ * then start again with no part */
+#define STATS_SPLIT(st, stage, part, rest, start) \
+    do { \
+	if (st) { \
+	    long long now_ = stats_clock(); \
+	    if (part) \
+		stats_stage(st, stage, part); \
+	    stats_stage(st, rest, now_ - (start) - (part)); \
+	    (part) = 0; \
+	    (start) = now_; \
+	} \
+    } while (0)
+/* a read that started at start, its time is added to total */
+#define STATS_FILE_SINCE(st, total, device, attr, start, bytes, syscalls) \
+    do { if (st) (total) += stats_file(st, device, attr, stats_clock() - (start), bytes, syscalls); } while (0)
+/* what the batch noted in the file_read r */
+#define STATS_BATCH_FILE(st, device, attr, r) \
+    STATS_FILE(st, device, attr, (r)->ns, (r)->result, (r)->syscalls)
+/* note in the file_read r how long it took since start */
+#define STATS_NOTE(st, r, start, calls) \
+    do { if (st) { (r)->ns = stats_clock() - (start); (r)->syscalls = (calls); } } while (0)
+#define STATS_PRINT(st, f) \
+    do { if (st) stats_print(st, f); } while (0)
+
+#else
+
+#define STATS_NEW()					((struct stats *) NULL)
+#define STATS_FREE(st)					((void) 0)
+#define STATS_START(st, start)				((void) 0)
+#define STATS_ADD(st, stage, ns)			((void) 0)
+#define STATS_LAP(st, stage, start)			((void) 0)
+#define STATS_SPLIT(st, stage, part, rest, start)	((void) 0)
+#define STATS_FILE(st, device, attr, ns, bytes, syscalls)	((void) 0)
+#define STATS_FILE_SINCE(st, total, device, attr, start, bytes, syscalls)	((void) 0)
+#define STATS_BATCH_FILE(st, device, attr, r)		((void) 0)
+#define STATS_NOTE(st, r, start, calls)			((void) 0)
+#define STATS_PRINT(st, f)				((void) 0)
+
+#endif
+
+#endif
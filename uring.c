@@ -0,0 +1,288 @@
+/* batched file reads with io_uring
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "uring.h"
+
+#ifdef HAVE_IO_URING
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES	64
+
+/* the ring is used without liburing, through the system calls and the
+ * rings shared with the kernel */
+struct uring {
+    int fd;
+    unsigned int entries;
+    void *sq_ring;
+    size_t sq_size;
+    void *cq_ring;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		   IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+/* the kernel has to know all operations a batch consists of */
+static int uring_supported(int fd)
+{
+    static const int ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+    struct io_uring_probe *probe;
+    size_t size = sizeof(*probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    int i, ok;
+
+    probe = calloc(1, size);
+    if (!probe)
+	return 0;
+    ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+    for (i = 0; ok && i < (int) (sizeof(ops) / sizeof(ops[0])); i++)
+	ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+struct uring *uring_open(void)
+{
+    struct io_uring_params p;
+    struct uring *u;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+#ifdef IORING_SETUP_DEFER_TASKRUN
+    /* completions are only needed when we wait for them, kernels before
+     * 6.1 do not know this and get a plain ring */
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+#endif
+    fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0 && errno == EINVAL) {
+	memset(&p, 0, sizeof(p));
+	fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    }
+    if (fd < 0)
+	return NULL;
+    if (!uring_supported(fd)) {
+	close(fd);
+	return NULL;
+    }
+
+    u = calloc(1, sizeof(struct uring));
+    if (!u) {
+	close(fd);
+	return NULL;
+    }
+    u->fd = fd;
+    u->entries = p.sq_entries;
+    u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_size > u->sq_size)
+	    u->sq_size = u->cq_size;
+	u->cq_size = 0;
+    }
+    u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		      fd, IORING_OFF_SQ_RING);
+    u->cq_ring = u->cq_size ? mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   fd, IORING_OFF_CQ_RING) : u->sq_ring;
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		   fd, IORING_OFF_SQES);
+    if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED || u->sqes == MAP_FAILED) {
+	uring_close(u);
+	return NULL;
+    }
+
+    u->sq_head = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *) ((char *) u->sq_ring + p.sq_off.array);
+    u->cq_head = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+    return u;
+}
+
+/* does reads[i] take part in the op step of a batch */
+static int uring_wants(struct file_read *r, int op)
+{
+    switch (op) {
+    case IORING_OP_OPENAT:
+	return r->path != NULL;
+    case IORING_OP_READ:
+	return r->fd >= 0 && r->result == 0;
+    default:
+	return r->path && r->fd >= 0;
+    }
+}
+
+static void uring_prep(struct io_uring_sqe *sqe, struct file_read *r, int op, int i)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->user_data = i;
+    switch (op) {
+    case IORING_OP_OPENAT:
+	sqe->fd = r->dir_fd;
+	sqe->addr = (unsigned long) r->path;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	break;
+    case IORING_OP_READ:
+	sqe->fd = r->fd;
+	sqe->addr = (unsigned long) r->buf;
+	sqe->len = r->size - 1;
+	sqe->off = 0;
+	break;
+    default:
+	sqe->fd = r->fd;
+	break;
+    }
+}
+
+static void uring_complete(struct file_read *r, int op, int res)
+{
+    switch (op) {
+    case IORING_OP_OPENAT:
+	if (res >= 0)
+	    r->fd = res;
+	else
+	    r->result = res;
+	break;
+    case IORING_OP_READ:
+	r->result = res;
+	if (res >= 0)
+	    r->buf[res] = '\0';
+	break;
+    default:
+	r->fd = -1;
+	break;
+    }
+}
+
+/* queue one step for all reads that need it, a ring full at a time, and
+ * wait for them with the same system call */
+static int uring_step(struct uring *u, struct file_read *reads, int n, int op)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int tail, head, queued, done;
+    int i = 0;
+
+    while (i < n) {
+	tail = *u->sq_tail;
+	for (queued = 0; i < n && queued < u->entries; i++) {
+	    if (!uring_wants(&reads[i], op))
+		continue;
+	    u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+	    uring_prep(&u->sqes[tail & *u->sq_mask], &reads[i], op, i);
+	    tail++;
+	    queued++;
+	}
+	if (!queued)
+	    break;
+	__atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+	if (uring_enter(u->fd, queued, queued) < 0 && errno != EINTR)
+	    return -1;
+	for (done = 0; done < queued; ) {
+	    head = *u->cq_head;
+	    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+		/* interrupted before everything was submitted or done */
+		head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+		if (uring_enter(u->fd, *u->sq_tail - head, 1) < 0 && errno != EINTR)
+		    return -1;
+		continue;
+	    }
+	    cqe = &u->cqes[head & *u->cq_mask];
+	    uring_complete(&reads[cqe->user_data], op, cqe->res);
+	    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+	    done++;
+	}
+    }
+    return 0;
+}
+
+int uring_read(struct uring *u, struct file_read *reads, int n)
+{
+    int i, ret;
+
+    for (i = 0; i < n; i++) {
+	reads[i].result = 0;
+	if (reads[i].path)
+	    reads[i].fd = -1;
+    }
+    ret = uring_step(u, reads, n, IORING_OP_OPENAT);
+    if (!ret)
+	ret = uring_step(u, reads, n, IORING_OP_READ);
+    /* files opened for the batch are closed even if it failed */
+    if (uring_step(u, reads, n, IORING_OP_CLOSE) < 0)
+	ret = -1;
+    for (i = 0; ret < 0 && i < n; i++)
+	if (reads[i].path && reads[i].fd >= 0) {
+	    close(reads[i].fd);
+	    reads[i].fd = -1;
+	}
+    return ret;
+}
+
+void uring_close(struct uring *u)
+{
+    if (!u)
+	return;
+    if (u->sqes && u->sqes != MAP_FAILED)
+	munmap(u->sqes, u->sqes_size);
+    if (u->cq_size && u->cq_ring && u->cq_ring != MAP_FAILED)
+	munmap(u->cq_ring, u->cq_size);
+    if (u->sq_ring && u->sq_ring != MAP_FAILED)
+	munmap(u->sq_ring, u->sq_size);
+    close(u->fd);
+    free(u);
+}
+
+#else
+
+/* built without io_uring, the files are always read one by one */
+struct uring *uring_open(void)
+{
+    return NULL;
+}
+
+int uring_read(struct uring *u, struct file_read *reads, int n)
+{
+    return -1;
+}
+
+void uring_close(struct uring *u)
+{
+}
+
+#endif
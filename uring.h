@@ -0,0 +1,48 @@
+/* batched file reads with io_uring
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _URING_H
+#define _URING_H
+
+#include "batch.h"
+#include "prefix.h"
+
+struct uring;
+
+/* set up a ring
+ *
+ * Post: returns NULL if io_uring was left out of the build or the kernel
+ *       does not support it, the caller then reads the files itself
+ */
+struct uring *uring_open(void);
+
+/* read the start of a number of files
+ *
+ * Pre: u != NULL, reads has n entries
+ * Post: reads[i].buf holds a null terminated string of reads[i].result
+ *       bytes for every read that succeeded, returns -1 if the ring failed
+ *       and nothing can be said about the reads
+ */
+int uring_read(struct uring *u, struct file_read *reads, int n);
+
+/* tear down a ring
+ *
+ * Pre: u is NULL or returned by uring_open
+ */
+void uring_close(struct uring *u);
+
+#endif
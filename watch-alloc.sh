@@ -0,0 +1,81 @@
+#!/bin/sh
+# make check: once --watch has taken its first samples it allocates no
+# more memory, counted by mallocount.so
+
+tree=$(mktemp -d "${TMPDIR:-/tmp}/acpi-check.XXXXXX") || exit 1
+trap 'rm -rf "$tree"' EXIT
+
+put() {
+	mkdir -p "$tree/sys/$(dirname "$1")"
+	printf '%s\n' "$2" > "$tree/sys/$1"
+}
+
+# a battery with a uevent file, one without, and one of every other class
+put power_supply/BAT0/uevent "POWER_SUPPLY_NAME=BAT0
+POWER_SUPPLY_TYPE=Battery
+POWER_SUPPLY_STATUS=Discharging
+POWER_SUPPLY_PRESENT=1
+POWER_SUPPLY_VOLTAGE_NOW=12000000
+POWER_SUPPLY_CURRENT_NOW=1500000
+POWER_SUPPLY_CHARGE_FULL_DESIGN=5000000
+POWER_SUPPLY_CHARGE_FULL=4000000
+POWER_SUPPLY_CHARGE_NOW=3000000
+POWER_SUPPLY_CAPACITY=75"
+put power_supply/BAT0/type Battery
+put power_supply/BAT1/type Battery
+put power_supply/BAT1/status Charging
+put power_supply/BAT1/energy_now 20000000
+put power_supply/BAT1/energy_full 40000000
+put power_supply/BAT1/energy_full_design 50000000
+put power_supply/BAT1/power_now 5000000
+put power_supply/BAT1/voltage_now 11000000
+put power_supply/AC/uevent "POWER_SUPPLY_NAME=AC
+POWER_SUPPLY_ONLINE=1"
+put power_supply/AC/type Mains
+put thermal/thermal_zone0/type acpitz
+put thermal/thermal_zone0/temp 55000
+put thermal/thermal_zone0/trip_point_0_type critical
+put thermal/thermal_zone0/trip_point_0_temp 98000
+put thermal/thermal_zone0/trip_point_1_type passive
+put thermal/thermal_zone0/trip_point_1_temp 50000
+put thermal/cooling_device0/type Processor
+put thermal/cooling_device0/cur_state 1
+put thermal/cooling_device0/max_state 10
+put hwmon/hwmon0/name coretemp
+put hwmon/hwmon0/temp1_label "Package id 0"
+put hwmon/hwmon0/temp1_input 48000
+put hwmon/hwmon0/temp1_crit 100000
+put hwmon/hwmon0/fan1_input 2100
+
+# the allocations acpi --watch $1 makes in 2 seconds after a second to
+# warm up, as "<after warm-up> <2 seconds later>"
+allocations() {
+	rm -f "$tree/count"
+	MALLOC_COUNT="$tree/count" LD_PRELOAD="$PWD/.libs/mallocount.so" \
+		./acpi -V -H -i -d "$tree/sys" -w 0.02 $1 > /dev/null &
+	pid=$!
+	for wait in 1 2; do
+		sleep $wait
+		kill -USR1 $pid || return 1
+		sleep 0.2
+		cat "$tree/count" || return 1
+	done
+	kill -TERM $pid
+	wait $pid 2> /dev/null
+	return 0
+}
+
+fail=0
+for options in "" "-j 1" "-D 1000" "-o json" "-A 0.2"; do
+	counts=$(allocations "$options") || {
+		echo "acpi --watch $options failed"
+		fail=1
+		continue
+	}
+	set -- $counts
+	if [ "$1" != "$2" ]; then
+		echo "acpi --watch $options: $(($2 - $1)) allocations after warm-up"
+		fail=1
+	fi
+done
+exit $fail
@@ -0,0 +1,31 @@
+#!/bin/sh
+# make check: the quantiles of --summarize hold for a thermal zone below
+# freezing, whose temperatures are all negative
+
+tree=$(mktemp -d "${TMPDIR:-/tmp}/acpi-check.XXXXXX") || exit 1
+trap 'rm -rf "$tree"' EXIT
+
+mkdir -p "$tree/sys/thermal/thermal_zone0"
+echo acpitz > "$tree/sys/thermal/thermal_zone0/type"
+for temp in -20000 -15000 -10000 -5000 -1000 -500; do
+	echo $temp > "$tree/sys/thermal/thermal_zone0/temp"
+	./acpi -t -d "$tree/sys" -r "$tree/recording" || exit 1
+done
+
+summary=$(./acpi -t -R "$tree/recording" --summarize 3600 -o ndjson) || exit 1
+# a value in millidegrees C
+value() {
+	echo "$summary" | sed -n "s/.*\"$1\": *\(-*[0-9]*\).*/\1/p"
+}
+fail=0
+for expected in min:-20000 max:-500 p50:-10000 p95:-1000 p99:-1000; do
+	name=${expected%:*}
+	want=${expected#*:}
+	got=$(value $name)
+	# within the accuracy of the sketch
+	if [ -z "$got" ] || [ $((got - want)) -gt $((-want / 50)) ] || [ $((want - got)) -gt $((-want / 50)) ]; then
+		echo "$name of -20, -15, -10, -5, -1 and -0.5 degrees C is $got, not about $want"
+		fail=1
+	fi
+done
+exit $fail
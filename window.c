@@ -0,0 +1,441 @@
+/* statistics of watched values over a rolling window
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "acpi.h"
+#include "window.h"
+
+/* The window is a ring of panes, each the time between two summaries, and
+ * a summary merges them. The values of a device in a pane are kept in a
+ * DDSketch: a value v is counted in bin ceil(log(v) / log(gamma)), whose
+ * middle is within SKETCH_ACCURACY of every value in it. A store has a
+ * fixed number of bins, values too far below the highest ones are counted
+ * in its lowest bin, which only costs accuracy near zero. Negative values,
+ * like a zone below freezing, go by their magnitude to a store of their
+ * own; values closer to zero than SKETCH_MIN_VALUE, like a battery drawing
+ * nothing, are counted apart as zero. */
+#define SKETCH_ACCURACY		0.01
+#define SKETCH_BINS		256	/* a range of 1:160 at full accuracy */
+#define SKETCH_MIN_VALUE	1e-3
+
+#define SERIES_BATTERIES	0
+#define SERIES_ZONES		1
+
+struct store {
+    long binned;
+    int offset;			/* the key of bins[0] */
+    unsigned int bins[SKETCH_BINS];
+};
+
+struct sketch {
+    long count;
+    long zero;			/* values within SKETCH_MIN_VALUE of zero */
+    struct store positive;
+    struct store negative;	/* by magnitude */
+    double min;
+    double max;
+    double sum;
+};
+
+/* the values of a battery or thermal zone */
+struct series {
+    struct sketch *panes;
+    int n_trip;
+    struct trip_point *trip;	/* the last ones, with copies of their types */
+    long long *above_ms;	/* n_trip per pane */
+    int have_last;
+    double last;		/* held until the next sample */
+};
+
+struct window {
+    unsigned int classes;
+    long long every_ms;
+    int n_panes;
+    int cur;			/* the pane being filled */
+    long long start_ms;		/* of the first sample */
+    long long due_ms;		/* of the next summary */
+    long long last_ms;		/* of the last sample, 0 before the first */
+    int pending;		/* samples were added since the last summary */
+    int n_last[2];		/* devices of the last sample */
+    int n_series[2];
+    struct series *series[2];
+    struct sketch merged;
+    struct window_summary summary;
+    int summary_size[2];
+    long long *above_ms;	/* of the summary */
+    int above_size;
+};
+
+/* log(gamma), the same for every sketch */
+static double log_gamma;
+
+static void *window_alloc(void *p, size_t size)
+{
+    p = realloc(p, size ? size : 1);
+    if (!p) {
+	fprintf(stderr, "Out of memory. Could not allocate memory in window.\n");
+	exit(1);
+    }
+    return p;
+}
+
+static void sketch_clear(struct sketch *sk)
+{
+    memset(sk, 0, sizeof(*sk));
+}
+
+/* move the bins to start at key offset, those below it go to the lowest */
+static void store_rebase(struct store *st, int offset)
+{
+    unsigned int bins[SKETCH_BINS];
+    int i, j;
+
+    memset(bins, 0, sizeof(bins));
+    for (i = 0; i < SKETCH_BINS; i++) {
+	if (!st->bins[i])
+	    continue;
+	j = st->offset + i - offset;
+	bins[j < 0 ? 0 : j < SKETCH_BINS ? j : SKETCH_BINS - 1] += st->bins[i];
+    }
+    memcpy(st->bins, bins, sizeof(bins));
+    st->offset = offset;
+}
+
+static void store_insert(struct store *st, int key, unsigned int count)
+{
+    int hi;
+
+    if (!st->binned) {
+	st->offset = key - SKETCH_BINS / 2;
+    } else if (key < st->offset) {
+	/* make room below as far as the highest bin allows */
+	for (hi = SKETCH_BINS - 1; hi > 0 && !st->bins[hi]; hi--)
+	    ;
+	if (st->offset + hi - key < SKETCH_BINS)
+	    store_rebase(st, key);
+	else
+	    store_rebase(st, st->offset + hi - SKETCH_BINS + 1);
+	if (key < st->offset)
+	    key = st->offset;
+    } else if (key >= st->offset + SKETCH_BINS) {
+	store_rebase(st, key - SKETCH_BINS + 1);
+    }
+    st->bins[key - st->offset] += count;
+    st->binned += count;
+}
+
+static void store_merge(struct store *dst, struct store *src)
+{
+    int i;
+
+    for (i = 0; i < SKETCH_BINS; i++)
+	if (src->bins[i])
+	    store_insert(dst, src->offset + i, src->bins[i]);
+}
+
+/* the middle of a bin */
+static double store_value(struct store *st, int i)
+{
+    return 2 * exp((st->offset + i) * log_gamma) / (1 + exp(log_gamma));
+}
+
+static void sketch_add(struct sketch *sk, double v)
+{
+    if (!sk->count || v < sk->min)
+	sk->min = v;
+    if (!sk->count || v > sk->max)
+	sk->max = v;
+    sk->count++;
+    sk->sum += v;
+    if (v >= SKETCH_MIN_VALUE)
+	store_insert(&sk->positive, (int) ceil(log(v) / log_gamma), 1);
+    else if (v <= -SKETCH_MIN_VALUE)
+	store_insert(&sk->negative, (int) ceil(log(-v) / log_gamma), 1);
+    else
+	sk->zero++;
+}
+
+static void sketch_merge(struct sketch *dst, struct sketch *src)
+{
+    if (!src->count)
+	return;
+    if (!dst->count || src->min < dst->min)
+	dst->min = src->min;
+    if (!dst->count || src->max > dst->max)
+	dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->zero += src->zero;
+    store_merge(&dst->positive, &src->positive);
+    store_merge(&dst->negative, &src->negative);
+}
+
+/* the middle of the bin of the value of rank q, within the values seen;
+ * the negative values come first, the largest magnitude lowest */
+static double sketch_quantile(struct sketch *sk, double q)
+{
+    double rank = q * (sk->count - 1), v = sk->max;
+    long seen = 0;
+    int i;
+
+    for (i = SKETCH_BINS - 1; i >= 0 && seen <= rank; i--)
+	if ((seen += sk->negative.bins[i]) > rank)
+	    v = -store_value(&sk->negative, i);
+    if (seen <= rank && (seen += sk->zero) > rank)
+	v = 0;
+    for (i = 0; i < SKETCH_BINS && seen <= rank; i++)
+	if ((seen += sk->positive.bins[i]) > rank)
+	    v = store_value(&sk->positive, i);
+    return v < sk->min ? sk->min : v > sk->max ? sk->max : v;
+}
+
+struct window *window_open(unsigned int classes, long long window_ms, long long every_ms)
+{
+    struct window *w = calloc(1, sizeof(struct window));
+
+    if (!w)
+	return NULL;
+    log_gamma = log((1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY));
+    w->classes = classes;
+    w->every_ms = every_ms;
+    w->n_panes = (window_ms + every_ms - 1) / every_ms;
+    if (w->n_panes > WINDOW_PANES)
+	w->n_panes = WINDOW_PANES;
+    return w;
+}
+
+static void free_trip_types(struct series *sr)
+{
+    int j;
+
+    for (j = 0; j < sr->n_trip; j++)
+	free(sr->trip[j].type);
+}
+
+/* series i of a kind, with room for n_trip trip points; the time above
+ * them starts over if a zone gets others */
+static struct series *get_series(struct window *w, int kind, int i, int n_trip)
+{
+    struct series *sr;
+    int n = w->n_series[kind];
+
+    if (i >= n) {
+	w->series[kind] = window_alloc(w->series[kind], (i + 1) * sizeof(struct series));
+	memset(&w->series[kind][n], 0, (i + 1 - n) * sizeof(struct series));
+	for (; n <= i; n++) {
+	    w->series[kind][n].panes = window_alloc(NULL, w->n_panes * sizeof(struct sketch));
+	    memset(w->series[kind][n].panes, 0, w->n_panes * sizeof(struct sketch));
+	}
+	w->n_series[kind] = i + 1;
+    }
+    sr = &w->series[kind][i];
+    if (n_trip != sr->n_trip) {
+	sr->above_ms = window_alloc(sr->above_ms, (size_t) w->n_panes * n_trip * sizeof(long long));
+	memset(sr->above_ms, 0, (size_t) w->n_panes * n_trip * sizeof(long long));
+	free_trip_types(sr);
+	sr->trip = window_alloc(sr->trip, n_trip * sizeof(struct trip_point));
+	memset(sr->trip, 0, n_trip * sizeof(struct trip_point));
+	sr->n_trip = n_trip;
+    }
+    return sr;
+}
+
+/* the power a battery draws or takes in uW, if it tells */
+static int battery_power(struct battery_info *b, double *power)
+{
+    if (HAS_ATTR(b, ATTR_POWER_NOW))
+	*power = fabs((double) b->power_now);
+    else if (HAS_ATTR(b, ATTR_CURRENT_NOW) && HAS_ATTR(b, ATTR_VOLTAGE_NOW))
+	*power = fabs((double) b->current_now * b->voltage_now / 1000000);
+    else
+	return FALSE;
+    return TRUE;
+}
+
+static void add_zone(struct window *w, int i, struct thermal_info *z, long long dt)
+{
+    struct series *sr = get_series(w, SERIES_ZONES, i, z->n_trip);
+    long long *above = sr->above_ms + (size_t) w->cur * sr->n_trip;
+    int j;
+
+    if (sr->have_last && dt > 0)
+	for (j = 0; j < z->n_trip; j++)
+	    if (z->trip[j].temp >= MIN_TEMP && sr->last >= z->trip[j].temp)
+		above[j] += dt;
+    /* a summary may come after the records are gone */
+    for (j = 0; j < z->n_trip; j++) {
+	sr->trip[j].temp = z->trip[j].temp;
+	if (z->trip[j].type && (!sr->trip[j].type || strcmp(z->trip[j].type, sr->trip[j].type))) {
+	    free(sr->trip[j].type);
+	    sr->trip[j].type = strdup(z->trip[j].type);
+	    if (!sr->trip[j].type) {
+		fprintf(stderr, "Out of memory. Could not allocate memory in window.\n");
+		exit(1);
+	    }
+	}
+    }
+    sr->have_last = (z->have & (ATTR_BIT(ATTR_TEMP) | ATTR_BIT(ATTR_TEMPERATURE))) != 0;
+    if (!sr->have_last)
+	return;
+    sr->last = z->temperature;
+    sketch_add(&sr->panes[w->cur], z->temperature);
+}
+
+int window_add(struct window *w, struct sample *s, long long time_ms)
+{
+    struct series *sr;
+    long long dt = 0;
+    double power;
+    int i;
+
+    if (!w->last_ms) {
+	w->start_ms = time_ms;
+	w->due_ms = time_ms + w->every_ms;
+    } else if (time_ms > w->last_ms) {
+	dt = time_ms - w->last_ms;
+    }
+    if (w->classes & (1 << BATTERY)) {
+	for (i = 0; i < s->n_batteries; i++) {
+	    sr = get_series(w, SERIES_BATTERIES, i, 0);
+	    if (battery_power(&s->batteries[i], &power))
+		sketch_add(&sr->panes[w->cur], power);
+	}
+    }
+    if (w->classes & (1 << THERMAL_ZONE))
+	for (i = 0; i < s->n_zones; i++)
+	    add_zone(w, i, &s->zones[i], dt);
+    w->n_last[SERIES_BATTERIES] = w->classes & (1 << BATTERY) ? s->n_batteries : 0;
+    w->n_last[SERIES_ZONES] = w->classes & (1 << THERMAL_ZONE) ? s->n_zones : 0;
+    w->last_ms = time_ms;
+    w->pending = TRUE;
+    return time_ms >= w->due_ms;
+}
+
+/* the time above trip points goes to *above, which is moved past it */
+static void summarize_series(struct window *w, struct series *sr, struct series_summary *sum, long long **above)
+{
+    struct sketch *m = &w->merged;
+    int p, j;
+
+    sketch_clear(m);
+    for (p = 0; p < w->n_panes; p++)
+	sketch_merge(m, &sr->panes[p]);
+    memset(sum, 0, sizeof(*sum));
+    sum->n = m->count;
+    if (m->count) {
+	sum->min = m->min;
+	sum->max = m->max;
+	sum->mean = m->sum / m->count;
+	sum->p50 = sketch_quantile(m, 0.50);
+	sum->p95 = sketch_quantile(m, 0.95);
+	sum->p99 = sketch_quantile(m, 0.99);
+    }
+    sum->n_trip = sr->n_trip;
+    sum->trip = sr->trip;
+    sum->above_ms = *above;
+    *above += sr->n_trip;
+    for (j = 0; j < sr->n_trip; j++) {
+	sum->above_ms[j] = 0;
+	for (p = 0; p < w->n_panes; p++)
+	    sum->above_ms[j] += sr->above_ms[(size_t) p * sr->n_trip + j];
+    }
+}
+
+/* the summaries of the devices of kind there are in the last sample */
+static struct series_summary *summarize_kind(struct window *w, int kind, int n, int *n_sum, long long **above)
+{
+    struct series_summary *sums = kind == SERIES_BATTERIES ? w->summary.batteries : w->summary.zones;
+    int i;
+
+    if (n > w->n_series[kind])
+	n = w->n_series[kind];
+    if (n > w->summary_size[kind]) {
+	sums = window_alloc(sums, n * sizeof(struct series_summary));
+	w->summary_size[kind] = n;
+    }
+    for (i = 0; i < n; i++)
+	summarize_series(w, &w->series[kind][i], &sums[i], above);
+    *n_sum = n;
+    return sums;
+}
+
+struct window_summary *window_summarize(struct window *w)
+{
+    struct window_summary *sum = &w->summary;
+    struct series *sr;
+    long long oldest = w->due_ms - w->n_panes * w->every_ms, *above;
+    int kind, i, n_trip = 0;
+
+    /* one array holds the time above the trip points of every zone */
+    for (i = 0; i < w->n_series[SERIES_ZONES]; i++)
+	n_trip += w->series[SERIES_ZONES][i].n_trip;
+    if (n_trip > w->above_size) {
+	w->above_ms = window_alloc(w->above_ms, n_trip * sizeof(long long));
+	w->above_size = n_trip;
+    }
+    above = w->above_ms;
+    w->pending = FALSE;
+
+    sum->time_ms = w->last_ms;
+    sum->window_ms = w->last_ms - (oldest > w->start_ms ? oldest : w->start_ms);
+    sum->batteries = summarize_kind(w, SERIES_BATTERIES, w->n_last[SERIES_BATTERIES], &sum->n_batteries, &above);
+    sum->zones = summarize_kind(w, SERIES_ZONES, w->n_last[SERIES_ZONES], &sum->n_zones, &above);
+
+    /* the next pane starts empty, and so do those a pause skipped */
+    do {
+	w->cur = (w->cur + 1) % w->n_panes;
+	for (kind = 0; kind < 2; kind++) {
+	    for (i = 0; i < w->n_series[kind]; i++) {
+		sr = &w->series[kind][i];
+		sketch_clear(&sr->panes[w->cur]);
+		if (sr->n_trip)
+		    memset(sr->above_ms + (size_t) w->cur * sr->n_trip, 0, sr->n_trip * sizeof(long long));
+	    }
+	}
+	w->due_ms += w->every_ms;
+    } while (w->due_ms <= w->last_ms);
+    return sum;
+}
+
+int window_pending(struct window *w)
+{
+    return w->pending;
+}
+
+void window_close(struct window *w)
+{
+    int kind, i;
+
+    if (!w)
+	return;
+    for (kind = 0; kind < 2; kind++) {
+	for (i = 0; i < w->n_series[kind]; i++) {
+	    free_trip_types(&w->series[kind][i]);
+	    free(w->series[kind][i].panes);
+	    free(w->series[kind][i].trip);
+	    free(w->series[kind][i].above_ms);
+	}
+	free(w->series[kind]);
+    }
+    free(w->summary.batteries);
+    free(w->summary.zones);
+    free(w->above_ms);
+    free(w);
+}
@@ -0,0 +1,83 @@
+/* statistics of watched values over a rolling window
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _WINDOW_H
+#define _WINDOW_H
+
+/* the most parts a window is kept in, each the length of the time between
+ * two summaries */
+#define WINDOW_PANES	60
+
+struct sample;
+struct trip_point;
+
+/* the values of a device over a window */
+struct series_summary {
+	long n;			/* 0 if there were none */
+	double min;
+	double max;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+	int n_trip;		/* of a thermal zone, as they were last */
+	struct trip_point *trip;
+	long long *above_ms;	/* by trip point */
+};
+
+/* temperatures are in degrees C and power draws in uW, like the records */
+struct window_summary {
+	long long time_ms;
+	long long window_ms;	/* what the window covers so far */
+	int n_batteries;
+	struct series_summary *batteries;
+	int n_zones;
+	struct series_summary *zones;
+};
+
+struct window;
+
+/* summarize the power draw of every battery if classes has BATTERY and
+ * the temperature of every thermal zone if it has THERMAL_ZONE, over the
+ * last window_ms every every_ms
+ *
+ * Pre: every_ms > 0, window_ms >= every_ms and at most WINDOW_PANES times
+ *      every_ms
+ * Post: returns NULL if there is no memory; window_add and window_summarize
+ *       exit if they run out of it later
+ */
+struct window *window_open(unsigned int classes, long long window_ms, long long every_ms);
+
+/* add a sample taken at time_ms, the time since the one before counts for
+ * the values of that one; samples must come in order
+ *
+ * Post: returns TRUE if a summary is due
+ */
+int window_add(struct window *w, struct sample *s, long long time_ms);
+
+/* the summary of the window up to the last sample, of the devices that
+ * sample had, which starts the next part of the window; it is valid until
+ * the next call */
+struct window_summary *window_summarize(struct window *w);
+
+/* whether samples were added since the last summary, which are to be
+ * summarized before the window is closed */
+int window_pending(struct window *w);
+
+void window_close(struct window *w);
+
+#endif